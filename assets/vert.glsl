@@ -8,24 +8,62 @@ in vec4 VertexBlendWeights;
 
 uniform mat4 MVP;
 uniform bool Animated;
-uniform mat4 Bones[32];
+// Always on texture unit 13, which sushi's draw functions set even for static meshes,
+// since a sampler left on unit 0 would clash with the sampler2D there.
+uniform samplerBuffer BonePalette;
+uniform int BoneOffset;
+uniform int BoneStride;
+uniform bool OctahedralNormals;
+uniform bool Morphed;
+uniform sampler2D MorphPositions;
+uniform sampler2D MorphNormals;
 
 out vec2 TexCoord;
 out vec3 Normal;
 
+// Normals encoded with sushi::mesh_options::octahedral_normals arrive in VertexNormal.xy.
+vec3 decode_octahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+// Skinning matrices from sushi::bone_palette_buffer, stored as their top 3 rows.
+// Each instance reads its own palette, BoneStride matrices after the previous one.
+mat4 get_bone(float index) {
+    int texel = (BoneOffset + gl_InstanceID * BoneStride + int(index)) * 3;
+    vec4 row0 = texelFetch(BonePalette, texel);
+    vec4 row1 = texelFetch(BonePalette, texel + 1);
+    vec4 row2 = texelFetch(BonePalette, texel + 2);
+    return transpose(mat4(row0, row1, row2, vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
 void main() {
     mat4 transform = MVP;
 
 	if (Animated) {
         transform =
             MVP * (
-                Bones[int(VertexBlendIndices[0])] * VertexBlendWeights[0] +
-                Bones[int(VertexBlendIndices[1])] * VertexBlendWeights[1] +
-                Bones[int(VertexBlendIndices[2])] * VertexBlendWeights[2] +
-                Bones[int(VertexBlendIndices[3])] * VertexBlendWeights[3]);
+                get_bone(VertexBlendIndices[0]) * VertexBlendWeights[0] +
+                get_bone(VertexBlendIndices[1]) * VertexBlendWeights[1] +
+                get_bone(VertexBlendIndices[2]) * VertexBlendWeights[2] +
+                get_bone(VertexBlendIndices[3]) * VertexBlendWeights[3]);
+    }
+
+    vec3 position = VertexPosition;
+    vec3 normal = OctahedralNormals ? decode_octahedral(VertexNormal.xy) : VertexNormal;
+
+    // Blended sparse morph target offsets from sushi::morph_target_set, one texel per vertex.
+    if (Morphed) {
+        int width = textureSize(MorphPositions, 0).x;
+        ivec2 texel = ivec2(gl_VertexID % width, gl_VertexID / width);
+        position += texelFetch(MorphPositions, texel, 0).xyz;
+        normal = normalize(normal + texelFetch(MorphNormals, texel, 0).xyz);
     }
 
     TexCoord = VertexTexCoord;
-    Normal = vec3(transpose(inverse(transform)) * vec4(VertexNormal, 0.0));
-    gl_Position = transform * vec4(VertexPosition, 1.0);
+    Normal = vec3(transpose(inverse(transform)) * vec4(normal, 0.0));
+    gl_Position = transform * vec4(position, 1.0);
 }
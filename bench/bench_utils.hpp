@@ -0,0 +1,308 @@
+#ifndef SUSHI_BENCH_UTILS_HPP
+#define SUSHI_BENCH_UTILS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+/// Helpers shared by the benchmarks.
+namespace sushi_bench {
+
+/// Runs a function several times.
+/// \param runs Number of runs.
+/// \param f Function to run.
+/// \return Duration of the fastest run, in milliseconds.
+template <typename F>
+auto time_best_of(int runs, F&& f) -> double {
+    auto best = 0.0;
+    for (auto i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        auto ms = std::chrono::duration<double, std::milli>(end - start).count();
+        best = i == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+/// Gets the thread pool sizes to time: 1, 2 and 4 threads, then doubling up to every hardware thread.
+inline auto get_thread_counts() -> std::vector<unsigned> {
+    auto hardware = std::max(1u, std::thread::hardware_concurrency());
+    auto counts = std::vector<unsigned>{1, 2, 4};
+
+    while (counts.back() * 2 < hardware) {
+        counts.push_back(counts.back() * 2);
+    }
+
+    if (counts.back() < hardware) {
+        counts.push_back(hardware);
+    }
+
+    return counts;
+}
+
+/// Gets the peak resident set size of the current process.
+/// \return Peak resident set size in bytes, or 0 if the platform does not report it.
+inline auto get_peak_rss() -> std::size_t {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return std::size_t(usage.ru_maxrss);
+#else
+    return std::size_t(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+/// Sizes of a synthetic IQM file.
+struct iqm_params {
+    std::uint32_t num_vertexes = 1000000;
+    std::uint32_t num_triangles = 2000000;
+    std::uint32_t num_joints = 64;
+    std::uint32_t num_frames = 1000;
+};
+
+/// Writes a synthetic IQM file, with positions, texcoords, normals, blend indices and weights, a skeleton,
+/// and a single animation in which every pose channel is animated.
+/// \param fname File name.
+/// \param params Sizes of the file.
+/// \return True if the file was written.
+inline auto write_iqm_file(const std::string& fname, const iqm_params& params) -> bool {
+    constexpr std::uint32_t iqm_ubyte = 1;
+    constexpr std::uint32_t iqm_float = 7;
+    constexpr std::uint32_t header_size = 16 + 27 * 4;
+
+    auto bytes = std::vector<unsigned char>();
+
+    auto put_u32 = [&](std::uint32_t v) {
+        for (auto i = 0; i < 4; ++i) {
+            bytes.push_back(static_cast<unsigned char>(v >> (8 * i)));
+        }
+    };
+
+    auto set_u32 = [&](std::size_t pos, std::uint32_t v) {
+        for (auto i = 0; i < 4; ++i) {
+            bytes[pos + i] = static_cast<unsigned char>(v >> (8 * i));
+        }
+    };
+
+    auto put_float = [&](float f) {
+        std::uint32_t v;
+        std::memcpy(&v, &f, sizeof(v));
+        put_u32(v);
+    };
+
+    auto put_u16 = [&](std::uint16_t v) {
+        bytes.push_back(static_cast<unsigned char>(v));
+        bytes.push_back(static_cast<unsigned char>(v >> 8));
+    };
+
+    auto here = [&] { return static_cast<std::uint32_t>(bytes.size()); };
+
+    const auto nv = params.num_vertexes;
+    const auto nj = params.num_joints;
+    const auto nf = params.num_frames;
+    const auto num_framechannels = nj * 10;
+
+    bytes.resize(header_size);
+
+    const char text[] = "\0mesh\0material\0joint\0anim";
+    const auto ofs_text = here();
+    bytes.insert(bytes.end(), text, text + sizeof(text));
+    const auto num_text = here() - ofs_text;
+
+    const auto ofs_meshes = here();
+    put_u32(1);
+    put_u32(6);
+    put_u32(0);
+    put_u32(nv);
+    put_u32(0);
+    put_u32(params.num_triangles);
+
+    struct array_desc {
+        std::uint32_t type;
+        std::uint32_t format;
+        std::uint32_t size;
+    };
+
+    const array_desc arrays[] = {
+        {0, iqm_float, 3},
+        {1, iqm_float, 2},
+        {2, iqm_float, 3},
+        {4, iqm_ubyte, 4},
+        {5, iqm_ubyte, 4},
+    };
+
+    const auto ofs_vertexarrays = here();
+    bytes.resize(bytes.size() + std::size(arrays) * 5 * 4);
+
+    auto array_offsets = std::vector<std::uint32_t>();
+    for (const auto& a : arrays) {
+        array_offsets.push_back(here());
+        for (auto v = 0u; v < nv; ++v) {
+            for (auto c = 0u; c < a.size; ++c) {
+                if (a.format == iqm_float) {
+                    put_float(float(v % 1000) * 0.01f + float(c));
+                } else if (a.type == 4) {
+                    bytes.push_back(static_cast<unsigned char>((v + c) % nj));
+                } else {
+                    bytes.push_back(static_cast<unsigned char>(c == 0 ? 255 : 0));
+                }
+            }
+        }
+    }
+
+    for (auto i = std::size_t{0}; i < std::size(arrays); ++i) {
+        auto pos = ofs_vertexarrays + i * 5 * 4;
+        set_u32(pos, arrays[i].type);
+        set_u32(pos + 4, 0);
+        set_u32(pos + 8, arrays[i].format);
+        set_u32(pos + 12, arrays[i].size);
+        set_u32(pos + 16, array_offsets[i]);
+    }
+
+    const auto ofs_triangles = here();
+    for (auto t = 0u; t < params.num_triangles; ++t) {
+        put_u32(t % nv);
+        put_u32((t + 1) % nv);
+        put_u32((t + 2) % nv);
+    }
+
+    const auto ofs_joints = here();
+    for (auto j = 0u; j < nj; ++j) {
+        put_u32(15);
+        put_u32(j == 0 ? std::uint32_t(-1) : (j - 1) / 2);
+        put_float(0);
+        put_float(1);
+        put_float(0);
+        put_float(0);
+        put_float(0);
+        put_float(0);
+        put_float(1);
+        put_float(1);
+        put_float(1);
+        put_float(1);
+    }
+
+    const auto ofs_poses = here();
+    for (auto j = 0u; j < nj; ++j) {
+        put_u32(j == 0 ? std::uint32_t(-1) : (j - 1) / 2);
+        put_u32(0x3FF);
+        for (auto c = 0; c < 10; ++c) {
+            put_float(c >= 3 && c < 7 ? -1.f : 0.f);
+        }
+        for (auto c = 0; c < 10; ++c) {
+            put_float(c >= 3 && c < 7 ? 2.f / 65535.f : 1.f / 65535.f);
+        }
+    }
+
+    const auto ofs_anims = here();
+    put_u32(21);
+    put_u32(0);
+    put_u32(nf);
+    put_float(30);
+    put_u32(1);
+
+    const auto ofs_frames = here();
+    for (auto f = 0u; f < nf; ++f) {
+        for (auto c = 0u; c < num_framechannels; ++c) {
+            put_u16(static_cast<std::uint16_t>((f * 131 + c * 17) & 0xFFFF));
+        }
+    }
+
+    const auto ofs_bounds = here();
+    for (auto f = 0u; f < nf; ++f) {
+        for (auto c = 0; c < 3; ++c) {
+            put_float(-1);
+        }
+        for (auto c = 0; c < 3; ++c) {
+            put_float(1);
+        }
+        put_float(1.5f);
+        put_float(1.8f);
+    }
+
+    const auto filesize = here();
+
+    const char magic[16] = "INTERQUAKEMODEL";
+    std::memcpy(bytes.data(), magic, sizeof(magic));
+    const std::uint32_t header[] = {
+        2, filesize, 0,
+        num_text, ofs_text,
+        1, ofs_meshes,
+        std::uint32_t(std::size(arrays)), nv, ofs_vertexarrays,
+        params.num_triangles, ofs_triangles, 0,
+        nj, ofs_joints,
+        nj, ofs_poses,
+        1, ofs_anims,
+        nf, num_framechannels, ofs_frames, ofs_bounds,
+        0, 0,
+        0, 0,
+    };
+    for (auto i = std::size_t{0}; i < std::size(header); ++i) {
+        set_u32(16 + i * 4, header[i]);
+    }
+
+    auto file = std::fopen(fname.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    auto written = std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+    return written == bytes.size();
+}
+
+/// Writes a synthetic OBJ file: a grid of `n` by `n` quads, each split into two triangles.
+/// Every corner has a texture coordinate and the same normal, so corners are shared between neighbouring triangles.
+/// \param fname File name.
+/// \param n Number of quads along each side.
+/// \return True if the file was written.
+inline auto write_obj_file(const std::string& fname, int n) -> bool {
+    auto file = std::fopen(fname.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    std::fprintf(file, "# Synthetic grid\no grid\n");
+
+    for (auto y = 0; y <= n; ++y) {
+        for (auto x = 0; x <= n; ++x) {
+            std::fprintf(file, "v %f %f %f\n", x * 0.01f, ((x * 7 + y * 13) % 100) * 0.001f, y * 0.01f);
+            std::fprintf(file, "vt %f %f\n", float(x) / n, float(y) / n);
+        }
+    }
+
+    std::fprintf(file, "vn 0.000000 1.000000 0.000000\n");
+
+    for (auto y = 0; y < n; ++y) {
+        for (auto x = 0; x < n; ++x) {
+            auto a = y * (n + 1) + x + 1;
+            auto b = a + 1;
+            auto c = a + n + 1;
+            auto d = c + 1;
+            std::fprintf(file, "f %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, c, c, b, b);
+            std::fprintf(file, "f %d/%d/1 %d/%d/1 %d/%d/1\n", b, b, c, c, d, d);
+        }
+    }
+
+    return std::fclose(file) == 0;
+}
+
+} // namespace sushi_bench
+
+#endif // SUSHI_BENCH_UTILS_HPP
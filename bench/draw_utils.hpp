@@ -0,0 +1,124 @@
+#ifndef SUSHI_BENCH_DRAW_UTILS_HPP
+#define SUSHI_BENCH_DRAW_UTILS_HPP
+
+#include "bench_utils.hpp"
+
+#include <glad/glad.h>
+
+#include <sushi/mesh_group.hpp>
+#include <sushi/shader.hpp>
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+/// Helpers shared by the benchmarks which draw meshes.
+namespace sushi_bench {
+
+/// A hidden window, whose GL context is current for as long as it's open.
+/// The window is tiny, so that draws are limited by vertex processing rather than by filling pixels.
+class gl_window {
+public:
+    gl_window() {
+        if (!glfwInit()) {
+            std::cerr << "Failed to init GLFW\n";
+            return;
+        }
+
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        window = glfwCreateWindow(64, 64, "Sushi Benchmark", nullptr, nullptr);
+        if (!window) {
+            std::cerr << "Failed to open window\n";
+            return;
+        }
+        glfwMakeContextCurrent(window);
+
+        if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress))) {
+            std::cerr << "Failed to load OpenGL extensions.\n";
+            window = nullptr;
+        }
+    }
+
+    gl_window(const gl_window&) = delete;
+    gl_window& operator=(const gl_window&) = delete;
+
+    ~gl_window() { glfwTerminate(); }
+
+    explicit operator bool() const { return window != nullptr; }
+
+private:
+    GLFWwindow* window = nullptr;
+};
+
+/// Links a program which reads positions, texture coordinates and normals, so that every vertex fetches all three.
+/// Positions are transformed by the `MVP` uniform.
+/// \return The program.
+inline auto make_draw_program() -> sushi::unique_program {
+    const char* vertex_source = R"(#version 330
+in vec3 VertexPosition;
+in vec2 VertexTexCoord;
+in vec3 VertexNormal;
+uniform mat4 MVP;
+out vec3 Color;
+void main() {
+    Color = abs(VertexNormal) + vec3(VertexTexCoord, 0.0);
+    gl_Position = MVP * vec4(VertexPosition, 1.0);
+}
+)";
+
+    const char* fragment_source = R"(#version 330
+in vec3 Color;
+out vec4 FragColor;
+void main() {
+    FragColor = vec4(Color, 1.0);
+}
+)";
+
+    auto shaders = std::vector<sushi::unique_shader>();
+    shaders.push_back(sushi::compile_shader(sushi::shader_type::VERTEX, {vertex_source}));
+    shaders.push_back(sushi::compile_shader(sushi::shader_type::FRAGMENT, {fragment_source}));
+
+    return sushi::link_program(shaders);
+}
+
+/// Gets a transform which fits a group's bounding sphere into clip space, so that every triangle is rasterized.
+inline auto get_fit_transform(const sushi::mesh_bounds& bounds) -> glm::mat4 {
+    auto scale = bounds.radius > 0 ? 1 / bounds.radius : 1.f;
+    auto mvp = glm::mat4(scale);
+    mvp[3] = glm::vec4(-bounds.center * scale, 1);
+    return mvp;
+}
+
+/// Draws a group repeatedly with `make_draw_program`'s program, fitted to the window.
+/// \param runs Number of runs, of which the fastest is kept.
+/// \param draws Number of draws in each run.
+/// \param group The meshes to draw.
+/// \return Average duration of a draw in the fastest run, in milliseconds, including the time to finish rendering.
+inline auto time_draws(int runs, int draws, const sushi::mesh_group& group) -> double {
+    auto program = make_draw_program();
+    sushi::set_program(program);
+    sushi::set_current_program_uniform(glGetUniformLocation(program.get(), "MVP"), get_fit_transform(group.bounds));
+
+    // The first draw pays for driver-side setup, which isn't part of the comparison.
+    sushi::draw_mesh(group);
+    glFinish();
+
+    auto ms = time_best_of(runs, [&] {
+        for (auto i = 0; i < draws; ++i) {
+            sushi::draw_mesh(group);
+        }
+        glFinish();
+    });
+
+    return ms / draws;
+}
+
+} // namespace sushi_bench
+
+#endif // SUSHI_BENCH_DRAW_UTILS_HPP
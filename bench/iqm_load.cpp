@@ -0,0 +1,383 @@
+// Compares the original byte-at-a-time IQM loader with the memory-mapped `load_iqm`.
+// Usage: sushi_bench_iqm_load [file.iqm...]
+// Without arguments, a large synthetic file is generated and loaded.
+
+#include "bench_utils.hpp"
+
+#include <sushi/iqm.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+namespace legacy {
+
+using namespace sushi::iqm;
+
+// The loader as it was before `load_iqm` moved to a memory map, kept as a baseline.
+std::optional<iqm_data> load_iqm(const std::string& fname) try {
+    constexpr bool orient90X = true;
+    const auto rotfixer90X = glm::angleAxis(glm::radians(-90.f), glm::vec3{1, 0, 0});
+
+    std::unique_ptr<std::FILE,int(*)(std::FILE*)> file (std::fopen(fname.c_str(), "rb"), &std::fclose);
+
+    if (!file) {
+        std::cerr << "legacy::load_iqm: Could not open file \"" << fname << "\".\n";
+        return std::nullopt;
+    }
+
+    auto next_u8 = [&]{
+        std::uint8_t rv = 0;
+        int c = std::fgetc(file.get());
+        if (c == EOF) {
+            throw std::runtime_error("ERROR: " + fname + ": Unexpected EOF!");
+        }
+        rv |= std::uint8_t(c);
+        return rv;
+    };
+
+    auto next_u32 = [&]{
+        std::uint32_t rv = 0;
+        for (int i=0; i<4; ++i) {
+            auto c = next_u8();
+            rv |= std::uint32_t(c) << (8 * i);
+        }
+        return rv;
+    };
+
+    auto next_u16 = [&]{
+        std::uint16_t rv = 0;
+        for (int i=0; i<2; ++i) {
+            auto c = next_u8();
+            rv |= std::uint16_t(c) << (8 * i);
+        }
+        return rv;
+    };
+
+    auto next_int = [&]{
+        static_assert(sizeof(int)==sizeof(std::uint32_t), "Oh no.");
+        auto i = next_u32();
+        int rv;
+        std::copy(reinterpret_cast<char*>(&i), reinterpret_cast<char*>(&i + 1), reinterpret_cast<char*>(&rv));
+        return rv;
+    };
+
+    auto next_float = [&]{
+        static_assert(sizeof(float)==sizeof(std::uint32_t), "NOOO!!!");
+        auto i = next_u32();
+        float rv;
+        std::copy(reinterpret_cast<char*>(&i), reinterpret_cast<char*>(&i + 1), reinterpret_cast<char*>(&rv));
+        return rv;
+    };
+
+    auto next_string = [&]{
+        std::string rv;
+        while (true) {
+            int c = std::fgetc(file.get());
+            if (c == EOF) {
+                throw std::runtime_error("ERROR: " + fname + ": Unexpected EOF!");
+            }
+            if (char(c) == '\0') {
+                return rv;
+            }
+            rv.push_back(char(c));
+        }
+    };
+
+    auto magic = next_string();
+    if (magic != "INTERQUAKEMODEL") {
+        throw std::runtime_error("ERROR: " + fname + ": Bad magic string!");
+    }
+
+    auto version = next_u32();
+    if (version != 2) {
+        throw std::runtime_error("ERROR: " + fname + ": Wrong version!");
+    }
+
+    next_u32(); // filesize
+    next_u32(); // flags
+    next_u32(); // num_text
+    auto ofs_text = next_u32();
+    auto num_meshes = next_u32();
+    auto ofs_meshes = next_u32();
+    auto num_vertexarrays = next_u32();
+    auto num_vertexes = next_u32();
+    auto ofs_vertexarrays = next_u32();
+    auto num_triangles = next_u32();
+    auto ofs_triangles = next_u32();
+    next_u32(); // ofs_adjacency
+    auto num_joints = next_u32();
+    auto ofs_joints = next_u32();
+    auto num_poses = next_u32();
+    auto ofs_poses = next_u32();
+    auto num_anims = next_u32();
+    auto ofs_anims = next_u32();
+    auto num_frames = next_u32();
+    auto num_framechannels = next_u32();
+    auto ofs_frames = next_u32();
+    auto ofs_bounds = next_u32();
+    next_u32(); // num_comment
+    next_u32(); // ofs_comment
+    next_u32(); // num_extensions
+    next_u32(); // ofs_extensions
+
+    iqm_data rv;
+
+    auto get_name = [&](long pos){
+        auto cur = std::ftell(file.get());
+        std::fseek(file.get(), ofs_text + pos, SEEK_SET);
+        SUSHI_DEFER { std::fseek(file.get(), cur, SEEK_SET); };
+        auto rv = next_string();
+        return rv;
+    };
+
+    // meshes
+
+    std::fseek(file.get(), ofs_meshes, SEEK_SET);
+    for (auto i = 0u; i < num_meshes; ++i) {
+        mesh m;
+        m.name = get_name(next_u32());
+        m.material = get_name(next_u32());
+        m.first_vertex = next_u32();
+        m.num_vertexes = next_u32();
+        m.first_triangle = next_u32();
+        m.num_triangles = next_u32();
+        rv.meshes.push_back(std::move(m));
+    }
+
+    // vertexarrays
+
+    std::fseek(file.get(), ofs_vertexarrays, SEEK_SET);
+    for (auto i = 0u; i < num_vertexarrays; ++i) {
+        auto type = next_u32();
+        next_u32(); // flags
+        next_u32(); // format
+        auto size = next_u32();
+        auto offset = next_u32();
+
+        auto cur = std::ftell(file.get());
+        std::fseek(file.get(), offset, SEEK_SET);
+        SUSHI_DEFER { std::fseek(file.get(), cur, SEEK_SET); };
+
+        switch (type) {
+            case 0: // position
+                if (orient90X) {
+                    for (auto i = std::size_t{0}; i < num_vertexes; ++i) {
+                        auto x = next_float();
+                        auto y = -next_float();
+                        auto z = next_float();
+                        rv.vertexarrays.position.push_back(x);
+                        rv.vertexarrays.position.push_back(z);
+                        rv.vertexarrays.position.push_back(y);
+                    }
+                } else {
+                    std::generate_n(std::back_inserter(rv.vertexarrays.position), num_vertexes * size, next_float);
+                }
+                break;
+            case 1: // texcoord
+                std::generate_n(std::back_inserter(rv.vertexarrays.texcoord), num_vertexes * size, next_float);
+                break;
+            case 2: // normal
+                if (orient90X) {
+                    for (auto i = std::size_t{0}; i < num_vertexes; ++i) {
+                        auto x = next_float();
+                        auto y = -next_float();
+                        auto z = next_float();
+                        rv.vertexarrays.normal.push_back(x);
+                        rv.vertexarrays.normal.push_back(z);
+                        rv.vertexarrays.normal.push_back(y);
+                    }
+                } else {
+                    std::generate_n(std::back_inserter(rv.vertexarrays.normal), num_vertexes * size, next_float);
+                }
+                break;
+            case 3: // tangent
+                if (orient90X) {
+                    for (auto i = std::size_t{0}; i < num_vertexes; ++i) {
+                        auto x = next_float();
+                        auto y = -next_float();
+                        auto z = next_float();
+                        rv.vertexarrays.tangent.push_back(x);
+                        rv.vertexarrays.tangent.push_back(z);
+                        rv.vertexarrays.tangent.push_back(y);
+                    }
+                } else {
+                    std::generate_n(std::back_inserter(rv.vertexarrays.tangent), num_vertexes * size, next_float);
+                }
+                break;
+            case 4: // blendindexes
+                std::generate_n(std::back_inserter(rv.vertexarrays.blendindexes), num_vertexes * size, next_u8);
+                break;
+            case 5: // blendweights
+                std::generate_n(std::back_inserter(rv.vertexarrays.blendweights), num_vertexes * size, next_u8);
+                break;
+            case 6: // color
+                std::generate_n(std::back_inserter(rv.vertexarrays.color), num_vertexes * size, next_u8);
+                break;
+        }
+    }
+
+    // triangles
+
+    std::fseek(file.get(), ofs_triangles, SEEK_SET);
+    for (auto i = 0u; i < num_triangles; ++i) {
+        triangle t;
+        std::generate(std::begin(t.verts), std::end(t.verts), next_u32);
+        rv.triangles.push_back(std::move(t));
+    }
+
+    // joints
+
+    std::fseek(file.get(), ofs_joints, SEEK_SET);
+    for (auto i = 0u; i < num_joints; ++i) {
+        joint j;
+        j.name = get_name(next_u32());
+        j.parent = next_int();
+        if (orient90X && j.parent == -1) {
+            j.pos.x = next_float(); j.pos.x = next_float(); j.pos.z = next_float();
+            j.rot.x = next_float(); j.rot.y = next_float(); j.rot.z = next_float(); j.rot.w = next_float();
+            j.rot = rotfixer90X * j.rot;
+            j.scl.x = next_float(); j.scl.y = next_float(); j.scl.z = next_float();
+        } else {
+            j.pos.x = next_float(); j.pos.y = next_float(); j.pos.z = next_float();
+            j.rot.x = next_float(); j.rot.y = next_float(); j.rot.z = next_float(); j.rot.w = next_float();
+            j.scl.x = next_float(); j.scl.y = next_float(); j.scl.z = next_float();
+        }
+        rv.joints.push_back(std::move(j));
+    }
+
+    // poses
+
+    std::fseek(file.get(), ofs_poses, SEEK_SET);
+    for (auto i = 0u; i < num_poses; ++i) {
+        pose p;
+        p.parent = next_int();
+        p.channels = next_u32();
+        std::generate(std::begin(p.offsets), std::end(p.offsets), next_float);
+        std::generate(std::begin(p.scales), std::end(p.scales), next_float);
+        rv.poses.push_back(std::move(p));
+    }
+
+    // anims
+
+    std::fseek(file.get(), ofs_anims, SEEK_SET);
+    for (auto i = 0u; i < num_anims; ++i) {
+        anim a;
+        a.name = get_name(next_u32());
+        a.first_frame = next_u32();
+        a.num_frames = next_u32();
+        a.framerate = next_float();
+        auto flags = next_u32();
+        a.loop = bool(flags & 1);
+        rv.anims.push_back(std::move(a));
+    }
+
+    // frames
+
+    std::fseek(file.get(), ofs_frames, SEEK_SET);
+    std::generate_n(std::back_inserter(rv.frames), num_frames * num_framechannels, next_u16);
+    rv.num_framechannels = num_framechannels;
+
+    // bounds
+
+    std::fseek(file.get(), ofs_bounds, SEEK_SET);
+    for (auto i = 0u; i < num_frames; ++i) {
+        bound b;
+        if (orient90X) {
+            b.min.x = next_float();
+            b.min.z = next_float();
+            b.min.y = next_float();
+            b.max.x = next_float();
+            b.max.z = next_float();
+            b.max.y = next_float();
+        } else {
+            b.min.x = next_float();
+            b.min.y = next_float();
+            b.min.z = next_float();
+            b.max.x = next_float();
+            b.max.y = next_float();
+            b.max.z = next_float();
+        }
+        b.xyradius = next_float();
+        b.radius = next_float();
+        rv.bounds.push_back(std::move(b));
+    }
+
+    // ignore extensions
+
+    return rv;
+} catch (const std::exception& e) {
+    std::cerr << "ERROR: legacy::load_iqm: " << e.what() << "\n";
+    return std::nullopt;
+}
+
+} // namespace legacy
+
+namespace {
+
+auto same_data(const sushi::iqm::iqm_data& a, const sushi::iqm::iqm_data& b) -> bool {
+    auto same_triangles = std::equal(
+        a.triangles.begin(), a.triangles.end(), b.triangles.begin(), b.triangles.end(), [](const auto& x, const auto& y) {
+            return std::equal(std::begin(x.verts), std::end(x.verts), std::begin(y.verts));
+        });
+    auto same_names = std::equal(
+        a.joints.begin(), a.joints.end(), b.joints.begin(), b.joints.end(), [](const auto& x, const auto& y) {
+            return x.name == y.name && x.parent == y.parent;
+        });
+    return a.vertexarrays.position == b.vertexarrays.position
+        && a.vertexarrays.texcoord == b.vertexarrays.texcoord
+        && a.vertexarrays.normal == b.vertexarrays.normal
+        && a.vertexarrays.blendindexes == b.vertexarrays.blendindexes
+        && a.vertexarrays.blendweights == b.vertexarrays.blendweights
+        && same_triangles
+        && same_names
+        && a.frames == b.frames
+        && a.meshes.size() == b.meshes.size()
+        && a.anims.size() == b.anims.size();
+}
+
+void run(const std::string& fname) {
+    constexpr auto runs = 5;
+
+    auto old_data = legacy::load_iqm(fname);
+    auto new_data = sushi::iqm::load_iqm(fname);
+
+    if (!old_data || !new_data) {
+        std::cerr << fname << ": failed to load\n";
+        return;
+    }
+
+    auto old_ms = sushi_bench::time_best_of(runs, [&] { old_data = legacy::load_iqm(fname); });
+    auto new_ms = sushi_bench::time_best_of(runs, [&] { new_data = sushi::iqm::load_iqm(fname); });
+
+    std::printf("%s: %zu vertices, %zu triangles, %zu frames\n",
+        fname.c_str(),
+        old_data->vertexarrays.position.size() / 3,
+        old_data->triangles.size(),
+        old_data->bounds.size());
+    std::printf("  fgetc loader:  %9.2f ms\n", old_ms);
+    std::printf("  load_iqm:      %9.2f ms (%.1fx)\n", new_ms, old_ms / new_ms);
+    std::printf("  output:        %s\n", same_data(*old_data, *new_data) ? "identical" : "MISMATCH");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        for (auto i = 1; i < argc; ++i) {
+            run(argv[i]);
+        }
+        return 0;
+    }
+
+    auto fname = std::string("sushi_bench_synthetic.iqm");
+    if (!sushi_bench::write_iqm_file(fname, {})) {
+        std::cerr << "Could not write " << fname << "\n";
+        return 1;
+    }
+    run(fname);
+    std::remove(fname.c_str());
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Compares peak resident memory when uploading IQM geometry through an `iqm_data` copy,
+// and when streaming it straight from the mapped file into GL buffers.
+// Usage: sushi_bench_iqm_upload [file.iqm...]
+// Without arguments, a large synthetic file is generated and uploaded.
+// Each path runs in its own process, since peak resident memory never goes back down.
+
+#include "bench_utils.hpp"
+
+#include <glad/glad.h>
+
+#include <sushi/iqm.hpp>
+#include <sushi/mapped_file.hpp>
+#include <sushi/mesh_group.hpp>
+
+#include <GLFW/glfw3.h>
+
+#include <cstdio>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+enum class upload_path {
+    COPY,
+    STREAM,
+};
+
+/// Uploads the file's meshes in a hidden window's context.
+/// \return Peak resident memory growth during the upload, in bytes, or 0 on failure.
+auto measure(const std::string& fname, upload_path path) -> std::size_t {
+    if (!glfwInit()) {
+        std::cerr << "Failed to init GLFW\n";
+        return 0;
+    }
+    SUSHI_DEFER { glfwTerminate(); };
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    auto window = glfwCreateWindow(64, 64, "Sushi Benchmark", nullptr, nullptr);
+    if (!window) {
+        std::cerr << "Failed to open window\n";
+        return 0;
+    }
+    glfwMakeContextCurrent(window);
+
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress))) {
+        std::cerr << "Failed to load OpenGL extensions.\n";
+        return 0;
+    }
+
+    // Driver and context memory is already counted here, so it does not show up as a difference between the paths.
+    auto baseline = sushi_bench::get_peak_rss();
+
+    auto loaded = false;
+    switch (path) {
+        case upload_path::COPY:
+            if (auto data = sushi::iqm::load_iqm(fname)) {
+                auto group = sushi::load_meshes(*data);
+                loaded = true;
+            }
+            break;
+        case upload_path::STREAM:
+            if (auto file = sushi::iqm::open_iqm(fname)) {
+                loaded = sushi::load_meshes(*file).has_value();
+            }
+            break;
+    }
+
+    glFinish();
+
+    return loaded ? sushi_bench::get_peak_rss() - baseline : 0;
+}
+
+/// Runs a function in a child process, so that its memory use does not affect the caller's.
+/// \return The function's result, or 0 if the child failed.
+template <typename F>
+auto run_in_child(F&& f) -> std::size_t {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return 0;
+    }
+
+    auto pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        std::size_t result = f();
+        auto written = write(fds[1], &result, sizeof(result));
+        _exit(written == sizeof(result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    auto result = std::size_t{0};
+    if (pid < 0 || read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+        result = 0;
+    }
+    close(fds[0]);
+    if (pid > 0) {
+        waitpid(pid, nullptr, 0);
+    }
+    return result;
+}
+
+void run(const std::string& fname) {
+    auto file_size = std::size_t{0};
+    if (auto file = sushi::map_file(fname)) {
+        file_size = file->size();
+    }
+
+    auto copy = run_in_child([&] { return measure(fname, upload_path::COPY); });
+    auto stream = run_in_child([&] { return measure(fname, upload_path::STREAM); });
+
+    if (copy == 0 || stream == 0) {
+        std::cerr << fname << ": failed to upload\n";
+        return;
+    }
+
+    auto mib = [](std::size_t bytes) { return double(bytes) / (1024 * 1024); };
+
+    std::printf("%s: %.1f MiB\n", fname.c_str(), mib(file_size));
+    std::printf("  load_iqm + load_meshes(iqm_data):  %8.1f MiB peak growth\n", mib(copy));
+    std::printf("  open_iqm + load_meshes(iqm_file):  %8.1f MiB peak growth (%.1f MiB saved)\n",
+        mib(stream),
+        mib(copy) - mib(stream));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        for (auto i = 1; i < argc; ++i) {
+            run(argv[i]);
+        }
+        return 0;
+    }
+
+    auto fname = std::string("sushi_bench_synthetic.iqm");
+
+    // Generating the file takes as much memory as the file itself, which must not count towards the measurements.
+    auto written = run_in_child([&] {
+        auto params = sushi_bench::iqm_params{};
+        params.num_frames = 0;
+        return std::size_t(sushi_bench::write_iqm_file(fname, params));
+    });
+
+    if (!written) {
+        std::cerr << "Could not write " << fname << "\n";
+        return 1;
+    }
+    run(fname);
+    std::remove(fname.c_str());
+    return 0;
+}
+
+#else
+
+int main() {
+    std::cerr << "Peak resident memory is only measured on POSIX platforms.\n";
+    return 1;
+}
+
+#endif
@@ -0,0 +1,135 @@
+// Compares the vertex count and draw time of OBJ meshes as loaded, with identical face corners welded into shared
+// vertices, and with every corner given its own vertex, as the loader did before welding.
+// Usage: sushi_bench_obj_draw [file.obj...]
+// Without arguments, a synthetic grid of half a million triangles is generated and drawn.
+
+#include "draw_utils.hpp"
+
+#include <sushi/mesh_group.hpp>
+#include <sushi/mesh_utils.hpp>
+#include <sushi/obj_loader.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+auto get_index(const sushi::mesh_blob& blob, std::size_t i) -> std::size_t {
+    if (blob.index_type == GL_UNSIGNED_SHORT) {
+        std::uint16_t index;
+        std::memcpy(&index, blob.index_data.data() + i * sizeof(index), sizeof(index));
+        return index;
+    }
+    std::uint32_t index;
+    std::memcpy(&index, blob.index_data.data() + i * sizeof(index), sizeof(index));
+    return index;
+}
+
+auto get_num_vertices(const sushi::mesh_blob& blob) -> std::size_t {
+    if (blob.options.layout == sushi::vertex_layout::INTERLEAVED) {
+        return blob.vertex_data.size() / std::size_t(blob.format.interleaved.stride);
+    }
+    return blob.attrib_data[0].size() / sushi::_detail::get_attrib_size(blob.format.attribs[0]);
+}
+
+/// Gives every triangle corner its own copy of its vertex, in triangle order.
+auto unweld(const sushi::mesh_blob& blob) -> sushi::mesh_blob {
+    auto result = sushi::mesh_blob{};
+    result.options = blob.options;
+    result.format = blob.format;
+    result.bounds = blob.bounds;
+    result.index_type = GL_UNSIGNED_INT;
+
+    const auto interleaved = blob.options.layout == sushi::vertex_layout::INTERLEAVED;
+    const auto stride = std::size_t(blob.format.interleaved.stride);
+
+    auto next_index = std::uint32_t{0};
+
+    for (const auto& mesh : blob.meshes) {
+        auto& result_mesh = result.meshes.emplace_back(mesh);
+        result_mesh.first_index = GLsizei(next_index);
+        result_mesh.base_vertex = 0;
+        result_mesh.lods.clear();
+
+        for (auto k = std::size_t{0}; k < std::size_t(mesh.num_tris) * 3; ++k) {
+            auto vertex = get_index(blob, mesh.first_index + k) + mesh.base_vertex;
+
+            if (interleaved) {
+                auto data = blob.vertex_data.data() + vertex * stride;
+                result.vertex_data.insert(result.vertex_data.end(), data, data + stride);
+            } else {
+                for (auto i = std::size_t{0}; i < blob.format.num_attribs; ++i) {
+                    if (blob.format.attribs[i].data) {
+                        auto size = sushi::_detail::get_attrib_size(blob.format.attribs[i]);
+                        auto data = blob.attrib_data[i].data() + vertex * size;
+                        result.attrib_data[i].insert(result.attrib_data[i].end(), data, data + size);
+                    }
+                }
+            }
+
+            auto bytes = reinterpret_cast<const unsigned char*>(&next_index);
+            result.index_data.insert(result.index_data.end(), bytes, bytes + sizeof(next_index));
+            ++next_index;
+        }
+    }
+
+    return result;
+}
+
+void run(const std::string& fname) {
+    constexpr auto runs = 5;
+    constexpr auto draws = 20;
+
+    auto welded_blob = sushi::bake_obj_file(fname);
+
+    if (!welded_blob) {
+        std::cerr << fname << ": failed to load\n";
+        return;
+    }
+
+    auto unwelded_blob = unweld(*welded_blob);
+
+    auto welded_vertices = get_num_vertices(*welded_blob);
+    auto unwelded_vertices = get_num_vertices(unwelded_blob);
+
+    auto welded = sushi::upload(*welded_blob);
+    auto unwelded = sushi::upload(unwelded_blob);
+
+    auto unwelded_ms = sushi_bench::time_draws(runs, draws, unwelded);
+    auto welded_ms = sushi_bench::time_draws(runs, draws, welded);
+
+    std::printf("%s:\n", fname.c_str());
+    std::printf("  one vertex per corner:  %9zu vertices, %8.3f ms per draw\n", unwelded_vertices, unwelded_ms);
+    std::printf("  welded corners:         %9zu vertices, %8.3f ms per draw (%.1fx fewer vertices, %.1fx faster)\n",
+        welded_vertices,
+        welded_ms,
+        double(unwelded_vertices) / double(welded_vertices),
+        unwelded_ms / welded_ms);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    auto window = sushi_bench::gl_window();
+    if (!window) {
+        return 1;
+    }
+
+    if (argc > 1) {
+        for (auto i = 1; i < argc; ++i) {
+            run(argv[i]);
+        }
+        return 0;
+    }
+
+    auto fname = std::string("sushi_bench_synthetic.obj");
+    if (!sushi_bench::write_obj_file(fname, 500)) {
+        std::cerr << "Could not write " << fname << "\n";
+        return 1;
+    }
+    run(fname);
+    std::remove(fname.c_str());
+    return 0;
+}
@@ -0,0 +1,262 @@
+// Compares the original istringstream OBJ parser with `bake_obj_file`, both serial and on the default thread pool.
+// Usage: sushi_bench_obj_load [file.obj...]
+// Without arguments, a synthetic grid of two million triangles is generated and loaded.
+// Only baking is timed, since uploading is the same for every parser.
+
+#include "bench_utils.hpp"
+
+#include <sushi/mesh_builder.hpp>
+#include <sushi/obj_loader.hpp>
+#include <sushi/thread_pool.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace legacy {
+
+using namespace sushi;
+
+// The parser as it was before `load_obj_file` moved to a hand-written tokenizer, kept as a baseline.
+// It bakes instead of uploading, so that it can be compared with `bake_obj_file`.
+auto bake_obj_file(const std::string &fname) -> std::optional<mesh_blob> {
+    std::ifstream file(fname);
+
+    if (!file) {
+        return std::nullopt;
+    }
+
+    std::string line;
+    std::string word;
+    int line_number = 0;
+
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+
+    mesh_group_builder mb;
+    mb.enable(attrib_location::POSITION);
+    mb.enable(attrib_location::TEXCOORD);
+    mb.enable(attrib_location::NORMAL);
+
+    while (getline(file, line)) {
+        ++line_number;
+        std::istringstream iss(line);
+        iss >> word;
+
+        if (word == "o") {
+            std::string s;
+            std::getline(iss, s);
+            mb.mesh(s);
+        } else if (word == "v") {
+            glm::vec3 v;
+            iss >> v.x >> v.y >> v.z;
+            vertices.push_back(v);
+        } else if (word == "vt") {
+            glm::vec2 v;
+            iss >> v.x >> v.y;
+            v.y = 1.0 - v.y;
+            texcoords.push_back(v);
+        } else if (word == "vn") {
+            glm::vec3 v;
+            iss >> v.x >> v.y >> v.z;
+            normals.push_back(v);
+        } else if (word == "f") {
+            GLuint verts[3];
+
+            for (auto& vert : verts) {
+                int pos_idx = 1;
+                int texcoord_idx = 1;
+                int normal_idx = 1;
+
+                iss >> word;
+                std::replace(begin(word), end(word), '/', ' ');
+                std::istringstream iss2(word);
+                iss2 >> pos_idx >> texcoord_idx >> normal_idx;
+
+                vert = mb.vertex()
+                    .position(vertices[pos_idx - 1])
+                    .texcoord(texcoords[texcoord_idx - 1])
+                    .normal(normals[normal_idx - 1])
+                    .get();
+            }
+
+            mb.tri(verts[0], verts[2], verts[1]);
+        } else if (word[0] == '#') {
+            // pass
+        } else {
+            std::clog << "sushi::load_obj_file(): Warning: Unknown OBJ directive at " << fname << "[" <<
+            line_number
+            << "]: \"" << word << "\"." << std::endl;
+        }
+    }
+
+    return mb.bake();
+}
+
+} // namespace legacy
+
+namespace {
+
+/// Writes a single triangle with positions only, which the istringstream parser cannot load.
+auto write_minimal_obj_file(const std::string& fname) -> bool {
+    auto file = std::fopen(fname.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    std::fprintf(file, "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n");
+
+    return std::fclose(file) == 0;
+}
+
+auto get_index(const sushi::mesh_blob& blob, std::size_t i) -> std::size_t {
+    if (blob.index_type == GL_UNSIGNED_SHORT) {
+        std::uint16_t index;
+        std::memcpy(&index, blob.index_data.data() + i * sizeof(index), sizeof(index));
+        return index;
+    }
+    std::uint32_t index;
+    std::memcpy(&index, blob.index_data.data() + i * sizeof(index), sizeof(index));
+    return index;
+}
+
+auto get_attrib_data(const sushi::mesh_blob& blob, std::size_t i, std::size_t vertex) -> const unsigned char* {
+    const auto& attr = blob.format.attribs[i];
+    if (blob.options.layout == sushi::vertex_layout::INTERLEAVED) {
+        const auto& interleaved = blob.format.interleaved;
+        return blob.vertex_data.data() + vertex * interleaved.stride + interleaved.offsets[static_cast<GLuint>(attr.loc)];
+    }
+    return blob.attrib_data[i].data() + vertex * sushi::_detail::get_attrib_size(attr);
+}
+
+/// Compares the encoded attributes of every triangle corner.
+/// Buffers themselves may differ, since `bake_obj_file` welds identical corners into shared vertices.
+auto same_geometry(const sushi::mesh_blob& a, const sushi::mesh_blob& b) -> bool {
+    if (a.meshes.size() != b.meshes.size() || a.format.num_attribs != b.format.num_attribs) {
+        return false;
+    }
+
+    for (auto m = std::size_t{0}; m < a.meshes.size(); ++m) {
+        const auto& mesh_a = a.meshes[m];
+        const auto& mesh_b = b.meshes[m];
+
+        if (mesh_a.num_tris != mesh_b.num_tris) {
+            return false;
+        }
+
+        for (auto k = std::size_t{0}; k < std::size_t(mesh_a.num_tris) * 3; ++k) {
+            auto vertex_a = get_index(a, mesh_a.first_index + k) + mesh_a.base_vertex;
+            auto vertex_b = get_index(b, mesh_b.first_index + k) + mesh_b.base_vertex;
+
+            for (auto i = std::size_t{0}; i < a.format.num_attribs; ++i) {
+                const auto& attr_a = a.format.attribs[i];
+                const auto& attr_b = b.format.attribs[i];
+
+                if (!attr_a.data != !attr_b.data || attr_a.type != attr_b.type || attr_a.size != attr_b.size) {
+                    return false;
+                }
+
+                if (attr_a.data
+                    && std::memcmp(
+                        get_attrib_data(a, i, vertex_a),
+                        get_attrib_data(b, i, vertex_b),
+                        sushi::_detail::get_attrib_size(attr_a)) != 0) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+/// Compares the baked buffers byte for byte, which the serial and pooled loaders must produce identically.
+auto same_buffers(const sushi::mesh_blob& a, const sushi::mesh_blob& b) -> bool {
+    return a.attrib_data == b.attrib_data && a.vertex_data == b.vertex_data && a.index_data == b.index_data
+        && a.index_type == b.index_type && a.meshes.size() == b.meshes.size();
+}
+
+void run(const std::string& fname) {
+    constexpr auto runs = 3;
+
+    auto old_blob = legacy::bake_obj_file(fname);
+    auto new_blob = sushi::bake_obj_file(fname);
+
+    if (!old_blob || !new_blob) {
+        std::cerr << fname << ": failed to load\n";
+        return;
+    }
+
+    auto old_ms = sushi_bench::time_best_of(runs, [&] { old_blob = legacy::bake_obj_file(fname); });
+    auto new_ms = sushi_bench::time_best_of(runs, [&] { new_blob = sushi::bake_obj_file(fname); });
+
+    auto num_tris = std::size_t{0};
+    for (const auto& mesh : new_blob->meshes) {
+        num_tris += mesh.num_tris;
+    }
+
+    std::printf("%s: %zu triangles, %u hardware threads\n", fname.c_str(), num_tris, std::thread::hardware_concurrency());
+    std::printf("  istringstream parser:          %9.2f ms\n", old_ms);
+    std::printf("  bake_obj_file:                 %9.2f ms (%.1fx)\n", new_ms, old_ms / new_ms);
+
+    auto identical = same_geometry(*old_blob, *new_blob);
+
+    for (auto num_threads : sushi_bench::get_thread_counts()) {
+        auto pool = sushi::thread_pool(num_threads);
+        auto pool_blob = sushi::bake_obj_file(fname, pool);
+
+        if (!pool_blob) {
+            std::cerr << fname << ": failed to load with " << num_threads << " threads\n";
+            return;
+        }
+
+        auto pool_ms = sushi_bench::time_best_of(runs, [&] { pool_blob = sushi::bake_obj_file(fname, pool); });
+
+        std::printf("  bake_obj_file, %2u threads:     %9.2f ms (%.1fx, %.2fx serial)\n",
+            num_threads,
+            pool_ms,
+            old_ms / pool_ms,
+            new_ms / pool_ms);
+
+        identical = identical && same_buffers(*new_blob, *pool_blob);
+    }
+
+    std::printf("  triangle corners:              %s\n", identical ? "identical" : "MISMATCH");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        for (auto i = 1; i < argc; ++i) {
+            run(argv[i]);
+        }
+        return 0;
+    }
+
+    // Files without texture coordinates or normals must still load, even though they are not timed.
+    auto minimal_fname = std::string("sushi_bench_minimal.obj");
+    if (!write_minimal_obj_file(minimal_fname)) {
+        std::cerr << "Could not write " << minimal_fname << "\n";
+        return 1;
+    }
+    auto minimal = sushi::bake_obj_file(minimal_fname);
+    std::remove(minimal_fname.c_str());
+    std::printf("%s: %s\n", minimal_fname.c_str(), minimal ? "loaded" : "FAILED");
+
+    auto fname = std::string("sushi_bench_synthetic.obj");
+    if (!sushi_bench::write_obj_file(fname, 1000)) {
+        std::cerr << "Could not write " << fname << "\n";
+        return 1;
+    }
+    run(fname);
+    std::remove(fname.c_str());
+    return 0;
+}
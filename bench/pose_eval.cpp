@@ -0,0 +1,226 @@
+// Compares `pose_evaluator` with the scalar per-bone evaluation it replaced, at typical character bone counts,
+// then times `animation_batch` on crowds of thousands of characters at several thread pool sizes.
+// Usage: sushi_bench_pose_eval
+// Skeletons are generated, with every bone's rotation blended between two random poses.
+
+#include "bench_utils.hpp"
+
+#include <sushi/animation_batch.hpp>
+#include <sushi/pose_evaluator.hpp>
+#include <sushi/skeleton.hpp>
+#include <sushi/transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+auto random_rotation(std::mt19937& rng, float spread) -> glm::quat {
+    auto dist = std::normal_distribution<float>(0, spread);
+    auto q = glm::quat(1 + dist(rng), dist(rng), dist(rng), dist(rng));
+    auto len = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    return glm::quat(q.w / len, q.x / len, q.y / len, q.z / len);
+}
+
+/// Builds a binary tree of bones, which is already sorted by depth.
+auto make_skeleton(int num_bones, std::mt19937& rng) -> sushi::skeleton {
+    auto skele = sushi::skeleton{};
+    auto depths = std::vector<int>();
+
+    for (auto i = 0; i < num_bones; ++i) {
+        auto parent = i == 0 ? -1 : (i - 1) / 2;
+        auto depth = parent == -1 ? 0 : depths[parent] + 1;
+
+        if (i == 0 || depth != depths.back()) {
+            skele.levels.push_back(std::size_t(i));
+        }
+
+        auto bind = sushi::transform{{0.f, 0.5f, 0.1f}, random_rotation(rng, 0.3f), {1, 1, 1}};
+        auto base_pose = sushi::to_mat4(bind);
+        if (parent != -1) {
+            base_pose = skele.base_poses[parent] * base_pose;
+        }
+
+        depths.push_back(depth);
+        skele.parents.push_back(parent);
+        skele.joint_indices.push_back(i);
+        skele.base_poses.push_back(base_pose);
+        skele.base_pose_inverses.push_back(glm::inverse(base_pose));
+        skele.bone_names.push_back("bone" + std::to_string(i));
+    }
+
+    skele.levels.push_back(std::size_t(num_bones));
+
+    return skele;
+}
+
+/// Adds a looping animation in which every bone's rotation changes a little each frame.
+void add_animation(sushi::skeleton& skele, int num_frames, std::mt19937& rng) {
+    const auto num_bones = skele.get_num_bones();
+
+    for (auto f = 0; f < num_frames; ++f) {
+        for (auto i = std::size_t{0}; i < num_bones; ++i) {
+            skele.frame_transforms.push_back({{0.f, 0.5f, 0.1f}, random_rotation(rng, 0.2f), {1, 1, 1}});
+        }
+    }
+
+    skele.animations.push_back({"loop", 0, num_frames, 30.f, true});
+}
+
+/// The evaluation `pose` did before `pose_evaluator`: slerp, full mat4 composition, and two multiplies per bone.
+void evaluate_scalar(
+    const sushi::skeleton& skele,
+    const std::vector<sushi::transform>& from,
+    const std::vector<sushi::transform>& to,
+    float alpha,
+    std::vector<glm::mat4>& model,
+    std::vector<glm::mat4>& out) {
+
+    for (auto i = std::size_t{0}; i < skele.get_num_bones(); ++i) {
+        auto local = sushi::to_mat4(sushi::mix(from[i], to[i], alpha));
+        auto parent = skele.parents[i];
+        model[i] = parent == -1 ? local : model[parent] * local;
+        out[i] = model[i] * skele.base_pose_inverses[i];
+    }
+}
+
+auto max_error(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b) -> float {
+    auto error = 0.f;
+    for (auto i = std::size_t{0}; i < a.size(); ++i) {
+        for (auto c = 0; c < 4; ++c) {
+            for (auto r = 0; r < 4; ++r) {
+                error = std::max(error, std::abs(a[i][c][r] - b[i][c][r]));
+            }
+        }
+    }
+    return error;
+}
+
+void run(int num_bones, std::mt19937& rng) {
+    constexpr auto runs = 5;
+    constexpr auto iterations = 2000;
+
+    auto skele = make_skeleton(num_bones, rng);
+
+    auto from = std::vector<sushi::transform>();
+    auto to = std::vector<sushi::transform>();
+
+    for (auto i = 0; i < num_bones; ++i) {
+        auto t = sushi::transform{{0.1f, 0.5f, 0.f}, random_rotation(rng, 0.5f), {1, 1, 1}};
+        from.push_back(t);
+        // Most bones move a little between poses, some move a lot and fall back to slerp.
+        t.pos.x += 0.01f;
+        t.rot = random_rotation(rng, i % 8 == 0 ? 0.8f : 0.05f);
+        to.push_back(t);
+    }
+
+    auto model = std::vector<glm::mat4>(num_bones);
+    auto reference = std::vector<glm::mat4>(num_bones);
+    auto fast_out = std::vector<glm::mat4>(num_bones);
+    auto exact_out = std::vector<glm::mat4>(num_bones);
+
+    auto fast = sushi::pose_evaluator();
+    auto exact = sushi::pose_evaluator(sushi::pose_blend_options{false});
+
+    auto from_span = sushi::span<const sushi::transform>(from.data(), from.size());
+    auto to_span = sushi::span<const sushi::transform>(to.data(), to.size());
+    auto alpha = 0.3f;
+
+    auto per_eval = [&](double ms) { return ms * 1000 / iterations; };
+
+    auto scalar_us = per_eval(sushi_bench::time_best_of(runs, [&] {
+        for (auto k = 0; k < iterations; ++k) {
+            evaluate_scalar(skele, from, to, alpha, model, reference);
+        }
+    }));
+
+    auto fast_us = per_eval(sushi_bench::time_best_of(runs, [&] {
+        for (auto k = 0; k < iterations; ++k) {
+            fast.evaluate(skele, from_span, to_span, alpha, fast_out);
+        }
+    }));
+
+    auto exact_us = per_eval(sushi_bench::time_best_of(runs, [&] {
+        for (auto k = 0; k < iterations; ++k) {
+            exact.evaluate(skele, from_span, to_span, alpha, exact_out);
+        }
+    }));
+
+    std::printf("%4d bones: scalar %7.2f us | evaluator nlerp %6.2f us (%4.1fx, err %.1e) | slerp %6.2f us (%4.1fx, err %.1e)\n",
+        num_bones,
+        scalar_us,
+        fast_us,
+        scalar_us / fast_us,
+        max_error(reference, fast_out),
+        exact_us,
+        scalar_us / exact_us,
+        max_error(reference, exact_out));
+}
+
+void run_batch(const std::vector<sushi::skeleton>& skeletons, int num_jobs) {
+    constexpr auto runs = 5;
+
+    // Characters share a few rigs, each at a different point in its animation, and every fourth one is smoothed.
+    auto jobs = std::vector<sushi::animation_job>();
+    for (auto i = 0; i < num_jobs; ++i) {
+        jobs.push_back({&skeletons[i % skeletons.size()], 0, i * 0.013f, i % 4 == 0});
+    }
+
+    auto jobs_span = sushi::span<const sushi::animation_job>(jobs.data(), jobs.size());
+
+    std::printf("animation_batch, %d jobs:\n", num_jobs);
+
+    auto single_ms = 0.0;
+
+    for (auto num_threads : sushi_bench::get_thread_counts()) {
+        auto pool = sushi::thread_pool(num_threads);
+        auto batch = sushi::animation_batch();
+
+        // The first call sizes the palettes and each thread's scratch memory.
+        batch.evaluate(jobs_span, pool);
+
+        auto ms = sushi_bench::time_best_of(runs, [&] { batch.evaluate(jobs_span, pool); });
+
+        if (num_threads == 1) {
+            single_ms = ms;
+        }
+
+        std::printf("  %3u threads: %8.2f ms (%5.2fx, %6.2f us per job)\n",
+            num_threads,
+            ms,
+            single_ms / ms,
+            ms * 1000 / num_jobs);
+    }
+}
+
+} // namespace
+
+int main() {
+    auto rng = std::mt19937(1);
+
+    // The scalar baseline is only as fast as glm's own math, so results are labelled with the glm they were built with.
+#if defined(GLM_VERSION) && defined(GLM_CONFIG_SIMD) && defined(GLM_ENABLE)
+    std::printf("glm %d, SIMD %s\n", GLM_VERSION, GLM_CONFIG_SIMD == GLM_ENABLE ? "enabled" : "disabled");
+#else
+    std::printf("glm version unknown\n");
+#endif
+
+    for (auto num_bones : {32, 64, 128, 256}) {
+        run(num_bones, rng);
+    }
+
+    auto skeletons = std::vector<sushi::skeleton>();
+    for (auto num_bones : {32, 64, 128}) {
+        skeletons.push_back(make_skeleton(num_bones, rng));
+        add_animation(skeletons.back(), 30, rng);
+    }
+
+    for (auto num_jobs : {1000, 4000}) {
+        run_batch(skeletons, num_jobs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Compares the draw throughput of the same meshes stored with vertex_layout::SEPARATE, one buffer per attribute,
+// and with vertex_layout::INTERLEAVED, one buffer with every attribute of a vertex next to each other.
+// Usage: sushi_bench_vertex_layout [file.iqm...]
+// Without arguments, a large synthetic file is generated and drawn.
+
+#include "draw_utils.hpp"
+
+#include <sushi/iqm.hpp>
+#include <sushi/mesh_group.hpp>
+
+#include <cstdio>
+#include <iostream>
+
+namespace {
+
+void run(const std::string& fname) {
+    constexpr auto runs = 5;
+    constexpr auto draws = 20;
+
+    auto data = sushi::iqm::load_iqm(fname);
+
+    if (!data) {
+        std::cerr << fname << ": failed to load\n";
+        return;
+    }
+
+    auto separate_options = sushi::mesh_options{};
+    separate_options.layout = sushi::vertex_layout::SEPARATE;
+
+    auto interleaved_options = sushi::mesh_options{};
+    interleaved_options.layout = sushi::vertex_layout::INTERLEAVED;
+
+    auto separate = sushi::load_meshes(*data, separate_options);
+    auto interleaved = sushi::load_meshes(*data, interleaved_options);
+
+    auto num_tris = std::size_t{0};
+    for (const auto& mesh : separate.meshes) {
+        num_tris += mesh.num_tris;
+    }
+
+    auto separate_ms = sushi_bench::time_draws(runs, draws, separate);
+    auto interleaved_ms = sushi_bench::time_draws(runs, draws, interleaved);
+
+    auto mtris = [&](double ms) { return double(num_tris) / (ms * 1000); };
+
+    std::printf("%s: %zu triangles, %zu vertices\n", fname.c_str(), num_tris, data->vertexarrays.position.size() / 3);
+    std::printf("  SEPARATE:     %8.3f ms per draw, %8.1f Mtris/s\n", separate_ms, mtris(separate_ms));
+    std::printf("  INTERLEAVED:  %8.3f ms per draw, %8.1f Mtris/s (%.2fx)\n",
+        interleaved_ms,
+        mtris(interleaved_ms),
+        separate_ms / interleaved_ms);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    auto window = sushi_bench::gl_window();
+    if (!window) {
+        return 1;
+    }
+
+    if (argc > 1) {
+        for (auto i = 1; i < argc; ++i) {
+            run(argv[i]);
+        }
+        return 0;
+    }
+
+    auto fname = std::string("sushi_bench_synthetic.iqm");
+
+    auto params = sushi_bench::iqm_params{};
+    params.num_frames = 0;
+
+    if (!sushi_bench::write_iqm_file(fname, params)) {
+        std::cerr << "Could not write " << fname << "\n";
+        return 1;
+    }
+    run(fname);
+    std::remove(fname.c_str());
+    return 0;
+}
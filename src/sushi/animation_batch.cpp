@@ -0,0 +1,68 @@
+#include "animation_batch.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sushi {
+
+namespace {
+
+/// Number of jobs claimed by a thread at once, which amortizes scheduling over a few characters.
+constexpr std::size_t jobs_per_task = 8;
+
+} // namespace
+
+animation_batch::animation_batch(const pose_blend_options& options) : options(options) {}
+
+void animation_batch::evaluate(span<const animation_job> jobs, thread_pool& pool) {
+    offsets.resize(jobs.size() + 1);
+    offsets[0] = 0;
+
+    for (auto i = std::size_t{0}; i < jobs.size(); ++i) {
+        offsets[i + 1] = offsets[i] + jobs[i].skele->get_num_bones();
+    }
+
+    palettes.resize(offsets.back());
+
+    while (scratch.size() < pool.size()) {
+        scratch.push_back({pose_evaluator(options)});
+    }
+
+    auto num_tasks = (jobs.size() + jobs_per_task - 1) / jobs_per_task;
+
+    pool.parallel_for(num_tasks, [&](std::size_t task, unsigned thread) {
+        auto& evaluator = scratch[thread].evaluator;
+        auto last = std::min(jobs.size(), (task + 1) * jobs_per_task);
+
+        for (auto i = task * jobs_per_task; i < last; ++i) {
+            const auto& job = jobs[i];
+            const auto& skele = *job.skele;
+            auto out = span<glm::mat4>(palettes.data() + offsets[i], offsets[i + 1] - offsets[i]);
+
+            if (!job.anim_index) {
+                for (auto b = std::size_t{0}; b < skele.get_num_bones(); ++b) {
+                    out[skele.joint_indices[b]] = skele.base_pose_inverses[b];
+                }
+                continue;
+            }
+
+            const auto& anim = skele.animations.at(*job.anim_index);
+            auto from = get_frame(skele, anim, job.time);
+
+            if (job.smooth) {
+                auto to = get_frame(skele, anim, job.time + 1.f / anim.framerate);
+                auto alpha = job.time * anim.framerate - std::floor(job.time * anim.framerate);
+
+                evaluator.evaluate(skele, from, to, alpha, out);
+            } else {
+                evaluator.evaluate(skele, from, out);
+            }
+        }
+    });
+}
+
+auto animation_batch::get_palette(std::size_t job) const -> span<const glm::mat4> {
+    return {palettes.data() + offsets[job], offsets[job + 1] - offsets[job]};
+}
+
+} // namespace sushi
@@ -0,0 +1,63 @@
+#ifndef SUSHI_ANIMATION_BATCH_HPP
+#define SUSHI_ANIMATION_BATCH_HPP
+
+#include "common.hpp"
+#include "pose_evaluator.hpp"
+#include "skeleton.hpp"
+#include "thread_pool.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+/// Sushi
+namespace sushi {
+
+/// One character to animate, with the same meaning as the arguments of `get_pose`.
+struct animation_job {
+    const skeleton* skele; /** Never null. */
+    std::optional<int> anim_index;
+    float time;
+    bool smooth;
+};
+
+/// Evaluates the skinning matrices of many characters at once, spread across a thread pool.
+///
+/// Every character's matrices (its palette) are written to one contiguous buffer, in job order,
+/// which is reused between calls, as is each thread's scratch memory.
+class animation_batch {
+public:
+    explicit animation_batch(const pose_blend_options& options = {});
+
+    /// Evaluates every job, replacing the results of the previous call.
+    /// \param jobs The characters to animate. Their skeletons must outlive the call.
+    /// \param pool Pool to run on. Jobs are handed to threads in small groups, as each thread becomes free.
+    void evaluate(span<const animation_job> jobs, thread_pool& pool = default_thread_pool());
+
+    /// Gets the skinning matrices of every job, one palette after another.
+    auto get_palettes() const -> span<const glm::mat4> { return {palettes.data(), palettes.size()}; }
+
+    /// Gets the skinning matrices of a job, indexed by joint.
+    /// \param job Index of the job in the last call to `evaluate`.
+    auto get_palette(std::size_t job) const -> span<const glm::mat4>;
+
+    /// Gets the index of a job's first matrix in `get_palettes()`.
+    auto get_offset(std::size_t job) const -> std::size_t { return offsets[job]; }
+
+private:
+    /// Kept on separate cache lines, since threads write to their own evaluator's members constantly.
+    struct alignas(64) thread_scratch {
+        pose_evaluator evaluator;
+    };
+
+    pose_blend_options options;
+    std::vector<thread_scratch> scratch;
+    std::vector<std::size_t> offsets; /** Start of each job's palette, followed by the total. */
+    std::vector<glm::mat4> palettes;
+};
+
+} // namespace sushi
+
+#endif // SUSHI_ANIMATION_BATCH_HPP
@@ -0,0 +1,142 @@
+#include "bone_palette.hpp"
+
+#ifndef __EMSCRIPTEN__
+
+#include "mesh_utils.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace sushi {
+
+void bone_palette_buffer::clear() {
+    rows.clear();
+}
+
+auto bone_palette_buffer::add(span<const glm::mat4> palette) -> GLint {
+    auto offset = GLint(get_size());
+
+    for (const auto& mat : palette) {
+        rows.emplace_back(mat[0][0], mat[1][0], mat[2][0], mat[3][0]);
+        rows.emplace_back(mat[0][1], mat[1][1], mat[2][1], mat[3][1]);
+        rows.emplace_back(mat[0][2], mat[1][2], mat[2][2], mat[3][2]);
+    }
+
+    return offset;
+}
+
+auto bone_palette_buffer::add(const pose& pose) -> GLint {
+    return add(pose.get_skinning_transforms());
+}
+
+auto bone_palette_buffer::add(const animation_batch& batch) -> GLint {
+    return add(batch.get_palettes());
+}
+
+void bone_palette_buffer::upload() {
+    if (!texture) {
+        buffer = make_unique_buffer();
+        texture = make_unique_texture();
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer.get());
+    SUSHI_DEFER { glBindBuffer(GL_TEXTURE_BUFFER, 0); };
+
+    // The buffer is orphaned every frame, so the driver never waits for draws still reading last frame's palettes.
+    if (rows.size() > capacity || capacity == 0) {
+        GLint max_texels;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+
+        if (rows.size() > std::size_t(max_texels)) {
+            std::cerr << "bone_palette_buffer: " << get_size() << " matrices exceed the texture buffer size limit.\n";
+        }
+
+        capacity = std::max({rows.size(), capacity * 2, std::size_t{64} * 3});
+        capacity = std::max(std::min(capacity, std::size_t(max_texels)), rows.size());
+
+        glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+
+        // The view is attached after the data store exists, and follows it through later orphaning.
+        glBindTexture(GL_TEXTURE_BUFFER, texture.get());
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer.get());
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    } else {
+        glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+    }
+
+    if (!rows.empty()) {
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, rows.size() * sizeof(glm::vec4), rows.data());
+    }
+}
+
+void bone_palette_buffer::bind() const {
+    GLint program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+    GLint prev_active_texture;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &prev_active_texture);
+
+    glActiveTexture(GL_TEXTURE0 + _detail::bone_palette_unit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture.get());
+    glActiveTexture(prev_active_texture);
+
+    _detail::set_bone_palette_unit(program);
+}
+
+namespace {
+
+/// Sets the uniforms of an animated draw, and binds the palettes and the group's VAO.
+void begin_palette_draw(const mesh_group& group, const bone_palette_buffer& palettes, GLint offset, GLint stride) {
+    GLint program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+    auto animated_uniform = glGetUniformLocation(program, "Animated");
+    auto octahedral_uniform = glGetUniformLocation(program, "OctahedralNormals");
+    auto offset_uniform = glGetUniformLocation(program, "BoneOffset");
+    auto stride_uniform = glGetUniformLocation(program, "BoneStride");
+
+    glUniform1i(animated_uniform, 1);
+    glUniform1i(octahedral_uniform, group.options.octahedral_normals);
+    glUniform1i(offset_uniform, offset);
+    glUniform1i(stride_uniform, stride);
+    palettes.bind();
+
+    glBindVertexArray(group.vao.get());
+}
+
+} // namespace
+
+void draw_mesh(const mesh_group& group, const bone_palette_buffer& palettes, GLint offset) {
+    begin_palette_draw(group, palettes, offset, 0);
+    SUSHI_DEFER { glBindVertexArray(0); };
+
+    for (const auto& mesh : group.meshes) {
+        _detail::draw_elements(group, mesh);
+    }
+}
+
+void draw_mesh(const mesh_group& group, const pose& pose, bone_palette_buffer& palettes) {
+    draw_mesh(group, pose.get_skinning_transforms(), palettes);
+}
+
+void draw_mesh(const mesh_group& group, span<const glm::mat4> palette, bone_palette_buffer& palettes) {
+    palettes.clear();
+    auto offset = palettes.add(palette);
+    palettes.upload();
+
+    draw_mesh(group, palettes, offset);
+}
+
+void draw_mesh_instanced(
+    const mesh_group& group, const bone_palette_buffer& palettes, GLint offset, GLint stride, GLsizei num_instances) {
+    begin_palette_draw(group, palettes, offset, stride);
+    SUSHI_DEFER { glBindVertexArray(0); };
+
+    for (const auto& mesh : group.meshes) {
+        _detail::draw_elements_instanced(group, mesh, num_instances);
+    }
+}
+
+} // namespace sushi
+
+#endif // __EMSCRIPTEN__
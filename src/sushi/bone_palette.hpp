@@ -0,0 +1,105 @@
+#ifndef SUSHI_BONE_PALETTE_HPP
+#define SUSHI_BONE_PALETTE_HPP
+
+#include "gl.hpp"
+#include "common.hpp"
+#include "animation_batch.hpp"
+#include "mesh_group.hpp"
+#include "pose.hpp"
+#include "texture.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Palettes are read through a texture buffer, which WebGL 1 lacks.
+#ifndef __EMSCRIPTEN__
+
+/// Sushi
+namespace sushi {
+
+/// Skinning matrices of any number of characters, uploaded together into one texture buffer.
+///
+/// Palettes are added over the course of a frame, each returning the offset a draw uses to find it,
+/// and then uploaded at once, so skeletons can be of any size and each frame costs a single upload.
+/// Matrices are stored as their top 3 rows, since skinning matrices are affine.
+/// See `assets/vert.glsl` for the shader side, which reads `BonePalette` at `BoneOffset`.
+/// The palettes are bound to texture unit 13, where every draw (animated or not) points `BonePalette`,
+/// so no other texture should be bound to that unit.
+class bone_palette_buffer {
+public:
+    /// Creates an empty buffer. GL objects are only created on the first upload.
+    bone_palette_buffer() = default;
+
+    /// Removes every palette, ready for the next frame.
+    void clear();
+
+    /// Adds a palette.
+    /// \param palette Skinning matrix of each joint.
+    /// \return Offset of the palette, in matrices.
+    auto add(span<const glm::mat4> palette) -> GLint;
+
+    /// Adds the palette of a pose, evaluating it if needed.
+    /// \param pose The pose.
+    /// \return Offset of the palette, in matrices.
+    auto add(const pose& pose) -> GLint;
+
+    /// Adds every palette of a batch, in job order.
+    /// \param batch The batch.
+    /// \return Offset of the first palette, in matrices. Add `batch.get_offset(job)` for each job's palette.
+    auto add(const animation_batch& batch) -> GLint;
+
+    /// Uploads every palette which has been added. Must be called on the GL context's thread, before drawing.
+    void upload();
+
+    /// Binds the palettes to the shader of the current program.
+    void bind() const;
+
+    /// Gets the number of matrices which have been added.
+    auto get_size() const -> std::size_t { return rows.size() / 3; }
+
+private:
+    std::vector<glm::vec4> rows;
+    std::size_t capacity = 0; /** Size of `buffer`, in rows. */
+    unique_buffer buffer;
+    unique_texture texture; /** Texture buffer view of `buffer`. */
+};
+
+/// Draws an animated mesh using a palette from a bone_palette_buffer.
+/// \param group The mesh to draw.
+/// \param palettes The uploaded palettes.
+/// \param offset Offset of the group's palette.
+void draw_mesh(const mesh_group& group, const bone_palette_buffer& palettes, GLint offset);
+
+/// Draws an animated mesh with the skinning matrices of a pose.
+/// The pose's palette replaces every palette in `palettes`, which is uploaded for the draw.
+/// Keep the buffer between draws, so that its GL objects are only created once.
+/// \param group The mesh to draw.
+/// \param pose The pose of the group's skeleton.
+/// \param palettes Buffer to upload the palette through.
+void draw_mesh(const mesh_group& group, const pose& pose, bone_palette_buffer& palettes);
+
+/// Draws an animated mesh with precomputed skinning matrices, such as those of an `animation_batch`.
+/// The matrices replace every palette in `palettes`, which is uploaded for the draw.
+/// When drawing many characters, adding all of their palettes before a single upload is cheaper.
+/// \param group The mesh to draw.
+/// \param palette Skinning matrix of each joint.
+/// \param palettes Buffer to upload the palette through.
+void draw_mesh(const mesh_group& group, span<const glm::mat4> palette, bone_palette_buffer& palettes);
+
+/// Draws many copies of an animated mesh in one call, each with its own palette.
+/// Instances share every other uniform, including `MVP`, so each palette should include its instance's model transform.
+/// \param group The mesh to draw.
+/// \param palettes The uploaded palettes.
+/// \param offset Offset of the first instance's palette.
+/// \param stride Distance between the palettes of consecutive instances, in matrices.
+/// \param num_instances Number of instances to draw.
+void draw_mesh_instanced(
+    const mesh_group& group, const bone_palette_buffer& palettes, GLint offset, GLint stride, GLsizei num_instances);
+
+} // namespace sushi
+
+#endif // __EMSCRIPTEN__
+
+#endif // SUSHI_BONE_PALETTE_HPP
@@ -87,6 +87,12 @@ public:
     span(T* ptr, std::size_t len) : b(ptr), e(ptr + len) {}
     span(T* b, T* e) : b(b), e(e) {}
 
+    /// Views the elements of a contiguous container, such as a `std::vector` or `std::array`.
+    template <typename C, typename = decltype(std::declval<C&>().data())>
+    span(C& c) : b(c.data()), e(c.data() + c.size()) {}
+
+    T* data() const { return b; }
+
     T* begin() const { return b; }
     T* end() const { return e; }
 
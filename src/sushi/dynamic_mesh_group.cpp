@@ -0,0 +1,423 @@
+#include "dynamic_mesh_group.hpp"
+
+#include "mesh_utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace sushi {
+
+namespace {
+
+/// Finds the stored format of an attribute, or null if the group doesn't have it.
+auto find_attrib(const _detail::vertex_encoding& format, attrib_location loc) -> const _detail::attrib_source* {
+    for (const auto& attr : format.get_attribs()) {
+        if (attr.loc == loc && attr.data) {
+            return &attr;
+        }
+    }
+    return nullptr;
+}
+
+/// Gets the smallest bounds containing both bounds.
+auto merge_bounds(const mesh_bounds& a, const mesh_bounds& b) -> mesh_bounds {
+    mesh_bounds bounds;
+    bounds.min = glm::min(a.min, b.min);
+    bounds.max = glm::max(a.max, b.max);
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+    // Each sphere is still contained after moving it to the new center, grown by the distance moved.
+    bounds.radius = std::max(
+        a.radius + glm::length(a.center - bounds.center),
+        b.radius + glm::length(b.center - bounds.center));
+
+    return bounds;
+}
+
+void upload_range(GLenum target, const unique_buffer& buf, std::size_t offset, std::size_t size, const void* data) {
+    glBindBuffer(target, buf.get());
+    glBufferSubData(target, offset, size, data);
+}
+
+} // namespace
+
+dynamic_mesh_group::dynamic_mesh_group(mesh_blob blob_in, float headroom) :
+    blob(std::move(blob_in)),
+    num_vertices(0),
+    vertex_capacity(0),
+    index_capacity(0),
+    headroom(headroom),
+    needs_reallocate(true) {
+
+    if (blob.options.layout == vertex_layout::INTERLEAVED) {
+        if (blob.format.interleaved.stride > 0) {
+            num_vertices = blob.vertex_data.size() / blob.format.interleaved.stride;
+        }
+    } else {
+        for (auto i = std::size_t{0}; i < blob.format.num_attribs; ++i) {
+            if (blob.format.attribs[i].data) {
+                num_vertices = blob.attrib_data[i].size() / _detail::get_attrib_size(blob.format.attribs[i]);
+                break;
+            }
+        }
+    }
+
+    // Indices are expanded to absolute 32-bit indices, so that they never need repacking as vertices are added.
+    auto index_size = blob.index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    for (auto& mesh : blob.meshes) {
+        auto num_indices = std::size_t(mesh.num_tris) * 3;
+        auto src = blob.index_data.data() + mesh.first_index * index_size;
+        auto first_index = indices.size();
+
+        for (auto i = std::size_t{0}; i < num_indices; ++i) {
+            GLuint idx;
+
+            if (blob.index_type == GL_UNSIGNED_SHORT) {
+                GLushort short_idx;
+                std::memcpy(&short_idx, src + i * index_size, sizeof(short_idx));
+                idx = short_idx;
+            } else {
+                std::memcpy(&idx, src + i * index_size, sizeof(idx));
+            }
+
+            indices.push_back(idx + GLuint(mesh.base_vertex));
+        }
+
+        mesh.first_index = GLsizei(first_index);
+        mesh.base_vertex = 0;
+        mesh.lods.clear();
+    }
+
+    blob.index_data = {};
+    blob.index_type = GL_UNSIGNED_INT;
+    blob.options.compact_indices = false;
+    blob.options.lods = {};
+
+    group.options = blob.options;
+
+    flush();
+}
+
+void dynamic_mesh_group::resize(std::size_t count) {
+    for (auto i = std::size_t{0}; i < blob.format.num_attribs; ++i) {
+        const auto& attr = blob.format.attribs[i];
+
+        if (!attr.data) {
+            continue;
+        }
+
+        if (blob.options.layout == vertex_layout::SEPARATE) {
+            blob.attrib_data[i].resize(count * _detail::get_attrib_size(attr));
+        }
+
+        if (count > num_vertices) {
+            dirty_attribs[static_cast<GLuint>(attr.loc)].add(num_vertices, count);
+        }
+    }
+
+    if (blob.options.layout == vertex_layout::INTERLEAVED) {
+        blob.vertex_data.resize(count * blob.format.interleaved.stride);
+    }
+
+    num_vertices = count;
+
+    if (num_vertices > vertex_capacity) {
+        needs_reallocate = true;
+    }
+}
+
+auto dynamic_mesh_group::set_attrib(
+    attrib_location loc,
+    std::size_t first,
+    std::size_t count,
+    GLint size,
+    GLenum type,
+    const void* data) -> bool {
+
+    auto to = find_attrib(blob.format, loc);
+
+    if (!to) {
+        return false;
+    }
+
+    if (first > num_vertices || count > num_vertices - first) {
+        std::cerr << "dynamic_mesh_group: Vertex range [" << first << ", " << first + count
+            << ") is outside of the " << num_vertices << " vertices.\n";
+        return false;
+    }
+
+    auto from = *to;
+    from.size = size;
+    from.type = type;
+
+    unsigned char* dst;
+    std::size_t stride;
+
+    if (blob.options.layout == vertex_layout::INTERLEAVED) {
+        stride = blob.format.interleaved.stride;
+        dst = blob.vertex_data.data() + first * stride + blob.format.interleaved.offsets[static_cast<GLuint>(loc)];
+    } else {
+        stride = _detail::get_attrib_size(*to);
+        dst = blob.attrib_data[to - blob.format.attribs.data()].data() + first * stride;
+    }
+
+    _detail::convert_attrib(from, data, *to, dst, stride, count);
+
+    dirty_attribs[static_cast<GLuint>(loc)].add(first, first + count);
+
+    return true;
+}
+
+void dynamic_mesh_group::set_positions(std::size_t first, span<const glm::vec3> values) {
+    if (set_attrib(attrib_location::POSITION, first, values.size(), 3, GL_FLOAT, values.data())) {
+        grow_bounds(values);
+    }
+}
+
+void dynamic_mesh_group::set_texcoords(std::size_t first, span<const glm::vec2> values) {
+    set_attrib(attrib_location::TEXCOORD, first, values.size(), 2, GL_FLOAT, values.data());
+}
+
+void dynamic_mesh_group::set_normals(std::size_t first, span<const glm::vec3> values) {
+    set_attrib(attrib_location::NORMAL, first, values.size(), 3, GL_FLOAT, values.data());
+}
+
+void dynamic_mesh_group::set_tangents(std::size_t first, span<const glm::vec3> values) {
+    set_attrib(attrib_location::TANGENT, first, values.size(), 3, GL_FLOAT, values.data());
+}
+
+void dynamic_mesh_group::set_blendindices(std::size_t first, span<const glm::ivec4> values) {
+    auto bytes = std::vector<GLubyte>(values.size() * 4);
+    for (auto i = std::size_t{0}; i < bytes.size(); ++i) {
+        bytes[i] = GLubyte(values[i / 4][i % 4]);
+    }
+    set_attrib(attrib_location::BLENDINDICES, first, values.size(), 4, GL_UNSIGNED_BYTE, bytes.data());
+}
+
+void dynamic_mesh_group::set_blendweights(std::size_t first, span<const glm::ivec4> values) {
+    auto bytes = std::vector<GLubyte>(values.size() * 4);
+    for (auto i = std::size_t{0}; i < bytes.size(); ++i) {
+        bytes[i] = GLubyte(values[i / 4][i % 4]);
+    }
+    set_attrib(attrib_location::BLENDWEIGHTS, first, values.size(), 4, GL_UNSIGNED_BYTE, bytes.data());
+}
+
+void dynamic_mesh_group::set_colors(std::size_t first, span<const glm::vec4> values) {
+    set_attrib(attrib_location::COLOR, first, values.size(), 4, GL_FLOAT, values.data());
+}
+
+void dynamic_mesh_group::set_triangles(std::size_t mesh_index, span<const GLuint> new_indices) {
+    if (mesh_index >= blob.meshes.size()) {
+        std::cerr << "dynamic_mesh_group: Mesh " << mesh_index << " does not exist.\n";
+        return;
+    }
+
+    if (new_indices.size() % 3 != 0) {
+        std::cerr << "dynamic_mesh_group: Index count " << new_indices.size() << " is not a multiple of 3.\n";
+    }
+
+    auto& mesh = blob.meshes[mesh_index];
+    auto count = new_indices.size() / 3 * 3;
+    auto first = std::size_t(mesh.first_index);
+    auto old_count = std::size_t(mesh.num_tris) * 3;
+
+    if (count != old_count) {
+        auto old_first = begin(indices) + first;
+        indices.erase(old_first, old_first + old_count);
+        indices.insert(begin(indices) + first, count, 0);
+
+        for (auto i = mesh_index + 1; i < blob.meshes.size(); ++i) {
+            blob.meshes[i].first_index += GLsizei(count) - GLsizei(old_count);
+        }
+
+        // Every following mesh has moved.
+        dirty_indices.add(first, indices.size());
+
+        if (indices.size() > index_capacity) {
+            needs_reallocate = true;
+        }
+    } else {
+        dirty_indices.add(first, first + count);
+    }
+
+    auto num_invalid = std::size_t{0};
+
+    for (auto i = std::size_t{0}; i < count; ++i) {
+        auto idx = new_indices[i];
+
+        if (idx >= num_vertices) {
+            idx = 0;
+            ++num_invalid;
+        }
+
+        indices[first + i] = idx;
+    }
+
+    if (num_invalid > 0) {
+        std::cerr << "dynamic_mesh_group: Warning: Mesh \"" << mesh.name << "\" has " << num_invalid << " out-of-range indices.\n";
+    }
+
+    mesh.num_tris = int(count / 3);
+}
+
+void dynamic_mesh_group::grow_bounds(span<const glm::vec3> positions) {
+    if (positions.empty()) {
+        return;
+    }
+
+    auto edited = compute_bounds(positions);
+
+    blob.bounds = merge_bounds(blob.bounds, edited);
+
+    // Which meshes use the edited vertices isn't tracked, so every mesh grows.
+    for (auto& mesh : blob.meshes) {
+        mesh.bounds = merge_bounds(mesh.bounds, edited);
+    }
+}
+
+void dynamic_mesh_group::recompute_bounds() {
+    if (!find_attrib(blob.format, attrib_location::POSITION)) {
+        return;
+    }
+
+    auto positions = std::vector<glm::vec3>(num_vertices);
+
+    // Positions are always stored as 32-bit floats.
+    if (blob.options.layout == vertex_layout::INTERLEAVED) {
+        auto stride = std::size_t(blob.format.interleaved.stride);
+        auto src = blob.vertex_data.data() + blob.format.interleaved.offsets[static_cast<GLuint>(attrib_location::POSITION)];
+        for (auto v = std::size_t{0}; v < num_vertices; ++v) {
+            std::memcpy(&positions[v], src + v * stride, sizeof(glm::vec3));
+        }
+    } else {
+        auto attr = find_attrib(blob.format, attrib_location::POSITION);
+        std::memcpy(positions.data(), blob.attrib_data[attr - blob.format.attribs.data()].data(), num_vertices * sizeof(glm::vec3));
+    }
+
+    for (auto& mesh : blob.meshes) {
+        auto first = begin(indices) + mesh.first_index;
+        auto last = first + std::size_t(mesh.num_tris) * 3;
+
+        if (first == last) {
+            mesh.bounds = {};
+        } else {
+            auto [min, max] = std::minmax_element(first, last);
+            mesh.bounds = compute_bounds({positions.data() + *min, std::size_t(*max - *min) + 1});
+        }
+    }
+
+    blob.bounds = compute_bounds(positions);
+}
+
+void dynamic_mesh_group::reallocate() {
+    using _detail::load_buffer;
+
+    auto grow = [&](std::size_t size) { return size + std::size_t(size * headroom); };
+
+    vertex_capacity = grow(num_vertices);
+    index_capacity = grow(indices.size());
+
+    if (blob.options.layout == vertex_layout::INTERLEAVED) {
+        auto stride = std::size_t(blob.format.interleaved.stride);
+        group.vertex_buffer = load_buffer(
+            GL_ARRAY_BUFFER, blob.vertex_data.data(), blob.vertex_data.size(), vertex_capacity * stride, GL_DYNAMIC_DRAW);
+    } else {
+        for (auto i = std::size_t{0}; i < blob.format.num_attribs; ++i) {
+            const auto& attr = blob.format.attribs[i];
+            if (attr.data) {
+                const auto& data = blob.attrib_data[i];
+                auto capacity = vertex_capacity * _detail::get_attrib_size(attr);
+                _detail::get_attrib_buffer(group, attr.loc) =
+                    load_buffer(GL_ARRAY_BUFFER, data.data(), data.size(), capacity, GL_DYNAMIC_DRAW);
+            }
+        }
+    }
+
+    group.vao = make_unique_vertex_array();
+    glBindVertexArray(group.vao.get());
+    SUSHI_DEFER { glBindVertexArray(0); };
+
+    group.index_type = GL_UNSIGNED_INT;
+    group.index_buffer = load_buffer(
+        GL_ELEMENT_ARRAY_BUFFER, indices.data(), indices.size() * sizeof(GLuint), index_capacity * sizeof(GLuint), GL_DYNAMIC_DRAW);
+
+    _detail::bind_attribs(group, blob.format);
+}
+
+void dynamic_mesh_group::flush() {
+    group.meshes = blob.meshes;
+    group.bounds = blob.bounds;
+
+    if (needs_reallocate) {
+        reallocate();
+        dirty_attribs = {};
+        dirty_indices = {};
+        needs_reallocate = false;
+        return;
+    }
+
+    // Vertices or indices may have been removed since they were edited.
+    for (auto& dirty : dirty_attribs) {
+        dirty.end = std::min(dirty.end, num_vertices);
+        dirty.begin = std::min(dirty.begin, dirty.end);
+    }
+
+    dirty_indices.end = std::min(dirty_indices.end, indices.size());
+    dirty_indices.begin = std::min(dirty_indices.begin, dirty_indices.end);
+
+    if (blob.options.layout == vertex_layout::INTERLEAVED) {
+        // Every attribute shares one buffer, so the union of their ranges is uploaded at once.
+        auto range = dirty_range{};
+
+        for (const auto& dirty : dirty_attribs) {
+            if (!dirty.empty()) {
+                range.add(dirty.begin, dirty.end);
+            }
+        }
+
+        if (!range.empty()) {
+            auto stride = std::size_t(blob.format.interleaved.stride);
+            upload_range(
+                GL_ARRAY_BUFFER,
+                group.vertex_buffer,
+                range.begin * stride,
+                (range.end - range.begin) * stride,
+                blob.vertex_data.data() + range.begin * stride);
+        }
+    } else {
+        for (auto i = std::size_t{0}; i < blob.format.num_attribs; ++i) {
+            const auto& attr = blob.format.attribs[i];
+            const auto& dirty = dirty_attribs[static_cast<GLuint>(attr.loc)];
+
+            if (attr.data && !dirty.empty()) {
+                auto size = _detail::get_attrib_size(attr);
+                upload_range(
+                    GL_ARRAY_BUFFER,
+                    _detail::get_attrib_buffer(group, attr.loc),
+                    dirty.begin * size,
+                    (dirty.end - dirty.begin) * size,
+                    blob.attrib_data[i].data() + dirty.begin * size);
+            }
+        }
+    }
+
+    if (!dirty_indices.empty()) {
+        // The element buffer binding belongs to the VAO, so it must be bound to avoid disturbing another VAO.
+        glBindVertexArray(group.vao.get());
+        SUSHI_DEFER { glBindVertexArray(0); };
+
+        upload_range(
+            GL_ELEMENT_ARRAY_BUFFER,
+            group.index_buffer,
+            dirty_indices.begin * sizeof(GLuint),
+            (dirty_indices.end - dirty_indices.begin) * sizeof(GLuint),
+            indices.data() + dirty_indices.begin);
+    }
+
+    dirty_attribs = {};
+    dirty_indices = {};
+}
+
+} // namespace sushi
@@ -0,0 +1,100 @@
+#ifndef SUSHI_DYNAMIC_MESH_GROUP_HPP
+#define SUSHI_DYNAMIC_MESH_GROUP_HPP
+
+#include "gl.hpp"
+#include "attrib_location.hpp"
+#include "common.hpp"
+#include "mesh_group.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+/// Sushi
+namespace sushi {
+
+/// A mesh_group whose vertices and triangles can be edited after upload.
+/// Edits are applied to a CPU-side copy of the encoded data, and `flush()` uploads only the ranges which changed.
+/// Buffers are allocated with extra capacity, so that growing the group doesn't reallocate them every time.
+/// Indices are always stored as 32-bit absolute vertex indices, and levels of detail are not supported.
+class dynamic_mesh_group {
+public:
+    /// Uploads baked meshes into dynamic buffers. Must be called on the GL context's thread.
+    /// \param blob The baked meshes. Any levels of detail are discarded.
+    /// \param headroom Extra capacity to allocate whenever buffers are (re)allocated, relative to the size needed.
+    explicit dynamic_mesh_group(mesh_blob blob, float headroom = 0.5f);
+
+    /// Gets the group, for drawing. Edits are not visible until `flush()` is called.
+    auto get() const -> const mesh_group& { return group; }
+
+    auto get_num_vertices() const -> std::size_t { return num_vertices; }
+
+    /// Changes the number of vertices. New vertices have zeroed attributes.
+    /// Buffers are only reallocated once their capacity is exceeded.
+    void resize(std::size_t count);
+
+    /// Replaces the attributes of a range of vertices, which must already exist.
+    /// Values are encoded into the group's vertex format. Attributes which the group doesn't have are ignored.
+    /// \param first Index of the first vertex to replace.
+    /// \param values One value for each vertex.
+    void set_positions(std::size_t first, span<const glm::vec3> values);
+    void set_texcoords(std::size_t first, span<const glm::vec2> values);
+    void set_normals(std::size_t first, span<const glm::vec3> values);
+    void set_tangents(std::size_t first, span<const glm::vec3> values);
+    void set_blendindices(std::size_t first, span<const glm::ivec4> values);
+    void set_blendweights(std::size_t first, span<const glm::ivec4> values);
+    void set_colors(std::size_t first, span<const glm::vec4> values);
+
+    /// Replaces every triangle of a mesh.
+    /// If the number of triangles changes, the indices of every following mesh are uploaded again.
+    /// \param mesh Index of the mesh in the group.
+    /// \param indices Absolute vertex indices, three per triangle.
+    void set_triangles(std::size_t mesh, span<const GLuint> indices);
+
+    /// Recomputes the bounds of every mesh and of the group.
+    /// Editing positions only grows the bounds, so this can tighten them after vertices move inwards.
+    void recompute_bounds();
+
+    /// Uploads every edit since the last flush. Must be called on the GL context's thread.
+    void flush();
+
+private:
+    /// A half-open range of elements which need uploading.
+    struct dirty_range {
+        std::size_t begin = 0;
+        std::size_t end = 0;
+
+        void add(std::size_t first, std::size_t last) {
+            if (begin == end) {
+                begin = first;
+                end = last;
+            } else {
+                begin = std::min(begin, first);
+                end = std::max(end, last);
+            }
+        }
+
+        auto empty() const -> bool { return begin == end; }
+    };
+
+    auto set_attrib(attrib_location loc, std::size_t first, std::size_t count, GLint size, GLenum type, const void* data)
+        -> bool;
+    void grow_bounds(span<const glm::vec3> positions);
+    void reallocate();
+
+    mesh_blob blob;
+    mesh_group group;
+    std::vector<GLuint> indices;
+    std::size_t num_vertices;
+    std::size_t vertex_capacity;
+    std::size_t index_capacity;
+    float headroom;
+    std::array<dirty_range, 7> dirty_attribs; /** In vertices, indexed by attrib_location. */
+    dirty_range dirty_indices;
+    bool needs_reallocate;
+};
+
+} // namespace sushi
+
+#endif // SUSHI_DYNAMIC_MESH_GROUP_HPP
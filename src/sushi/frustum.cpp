@@ -1,6 +1,8 @@
 
 #include "frustum.hpp"
 
+#include "mesh_group.hpp"
+
 namespace sushi {
 
 frustum::plane::plane(const glm::vec4 &vec) :
@@ -32,4 +34,23 @@ bool frustum::contains(const glm::vec3& position, float radius) const {
     return true;
 }
 
+bool frustum::contains(const glm::vec3& min, const glm::vec3& max) const {
+    for (auto&& plane : planes) {
+        // The corner furthest along the plane's normal.
+        auto corner = glm::vec3{
+            plane.normal.x >= 0 ? max.x : min.x,
+            plane.normal.y >= 0 ? max.y : min.y,
+            plane.normal.z >= 0 ? max.z : min.z};
+
+        if (dot(plane.normal, corner) + plane.offset < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool frustum::contains(const mesh_bounds& bounds) const {
+    return contains(bounds.center, bounds.radius) && contains(bounds.min, bounds.max);
+}
+
 } // namespace sushi
@@ -5,6 +5,8 @@
 
 namespace sushi {
 
+struct mesh_bounds;
+
 /// A camera frustum.
 class frustum {
 public:
@@ -42,6 +44,19 @@ public:
     /// \param radius Radius of sphere.
     /// \return True if the sphere intersects the frustum.
     bool contains(const glm::vec3& position, float radius) const;
+
+    /// Determines if the given axis-aligned box intersects the frustum.
+    /// The test is conservative: some boxes near the frustum's corners are reported as intersecting.
+    /// \param min Minimum corner of the box.
+    /// \param max Maximum corner of the box.
+    /// \return True if the box intersects the frustum.
+    bool contains(const glm::vec3& min, const glm::vec3& max) const;
+
+    /// Determines if the given bounds intersect the frustum, testing the bounding sphere first, then the box.
+    /// To test a mesh's model-space bounds, construct the frustum from the full model-view-projection matrix.
+    /// \param bounds The bounds.
+    /// \return True if the bounds intersect the frustum.
+    bool contains(const mesh_bounds& bounds) const;
 };
 
 } // namespace sushi
@@ -4,300 +4,555 @@
 
 #include "iqm.hpp"
 
+#include "mapped_file.hpp"
+
 #include <algorithm>
-#include <memory>
-#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
 
 namespace sushi {
 namespace iqm {
 
-std::optional<iqm_data> load_iqm(const std::string& fname) try {
-    constexpr bool orient90X = true;
-    const auto rotfixer90X = glm::angleAxis(glm::radians(-90.f), glm::vec3{1, 0, 0});
+namespace {
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool host_is_little_endian = false;
+#else
+constexpr bool host_is_little_endian = true;
+#endif
+
+enum vertexarray_format : std::uint32_t {
+    IQM_UBYTE = 1,
+    IQM_FLOAT = 7,
+};
+
+constexpr std::size_t header_size = 16 + 27 * 4;
+constexpr std::size_t mesh_size = 6 * 4;
+constexpr std::size_t vertexarray_size = 5 * 4;
+constexpr std::size_t triangle_size = 3 * 4;
+constexpr std::size_t joint_size = 2 * 4 + 10 * 4;
+constexpr std::size_t pose_size = 2 * 4 + 20 * 4;
+constexpr std::size_t anim_size = 5 * 4;
+constexpr std::size_t bound_size = 8 * 4;
+
+/// Copies `count` little-endian values of type T out of the file.
+template <typename T>
+void read_le_array(const unsigned char* src, T* dst, std::size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    if (count == 0) {
+        return;
+    }
 
-    std::unique_ptr<std::FILE,int(*)(std::FILE*)> file (std::fopen(fname.c_str(), "rb"), &std::fclose);
+    std::memcpy(dst, src, count * sizeof(T));
 
-    if (!file) {
-        std::cerr << "sushi::iqm::load_iqm: Could not open file \"" << fname << "\".\n";
-        return std::nullopt;
+    if constexpr (!host_is_little_endian && sizeof(T) > 1) {
+        auto bytes = reinterpret_cast<unsigned char*>(dst);
+        for (std::size_t i = 0; i < count; ++i) {
+            std::reverse(bytes + i * sizeof(T), bytes + (i + 1) * sizeof(T));
+        }
     }
+}
 
-    auto next_u8 = [&]{
-        std::uint8_t rv = 0;
-        int c = std::fgetc(file.get());
-        if (c == EOF) {
-            throw std::runtime_error("ERROR: " + fname + ": Unexpected EOF!");
-        }
-        rv |= std::uint8_t(c);
-        return rv;
-    };
+template <typename T>
+auto read_le(const unsigned char* src) -> T {
+    T rv;
+    read_le_array(src, &rv, 1);
+    return rv;
+}
 
-    auto next_u32 = [&]{
-        std::uint32_t rv = 0;
-        for (int i=0; i<4; ++i) {
-            auto c = next_u8();
-            rv |= std::uint32_t(c) << (8 * i);
-        }
-        return rv;
-    };
+/// Reorients a tightly packed array of 3-component vectors from IQM's Z-up space into Y-up space.
+/// Equivalent to rotating each vector by -90 degrees around the X axis: `(x, y, z) -> (x, z, -y)`.
+void orient_vec3_array(float* data, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+        auto v = data + i * 3;
+        auto y = v[1];
+        auto z = v[2];
+        v[1] = z;
+        v[2] = -y;
+    }
+}
 
-    auto next_u16 = [&]{
-        std::uint16_t rv = 0;
-        for (int i=0; i<2; ++i) {
-            auto c = next_u8();
-            rv |= std::uint16_t(c) << (8 * i);
-        }
-        return rv;
-    };
+/// Reads and validates the header, including the bounds of every section.
+/// After this succeeds, all section reads are guaranteed to be within the file.
+auto read_header(const mapped_file& file, const std::string& fname) -> header {
+    if (file.size() < header_size) {
+        throw std::runtime_error("ERROR: " + fname + ": Unexpected EOF!");
+    }
 
-    auto next_int = [&]{
-        static_assert(sizeof(int)==sizeof(std::uint32_t), "Oh no.");
-        auto i = next_u32();
-        int rv;
-        std::copy(reinterpret_cast<char*>(&i), reinterpret_cast<char*>(&i + 1), reinterpret_cast<char*>(&rv));
-        return rv;
-    };
+    if (std::memcmp(file.data(), "INTERQUAKEMODEL", 16) != 0) {
+        throw std::runtime_error("ERROR: " + fname + ": Bad magic string!");
+    }
 
-    auto next_float = [&]{
-        static_assert(sizeof(float)==sizeof(std::uint32_t), "NOOO!!!");
-        auto i = next_u32();
-        float rv;
-        std::copy(reinterpret_cast<char*>(&i), reinterpret_cast<char*>(&i + 1), reinterpret_cast<char*>(&rv));
-        return rv;
-    };
+    std::uint32_t fields[27];
+    read_le_array(file.data() + 16, fields, 27);
 
-    auto next_string = [&]{
-        std::string rv;
-        while (true) {
-            int c = std::fgetc(file.get());
-            if (c == EOF) {
-                throw std::runtime_error("ERROR: " + fname + ": Unexpected EOF!");
-            }
-            if (char(c) == '\0') {
-                return rv;
-            }
-            rv.push_back(char(c));
+    header h;
+    static_assert(sizeof(h) == sizeof(fields));
+    std::memcpy(&h, fields, sizeof(h));
+
+    if (h.version != 2) {
+        throw std::runtime_error("ERROR: " + fname + ": Wrong version!");
+    }
+
+    auto check_section = [&](std::uint32_t ofs, std::uint64_t count, std::uint64_t elem_size, const char* what) {
+        if (count == 0) {
+            return;
+        }
+        if (std::uint64_t(ofs) + count * elem_size > file.size()) {
+            throw std::runtime_error("ERROR: " + fname + ": Section \"" + what + "\" extends past EOF!");
         }
     };
 
-    auto magic = next_string();
-    if (magic != "INTERQUAKEMODEL") {
-        throw std::runtime_error("ERROR: " + fname + ": Bad magic string!");
+    check_section(h.ofs_text, h.num_text, 1, "text");
+    check_section(h.ofs_meshes, h.num_meshes, mesh_size, "meshes");
+    check_section(h.ofs_vertexarrays, h.num_vertexarrays, vertexarray_size, "vertexarrays");
+    check_section(h.ofs_triangles, h.num_triangles, triangle_size, "triangles");
+    check_section(h.ofs_joints, h.num_joints, joint_size, "joints");
+    check_section(h.ofs_poses, h.num_poses, pose_size, "poses");
+    check_section(h.ofs_anims, h.num_anims, anim_size, "anims");
+    check_section(h.ofs_frames, std::uint64_t(h.num_frames) * h.num_framechannels, 2, "frames");
+    if (h.ofs_bounds != 0) {
+        check_section(h.ofs_bounds, h.num_frames, bound_size, "bounds");
     }
 
-    auto version = next_u32();
-    if (version != 2) {
-        throw std::runtime_error("ERROR: " + fname + ": Wrong version!");
-    }
+    return h;
+}
 
-    next_u32(); // filesize
-    next_u32(); // flags
-    auto num_text = next_u32();
-    auto ofs_text = next_u32();
-    auto num_meshes = next_u32();
-    auto ofs_meshes = next_u32();
-    auto num_vertexarrays = next_u32();
-    auto num_vertexes = next_u32();
-    auto ofs_vertexarrays = next_u32();
-    auto num_triangles = next_u32();
-    auto ofs_triangles = next_u32();
-    auto ofs_adjacency = next_u32();
-    auto num_joints = next_u32();
-    auto ofs_joints = next_u32();
-    auto num_poses = next_u32();
-    auto ofs_poses = next_u32();
-    auto num_anims = next_u32();
-    auto ofs_anims = next_u32();
-    auto num_frames = next_u32();
-    auto num_framechannels = next_u32();
-    auto ofs_frames = next_u32();
-    auto ofs_bounds = next_u32();
-    auto num_comment = next_u32();
-    auto ofs_comment = next_u32();
-    auto num_extensions = next_u32();
-    auto ofs_extensions = next_u32();
+/// Views a string in the text section.
+auto get_name(const iqm_file& iqm, std::uint32_t pos) -> std::string_view {
+    const auto& h = iqm.get_header();
 
-    iqm_data rv;
+    if (h.num_text == 0 && pos == 0) {
+        return {};
+    }
 
-    auto get_name = [&](long pos){
-        auto cur = std::ftell(file.get());
-        std::fseek(file.get(), ofs_text + pos, SEEK_SET);
-        SUSHI_DEFER { std::fseek(file.get(), cur, SEEK_SET); };
-        auto rv = next_string();
-        return rv;
-    };
+    if (pos >= h.num_text) {
+        throw std::runtime_error("ERROR: " + iqm.get_filename() + ": String offset out of range!");
+    }
 
-    // meshes
+    auto text = iqm.get_file().chars() + h.ofs_text;
+    auto start = text + pos;
+    auto end = static_cast<const char*>(std::memchr(start, '\0', h.num_text - pos));
 
-    std::fseek(file.get(), ofs_meshes, SEEK_SET);
-    for (auto i = 0u; i < num_meshes; ++i) {
-        mesh m;
-        m.name = get_name(next_u32());
-        m.material = get_name(next_u32());
-        m.first_vertex = next_u32();
-        m.num_vertexes = next_u32();
-        m.first_triangle = next_u32();
-        m.num_triangles = next_u32();
-        rv.meshes.push_back(std::move(m));
+    if (!end) {
+        throw std::runtime_error("ERROR: " + iqm.get_filename() + ": Unexpected EOF!");
     }
 
-    // vertexarrays
+    return std::string_view(start, end - start);
+}
+
+constexpr bool orient90X = true;
+
+auto get_rotfixer90X() -> glm::quat {
+    return glm::angleAxis(glm::radians(-90.f), glm::vec3{1, 0, 0});
+}
 
-    std::fseek(file.get(), ofs_vertexarrays, SEEK_SET);
-    for (auto i = 0u; i < num_vertexarrays; ++i) {
-        auto type = next_u32();
-        next_u32(); // flags
-        auto format = next_u32();
-        auto size = next_u32();
-        auto offset = next_u32();
+struct vertexarray_desc {
+    std::uint32_t format;
+    std::uint32_t size;
+    std::uint32_t offset;
+};
 
-        auto cur = std::ftell(file.get());
-        std::fseek(file.get(), offset, SEEK_SET);
-        SUSHI_DEFER { std::fseek(file.get(), cur, SEEK_SET); };
+/// Finds and validates a vertex array.
+auto find_vertexarray(const iqm_file& iqm, vertexarray_type type) -> std::optional<vertexarray_desc> {
+    const auto& h = iqm.get_header();
+    const auto& fname = iqm.get_filename();
+    auto base = iqm.get_file().data();
+
+    for (auto i = 0u; i < h.num_vertexarrays; ++i) {
+        std::uint32_t fields[5];
+        read_le_array(base + h.ofs_vertexarrays + i * vertexarray_size, fields, 5);
+
+        if (fields[0] != static_cast<std::uint32_t>(type)) {
+            continue;
+        }
+
+        auto desc = vertexarray_desc{fields[2], fields[3], fields[4]};
+
+        auto expect = [&](std::uint32_t expected_format, std::uint32_t min_size, std::uint32_t max_size) {
+            if (desc.format != expected_format || desc.size < min_size || desc.size > max_size) {
+                throw std::runtime_error("ERROR: " + fname + ": Unsupported vertex array format!");
+            }
+            auto elem_size = desc.format == IQM_FLOAT ? 4 : 1;
+            if (std::uint64_t(desc.offset) + std::uint64_t(h.num_vertexes) * desc.size * elem_size > iqm.get_file().size()) {
+                throw std::runtime_error("ERROR: " + fname + ": Vertex array extends past EOF!");
+            }
+        };
 
         switch (type) {
-            case 0: // position
-                if (orient90X) {
-                    for (auto i = 0; i < num_vertexes; ++i) {
-                        auto x = next_float();
-                        auto y = -next_float();
-                        auto z = next_float();
-                        rv.vertexarrays.position.push_back(x);
-                        rv.vertexarrays.position.push_back(z);
-                        rv.vertexarrays.position.push_back(y);
-                    }
-                } else {
-                    std::generate_n(std::back_inserter(rv.vertexarrays.position), num_vertexes * size, next_float);
-                }
-                break;
-            case 1: // texcoord
-                std::generate_n(std::back_inserter(rv.vertexarrays.texcoord), num_vertexes * size, next_float);
-                break;
-            case 2: // normal
-                if (orient90X) {
-                    for (auto i = 0; i < num_vertexes; ++i) {
-                        auto x = next_float();
-                        auto y = -next_float();
-                        auto z = next_float();
-                        rv.vertexarrays.normal.push_back(x);
-                        rv.vertexarrays.normal.push_back(z);
-                        rv.vertexarrays.normal.push_back(y);
-                    }
-                } else {
-                    std::generate_n(std::back_inserter(rv.vertexarrays.normal), num_vertexes * size, next_float);
-                }
-                break;
-            case 3: // tangent
-                if (orient90X) {
-                    for (auto i = 0; i < num_vertexes; ++i) {
-                        auto x = next_float();
-                        auto y = -next_float();
-                        auto z = next_float();
-                        rv.vertexarrays.tangent.push_back(x);
-                        rv.vertexarrays.tangent.push_back(z);
-                        rv.vertexarrays.tangent.push_back(y);
-                    }
-                } else {
-                    std::generate_n(std::back_inserter(rv.vertexarrays.tangent), num_vertexes * size, next_float);
-                }
+            case vertexarray_type::POSITION:
+            case vertexarray_type::NORMAL:
+            case vertexarray_type::TANGENT:
+                expect(IQM_FLOAT, 3, 4);
                 break;
-            case 4: // blendindexes
-                std::generate_n(std::back_inserter(rv.vertexarrays.blendindexes), num_vertexes * size, next_u8);
+            case vertexarray_type::TEXCOORD:
+                expect(IQM_FLOAT, 1, 4);
                 break;
-            case 5: // blendweights
-                std::generate_n(std::back_inserter(rv.vertexarrays.blendweights), num_vertexes * size, next_u8);
-                break;
-            case 6: // color
-                std::generate_n(std::back_inserter(rv.vertexarrays.color), num_vertexes * size, next_u8);
+            case vertexarray_type::BLENDINDEXES:
+            case vertexarray_type::BLENDWEIGHTS:
+            case vertexarray_type::COLOR:
+                expect(IQM_UBYTE, 1, 4);
                 break;
         }
+
+        return desc;
     }
 
-    // triangles
+    return std::nullopt;
+}
 
-    std::fseek(file.get(), ofs_triangles, SEEK_SET);
-    for (auto i = 0u; i < num_triangles; ++i) {
-        triangle t;
-        std::generate(std::begin(t.verts), std::end(t.verts), next_u32);
-        rv.triangles.push_back(std::move(t));
+/// Number of components per vertex in the decoded array.
+auto get_decoded_components(vertexarray_type type, const vertexarray_desc& desc) -> std::uint32_t {
+    switch (type) {
+        case vertexarray_type::POSITION:
+        case vertexarray_type::NORMAL:
+        case vertexarray_type::TANGENT:
+            return 3;
+        default:
+            return desc.size;
     }
+}
+
+template <typename T>
+void decode_vertexarray_into(const iqm_file& iqm, vertexarray_type type, std::vector<T>& dst) {
+    dst.resize(get_vertexarray_size(iqm, type) / sizeof(T));
+    decode_vertexarray(iqm, type, dst.data());
+}
+
+void decode_geometry(const iqm_file& iqm, iqm_data& rv) {
+    const auto& h = iqm.get_header();
+
+    rv.meshes = decode_meshes(iqm);
+
+    decode_vertexarray_into(iqm, vertexarray_type::POSITION, rv.vertexarrays.position);
+    decode_vertexarray_into(iqm, vertexarray_type::TEXCOORD, rv.vertexarrays.texcoord);
+    decode_vertexarray_into(iqm, vertexarray_type::NORMAL, rv.vertexarrays.normal);
+    decode_vertexarray_into(iqm, vertexarray_type::TANGENT, rv.vertexarrays.tangent);
+    decode_vertexarray_into(iqm, vertexarray_type::BLENDINDEXES, rv.vertexarrays.blendindexes);
+    decode_vertexarray_into(iqm, vertexarray_type::BLENDWEIGHTS, rv.vertexarrays.blendweights);
+    decode_vertexarray_into(iqm, vertexarray_type::COLOR, rv.vertexarrays.color);
+
+    rv.triangles.resize(h.num_triangles);
+    decode_triangles(iqm, 0, h.num_triangles, rv.triangles.data());
+}
+
+void decode_skeleton(const iqm_file& iqm, iqm_data& rv) {
+    const auto& h = iqm.get_header();
+    const auto rotfixer90X = get_rotfixer90X();
+    auto base = iqm.get_file().data();
 
     // joints
 
-    std::fseek(file.get(), ofs_joints, SEEK_SET);
-    for (auto i = 0u; i < num_joints; ++i) {
+    rv.joints.reserve(h.num_joints);
+    for (auto i = 0u; i < h.num_joints; ++i) {
+        auto src = base + h.ofs_joints + i * joint_size;
+        float values[10];
+        read_le_array(src + 8, values, 10);
+
         joint j;
-        j.name = get_name(next_u32());
-        j.parent = next_int();
+        j.name = get_name(iqm, read_le<std::uint32_t>(src));
+        j.parent = read_le<std::int32_t>(src + 4);
+        j.pos = {values[0], values[1], values[2]};
+        j.rot.x = values[3]; j.rot.y = values[4]; j.rot.z = values[5]; j.rot.w = values[6];
+        j.scl = {values[7], values[8], values[9]};
+
         if (orient90X && j.parent == -1) {
-            j.pos.x = next_float(); j.pos.x = next_float(); j.pos.z = next_float();
-            j.rot.x = next_float(); j.rot.y = next_float(); j.rot.z = next_float(); j.rot.w = next_float();
+            j.pos = rotfixer90X * j.pos;
             j.rot = rotfixer90X * j.rot;
-            j.scl.x = next_float(); j.scl.y = next_float(); j.scl.z = next_float();
-        } else {
-            j.pos.x = next_float(); j.pos.y = next_float(); j.pos.z = next_float();
-            j.rot.x = next_float(); j.rot.y = next_float(); j.rot.z = next_float(); j.rot.w = next_float();
-            j.scl.x = next_float(); j.scl.y = next_float(); j.scl.z = next_float();
         }
+
         rv.joints.push_back(std::move(j));
     }
 
     // poses
 
-    std::fseek(file.get(), ofs_poses, SEEK_SET);
-    for (auto i = 0u; i < num_poses; ++i) {
+    rv.poses.reserve(h.num_poses);
+    for (auto i = 0u; i < h.num_poses; ++i) {
+        auto src = base + h.ofs_poses + i * pose_size;
+
         pose p;
-        p.parent = next_int();
-        p.channels = next_u32();
-        std::generate(std::begin(p.offsets), std::end(p.offsets), next_float);
-        std::generate(std::begin(p.scales), std::end(p.scales), next_float);
+        p.parent = read_le<std::int32_t>(src);
+        p.channels = read_le<std::uint32_t>(src + 4);
+        read_le_array(src + 8, p.offsets, 10);
+        read_le_array(src + 48, p.scales, 10);
         rv.poses.push_back(std::move(p));
     }
+}
+
+/// Determines which animations are selected by the options, in file order.
+auto select_anims(const iqm_file& iqm, const load_options& options) -> std::vector<anim> {
+    const auto& h = iqm.get_header();
+    auto base = iqm.get_file().data();
+
+    std::vector<anim> rv;
+    rv.reserve(options.animation_names.empty() ? h.num_anims : options.animation_names.size());
+
+    for (auto i = 0u; i < h.num_anims; ++i) {
+        auto src = base + h.ofs_anims + i * anim_size;
 
-    // anims
+        auto name = get_name(iqm, read_le<std::uint32_t>(src));
+
+        if (!options.animation_names.empty() &&
+            std::find(begin(options.animation_names), end(options.animation_names), name) == end(options.animation_names)) {
+            continue;
+        }
 
-    std::fseek(file.get(), ofs_anims, SEEK_SET);
-    for (auto i = 0u; i < num_anims; ++i) {
         anim a;
-        a.name = get_name(next_u32());
-        a.first_frame = next_u32();
-        a.num_frames = next_u32();
-        a.framerate = next_float();
-        auto flags = next_u32();
+        a.name = name;
+        a.first_frame = read_le<std::uint32_t>(src + 4);
+        a.num_frames = read_le<std::uint32_t>(src + 8);
+        a.framerate = read_le<float>(src + 12);
+        auto flags = read_le<std::uint32_t>(src + 16);
         a.loop = bool(flags & 1);
-        rv.anims.push_back(std::move(a));
+
+        if (std::uint64_t(a.first_frame) + a.num_frames > h.num_frames) {
+            throw std::runtime_error("ERROR: " + iqm.get_filename() + ": Animation \"" + a.name + "\" is out of range!");
+        }
+
+        rv.push_back(std::move(a));
+    }
+
+    for (const auto& name : options.animation_names) {
+        if (std::none_of(begin(rv), end(rv), [&](const anim& a) { return a.name == name; })) {
+            std::cerr << "sushi::iqm::load_iqm: Warning: Animation \"" << name << "\" not found in " << iqm.get_filename() << ".\n";
+        }
+    }
+
+    return rv;
+}
+
+/// Calls `func(first_frame, num_frames)` for each contiguous run of selected frames.
+/// When every animation is selected, this is just the whole frame range.
+template <typename F>
+void for_each_frame_range(const iqm_file& iqm, const load_options& options, const std::vector<anim>& anims, F&& func) {
+    if (options.animation_names.empty()) {
+        func(0u, iqm.get_header().num_frames);
+    } else {
+        for (const auto& a : anims) {
+            func(a.first_frame, a.num_frames);
+        }
     }
+}
+
+void decode_animations(const iqm_file& iqm, const load_options& options, const std::vector<anim>& anims, iqm_data& rv) {
+    const auto& h = iqm.get_header();
+    auto base = iqm.get_file().data();
+
+    rv.anims = anims;
+    rv.num_framechannels = h.num_framechannels;
 
     // frames
 
-    std::fseek(file.get(), ofs_frames, SEEK_SET);
-    std::generate_n(std::back_inserter(rv.frames), num_frames * num_framechannels, next_u16);
-    rv.num_framechannels = num_framechannels;
-
-    // bounds
-
-    std::fseek(file.get(), ofs_bounds, SEEK_SET);
-    for (auto i = 0u; i < num_frames; ++i) {
-        bound b;
-        if (orient90X) {
-            b.min.x = next_float();
-            b.min.z = next_float();
-            b.min.y = next_float();
-            b.max.x = next_float();
-            b.max.z = next_float();
-            b.max.y = next_float();
-        } else {
-            b.min.x = next_float();
-            b.min.y = next_float();
-            b.min.z = next_float();
-            b.max.x = next_float();
-            b.max.y = next_float();
-            b.max.z = next_float();
+    auto total_frames = std::size_t{0};
+    for_each_frame_range(iqm, options, anims, [&](std::uint32_t, std::uint32_t count) { total_frames += count; });
+
+    rv.frames.resize(total_frames * h.num_framechannels);
+
+    auto next_frame = std::uint32_t{0};
+    for_each_frame_range(iqm, options, anims, [&](std::uint32_t first, std::uint32_t count) {
+        read_le_array(
+            base + h.ofs_frames + std::size_t(first) * h.num_framechannels * 2,
+            rv.frames.data() + std::size_t(next_frame) * h.num_framechannels,
+            std::size_t(count) * h.num_framechannels);
+        next_frame += count;
+    });
+
+    // Frames are packed in selection order, so the animations must be renumbered to match.
+    if (!options.animation_names.empty()) {
+        auto first_frame = std::uint32_t{0};
+        for (auto& a : rv.anims) {
+            a.first_frame = first_frame;
+            first_frame += a.num_frames;
+        }
+    }
+}
+
+void decode_bounds(const iqm_file& iqm, const load_options& options, const std::vector<anim>& anims, iqm_data& rv) {
+    const auto& h = iqm.get_header();
+    auto base = iqm.get_file().data();
+
+    if (h.ofs_bounds == 0) {
+        return;
+    }
+
+    for_each_frame_range(iqm, options, anims, [&](std::uint32_t first, std::uint32_t count) {
+        rv.bounds.reserve(rv.bounds.size() + count);
+        for (auto i = first; i < first + count; ++i) {
+            float values[8];
+            read_le_array(base + h.ofs_bounds + i * bound_size, values, 8);
+
+            bound b;
+            if (orient90X) {
+                b.min = {values[0], values[2], values[1]};
+                b.max = {values[3], values[5], values[4]};
+            } else {
+                b.min = {values[0], values[1], values[2]};
+                b.max = {values[3], values[4], values[5]};
+            }
+            b.xyradius = values[6];
+            b.radius = values[7];
+            rv.bounds.push_back(std::move(b));
+        }
+    });
+}
+
+} // namespace
+
+auto get_vertexarray_size(const iqm_file& file, vertexarray_type type) -> std::size_t {
+    auto desc = find_vertexarray(file, type);
+
+    if (!desc) {
+        return 0;
+    }
+
+    auto elem_size = desc->format == IQM_FLOAT ? sizeof(float) : sizeof(std::uint8_t);
+
+    return std::size_t(file.get_header().num_vertexes) * get_decoded_components(type, *desc) * elem_size;
+}
+
+auto get_vertexarray_components(const iqm_file& file, vertexarray_type type) -> std::uint32_t {
+    auto desc = find_vertexarray(file, type);
+    return desc ? get_decoded_components(type, *desc) : 0;
+}
+
+void decode_vertexarray(const iqm_file& file, vertexarray_type type, void* dst) {
+    decode_vertexarray(file, type, 0, file.get_header().num_vertexes, dst);
+}
+
+void decode_vertexarray(
+    const iqm_file& file, vertexarray_type type, std::size_t first_vertex, std::size_t num_vertices, void* dst) {
+    auto desc = find_vertexarray(file, type);
+
+    if (!desc) {
+        return;
+    }
+
+    if (std::uint64_t(first_vertex) + num_vertices > file.get_header().num_vertexes) {
+        throw std::runtime_error("ERROR: " + file.get_filename() + ": Vertex range is out of range!");
+    }
+
+    auto elem_size = desc->format == IQM_FLOAT ? std::size_t{4} : std::size_t{1};
+    auto src = file.get_file().data() + desc->offset + first_vertex * desc->size * elem_size;
+
+    switch (type) {
+        case vertexarray_type::POSITION:
+        case vertexarray_type::NORMAL:
+        case vertexarray_type::TANGENT: {
+            // Extra components (such as the tangent's bitangent sign) are dropped.
+            auto fdst = static_cast<float*>(dst);
+            if (desc->size == 3) {
+                read_le_array(src, fdst, num_vertices * 3);
+            } else {
+                for (auto v = std::size_t{0}; v < num_vertices; ++v) {
+                    read_le_array(src + v * desc->size * 4, fdst + v * 3, 3);
+                }
+            }
+            if (orient90X) {
+                orient_vec3_array(fdst, num_vertices);
+            }
+            break;
+        }
+        case vertexarray_type::TEXCOORD:
+            read_le_array(src, static_cast<float*>(dst), num_vertices * desc->size);
+            break;
+        case vertexarray_type::BLENDINDEXES:
+        case vertexarray_type::BLENDWEIGHTS:
+        case vertexarray_type::COLOR:
+            read_le_array(src, static_cast<std::uint8_t*>(dst), num_vertices * desc->size);
+            break;
+    }
+}
+
+auto decode_meshes(const iqm_file& file) -> std::vector<mesh> {
+    const auto& h = file.get_header();
+    auto base = file.get_file().data();
+
+    std::vector<mesh> rv;
+    rv.reserve(h.num_meshes);
+
+    for (auto i = 0u; i < h.num_meshes; ++i) {
+        std::uint32_t fields[6];
+        read_le_array(base + h.ofs_meshes + i * mesh_size, fields, 6);
+
+        mesh m;
+        m.name = get_name(file, fields[0]);
+        m.material = get_name(file, fields[1]);
+        m.first_vertex = fields[2];
+        m.num_vertexes = fields[3];
+        m.first_triangle = fields[4];
+        m.num_triangles = fields[5];
+
+        if (std::uint64_t(m.first_vertex) + m.num_vertexes > h.num_vertexes ||
+            std::uint64_t(m.first_triangle) + m.num_triangles > h.num_triangles) {
+            throw std::runtime_error("ERROR: " + file.get_filename() + ": Mesh \"" + m.name + "\" is out of range!");
+        }
+
+        rv.push_back(std::move(m));
+    }
+
+    return rv;
+}
+
+void decode_triangles(const iqm_file& file, std::uint32_t first, std::uint32_t count, triangle* dst) {
+    static_assert(sizeof(triangle) == triangle_size, "triangle must be tightly packed");
+
+    const auto& h = file.get_header();
+
+    if (std::uint64_t(first) + count > h.num_triangles) {
+        throw std::runtime_error("ERROR: " + file.get_filename() + ": Triangle range is out of range!");
+    }
+
+    read_le_array(
+        file.get_file().data() + h.ofs_triangles + std::size_t(first) * triangle_size,
+        reinterpret_cast<int*>(dst),
+        std::size_t(count) * 3);
+}
+
+auto open_iqm(const std::string& fname) -> std::optional<iqm_file> try {
+    auto file = map_file(fname);
+
+    if (!file) {
+        std::cerr << "sushi::iqm::open_iqm: Could not open file \"" << fname << "\".\n";
+        return std::nullopt;
+    }
+
+    iqm_file rv;
+    rv.hdr = read_header(*file, fname);
+    rv.fname = fname;
+    rv.file = std::move(*file);
+
+    return rv;
+} catch (const std::exception& e) {
+    std::cerr << "ERROR: sushi::iqm::open_iqm: " << e.what() << "\n";
+    return std::nullopt;
+}
+
+std::optional<iqm_data> load_iqm(const iqm_file& file, const load_options& options) try {
+    iqm_data rv;
+    rv.num_framechannels = 0;
+
+    if (options.geometry) {
+        decode_geometry(file, rv);
+    }
+
+    if (options.skeleton || options.animations) {
+        decode_skeleton(file, rv);
+    }
+
+    if (options.animations || options.bounds) {
+        auto anims = select_anims(file, options);
+
+        if (options.animations) {
+            decode_animations(file, options, anims, rv);
+        }
+
+        if (options.bounds) {
+            decode_bounds(file, options, anims, rv);
         }
-        b.xyradius = next_float();
-        b.radius = next_float();
-        rv.bounds.push_back(std::move(b));
     }
 
     // ignore extensions
@@ -308,6 +563,16 @@ std::optional<iqm_data> load_iqm(const std::string& fname) try {
     return std::nullopt;
 }
 
+std::optional<iqm_data> load_iqm(const std::string& fname) {
+    auto file = open_iqm(fname);
+
+    if (!file) {
+        return std::nullopt;
+    }
+
+    return load_iqm(*file, load_options{});
+}
+
 
 } // namespace iqm
 } // namespace sushi
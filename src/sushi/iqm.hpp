@@ -7,6 +7,7 @@
 
 #include "common.hpp"
 #include "gl.hpp"
+#include "mapped_file.hpp"
 
 #include <string>
 #include <bitset>
@@ -81,6 +82,127 @@ struct iqm_data {
     std::vector<bound> bounds;
 };
 
+/// The raw IQM file header.
+struct header {
+    std::uint32_t version;
+    std::uint32_t filesize;
+    std::uint32_t flags;
+    std::uint32_t num_text, ofs_text;
+    std::uint32_t num_meshes, ofs_meshes;
+    std::uint32_t num_vertexarrays, num_vertexes, ofs_vertexarrays;
+    std::uint32_t num_triangles, ofs_triangles, ofs_adjacency;
+    std::uint32_t num_joints, ofs_joints;
+    std::uint32_t num_poses, ofs_poses;
+    std::uint32_t num_anims, ofs_anims;
+    std::uint32_t num_frames, num_framechannels, ofs_frames, ofs_bounds;
+    std::uint32_t num_comment, ofs_comment;
+    std::uint32_t num_extensions, ofs_extensions;
+};
+
+/// An opened IQM file.
+/// Opening a file only reads and validates its header, sections are decoded on demand by `load_iqm`.
+/// Since the file is memory-mapped, sections which are never decoded are never read from disk.
+class iqm_file {
+public:
+    auto get_filename() const -> const std::string& { return fname; }
+    auto get_header() const -> const header& { return hdr; }
+    auto get_file() const -> const mapped_file& { return file; }
+
+    friend auto open_iqm(const std::string& fname) -> std::optional<iqm_file>;
+
+private:
+    std::string fname;
+    mapped_file file;
+    header hdr;
+};
+
+/// Selects which sections of an IQM file are decoded.
+/// Sections which are not selected are left empty in the resulting `iqm_data`.
+struct load_options {
+    /// Meshes, vertex arrays, and triangles.
+    bool geometry = true;
+
+    /// Joints and poses.
+    bool skeleton = true;
+
+    /// Animations and their frames. Implies `skeleton`, since frames cannot be decoded without poses.
+    bool animations = true;
+
+    /// If not empty, only the named animations (and their frames) are decoded.
+    std::vector<std::string> animation_names;
+
+    /// Per-frame bounds. Follows the same frame selection as `animations`.
+    bool bounds = true;
+};
+
+/// Vertex array types, as defined by the IQM format.
+enum class vertexarray_type : std::uint32_t {
+    POSITION = 0,
+    TEXCOORD = 1,
+    NORMAL = 2,
+    TANGENT = 3,
+    BLENDINDEXES = 4,
+    BLENDWEIGHTS = 5,
+    COLOR = 6,
+};
+
+/// Opens an IQM file, reading only its header.
+/// See http://sauerbraten.org/iqm/ for details.
+/// \param fname Name of file.
+/// \return The opened file, or nothing if the file cannot be opened or has an invalid header.
+auto open_iqm(const std::string& fname) -> std::optional<iqm_file>;
+
+/// Decodes the selected sections of an opened IQM file.
+/// \param file The opened file.
+/// \param options Sections to decode.
+/// \return IQM data.
+std::optional<iqm_data> load_iqm(const iqm_file& file, const load_options& options);
+
+/// Gets the size, in bytes, of a decoded vertex array.
+/// \param file The opened file.
+/// \param type The vertex array.
+/// \return Size of the decoded array, or 0 if the file does not contain it.
+/// \throws std::runtime_error if the array is malformed.
+auto get_vertexarray_size(const iqm_file& file, vertexarray_type type) -> std::size_t;
+
+/// Gets the number of components per vertex in a decoded vertex array.
+/// \param file The opened file.
+/// \param type The vertex array.
+/// \return Number of components, or 0 if the file does not contain the array.
+/// \throws std::runtime_error if the array is malformed.
+auto get_vertexarray_components(const iqm_file& file, vertexarray_type type) -> std::uint32_t;
+
+/// Decodes a vertex array directly into caller-provided memory, with the same layout as `iqm_data::vertexarrays`.
+/// \param file The opened file.
+/// \param type The vertex array.
+/// \param dst Destination, must have room for `get_vertexarray_size(file, type)` bytes.
+/// \throws std::runtime_error if the array is malformed.
+void decode_vertexarray(const iqm_file& file, vertexarray_type type, void* dst);
+
+/// Decodes part of a vertex array directly into caller-provided memory, with the same layout as `iqm_data::vertexarrays`.
+/// \param file The opened file.
+/// \param type The vertex array.
+/// \param first_vertex First vertex to decode.
+/// \param num_vertices Number of vertices to decode.
+/// \param dst Destination, must have room for `num_vertices` vertices.
+/// \throws std::runtime_error if the array is malformed, or the range is outside of it.
+void decode_vertexarray(
+    const iqm_file& file, vertexarray_type type, std::size_t first_vertex, std::size_t num_vertices, void* dst);
+
+/// Decodes the mesh table of an opened IQM file.
+/// \param file The opened file.
+/// \return The meshes.
+/// \throws std::runtime_error if a mesh is malformed.
+auto decode_meshes(const iqm_file& file) -> std::vector<mesh>;
+
+/// Decodes a range of triangles directly into caller-provided memory.
+/// \param file The opened file.
+/// \param first Index of the first triangle.
+/// \param count Number of triangles.
+/// \param dst Destination, must have room for `count` triangles.
+/// \throws std::runtime_error if the range is out of bounds.
+void decode_triangles(const iqm_file& file, std::uint32_t first, std::uint32_t count, triangle* dst);
+
 /// Loads an IQM file.
 /// See http://sauerbraten.org/iqm/ for details.
 /// \param fname Name of file.
@@ -0,0 +1,169 @@
+#include "mapped_file.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <utility>
+
+#if defined(_WIN32)
+#define SUSHI_MAPPED_FILE_WIN32 1
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif !defined(__EMSCRIPTEN__)
+#define SUSHI_MAPPED_FILE_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sushi {
+
+mapped_file::mapped_file(mapped_file&& other) noexcept :
+    ptr(std::exchange(other.ptr, nullptr)),
+    len(std::exchange(other.len, 0)),
+    is_mapped(std::exchange(other.is_mapped, false)),
+    buffer(std::move(other.buffer))
+{}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+    if (this != &other) {
+        release();
+        ptr = std::exchange(other.ptr, nullptr);
+        len = std::exchange(other.len, 0);
+        is_mapped = std::exchange(other.is_mapped, false);
+        buffer = std::move(other.buffer);
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file() {
+    release();
+}
+
+void mapped_file::release() noexcept {
+    if (is_mapped && ptr) {
+#if defined(SUSHI_MAPPED_FILE_WIN32)
+        UnmapViewOfFile(ptr);
+#elif defined(SUSHI_MAPPED_FILE_POSIX)
+        munmap(const_cast<unsigned char*>(ptr), len);
+#endif
+    }
+    ptr = nullptr;
+    len = 0;
+    is_mapped = false;
+    buffer.clear();
+}
+
+auto map_file(const std::string& fname) -> std::optional<mapped_file> {
+    mapped_file rv;
+
+    [[maybe_unused]] auto read_whole_file = [&]() -> std::optional<mapped_file> {
+        std::unique_ptr<std::FILE,int(*)(std::FILE*)> file (std::fopen(fname.c_str(), "rb"), &std::fclose);
+
+        if (!file) {
+            return std::nullopt;
+        }
+
+        if (std::fseek(file.get(), 0, SEEK_END) == 0) {
+            auto sz = std::ftell(file.get());
+            if (sz > 0) {
+                rv.buffer.resize(sz);
+            }
+            std::fseek(file.get(), 0, SEEK_SET);
+        }
+
+        if (!rv.buffer.empty() && std::fread(rv.buffer.data(), 1, rv.buffer.size(), file.get()) != rv.buffer.size()) {
+            return std::nullopt;
+        }
+
+        rv.ptr = rv.buffer.data();
+        rv.len = rv.buffer.size();
+
+        return std::move(rv);
+    };
+
+#if defined(SUSHI_MAPPED_FILE_WIN32)
+    auto file = CreateFileA(
+        fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return std::nullopt;
+    }
+
+    LARGE_INTEGER file_size;
+
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return std::nullopt;
+    }
+
+    if (file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return rv;
+    }
+
+    auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if (!mapping) {
+        return std::nullopt;
+    }
+
+    auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (!view) {
+        return std::nullopt;
+    }
+
+    rv.ptr = static_cast<const unsigned char*>(view);
+    rv.len = static_cast<std::size_t>(file_size.QuadPart);
+    rv.is_mapped = true;
+
+    return rv;
+#elif defined(SUSHI_MAPPED_FILE_POSIX)
+    auto fd = ::open(fname.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        return std::nullopt;
+    }
+
+    struct stat st;
+
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    if (st.st_size == 0) {
+        ::close(fd);
+        return rv;
+    }
+
+    auto addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (addr == MAP_FAILED) {
+        return read_whole_file();
+    }
+
+#ifdef POSIX_MADV_SEQUENTIAL
+    ::posix_madvise(addr, st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+
+    rv.ptr = static_cast<const unsigned char*>(addr);
+    rv.len = static_cast<std::size_t>(st.st_size);
+    rv.is_mapped = true;
+
+    return rv;
+#else
+    return read_whole_file();
+#endif
+}
+
+} // namespace sushi
@@ -0,0 +1,51 @@
+#ifndef SUSHI_MAPPED_FILE_HPP
+#define SUSHI_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+/// Sushi
+namespace sushi {
+
+/// A read-only view of the entire contents of a file.
+/// The file is memory-mapped where the platform supports it, otherwise it is read into memory in one go.
+class mapped_file {
+public:
+    mapped_file() = default;
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    /// Pointer to the first byte of the file. May be null for empty files.
+    auto data() const -> const unsigned char* { return ptr; }
+
+    /// Size of the file in bytes.
+    auto size() const -> std::size_t { return len; }
+
+    /// Views the file as characters.
+    auto chars() const -> const char* { return reinterpret_cast<const char*>(ptr); }
+
+    friend auto map_file(const std::string& fname) -> std::optional<mapped_file>;
+
+private:
+    void release() noexcept;
+
+    const unsigned char* ptr = nullptr;
+    std::size_t len = 0;
+    bool is_mapped = false;
+    std::vector<unsigned char> buffer;
+};
+
+/// Maps an entire file into memory for reading.
+/// \param fname File name.
+/// \return The mapped file, or nothing if the file cannot be opened.
+auto map_file(const std::string& fname) -> std::optional<mapped_file>;
+
+} // namespace sushi
+
+#endif // SUSHI_MAPPED_FILE_HPP
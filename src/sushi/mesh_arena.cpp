@@ -0,0 +1,409 @@
+#include "mesh_arena.hpp"
+
+#include "mesh_utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace sushi {
+
+namespace {
+
+/// Whether attribute formats can be specified separately from the buffers they read from.
+auto has_attrib_binding() -> bool {
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    return GLAD_GL_ARB_vertex_attrib_binding != 0;
+#endif
+}
+
+} // namespace
+
+arena_mesh_group::arena_mesh_group(arena_mesh_group&& other) noexcept {
+    *this = std::move(other);
+}
+
+auto arena_mesh_group::operator=(arena_mesh_group&& other) noexcept -> arena_mesh_group& {
+    if (this != &other) {
+        if (arena) {
+            arena->free(*this);
+        }
+
+        options = other.options;
+        meshes = std::move(other.meshes);
+        bounds = other.bounds;
+        index_type = other.index_type;
+        arena = other.arena;
+        format = other.format;
+        vertex_page = other.vertex_page;
+        vertex_range = other.vertex_range;
+        index_page = other.index_page;
+        index_range = other.index_range;
+
+        other.arena = nullptr;
+    }
+
+    return *this;
+}
+
+arena_mesh_group::~arena_mesh_group() {
+    if (arena) {
+        arena->free(*this);
+    }
+}
+
+auto mesh_arena::format_key::operator==(const format_key& other) const -> bool {
+    if (stride != other.stride || offsets != other.offsets) {
+        return false;
+    }
+
+    for (auto i = 0; i < 7; ++i) {
+        const auto& a = attribs[i];
+        const auto& b = other.attribs[i];
+
+        if (bool(a.data) != bool(b.data)) {
+            return false;
+        }
+
+        if (a.data && (a.size != b.size || a.type != b.type || a.normalize != b.normalize)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+mesh_arena::mesh_arena(const mesh_arena_options& options) : options(options) {}
+
+auto mesh_arena::get_format(const _detail::vertex_encoding& encoding) -> std::size_t {
+    format_key key;
+    key.offsets = encoding.interleaved.offsets;
+    key.stride = encoding.interleaved.stride;
+
+    for (auto i = 0; i < 7; ++i) {
+        key.attribs[i] = {static_cast<attrib_location>(i), 4, GL_FLOAT, GL_FALSE, {0, 0, 0, 0}, nullptr};
+    }
+
+    for (const auto& attr : encoding.get_attribs()) {
+        key.attribs[static_cast<GLuint>(attr.loc)] = attr;
+    }
+
+    for (auto i = std::size_t{0}; i < formats.size(); ++i) {
+        if (formats[i].key == key) {
+            return i;
+        }
+    }
+
+    auto& pool = formats.emplace_back();
+    pool.key = key;
+    pool.vao = make_unique_vertex_array();
+
+    glBindVertexArray(pool.vao.get());
+
+    for (const auto& attr : key.attribs) {
+        if (attr.data) {
+            auto loc = static_cast<GLuint>(attr.loc);
+            glEnableVertexAttribArray(loc);
+
+#ifndef __EMSCRIPTEN__
+            // Otherwise, attributes are specified whenever a page is bound.
+            if (has_attrib_binding()) {
+                glVertexAttribFormat(loc, attr.size, attr.type, attr.normalize, GLuint(key.offsets[loc]));
+                glVertexAttribBinding(loc, 0);
+            }
+#endif
+        }
+    }
+
+    return formats.size() - 1;
+}
+
+auto mesh_arena::allocate_range(
+    std::vector<page>& pages,
+    std::size_t units,
+    std::size_t page_units,
+    std::size_t unit_size,
+    GLenum target) -> page_range {
+
+    for (auto i = std::size_t{0}; i < pages.size(); ++i) {
+        if (auto range = pages[i].allocator.allocate(units)) {
+            return {i, *range};
+        }
+    }
+
+    // Groups larger than a page get a page of their own.
+    auto capacity = std::max(units, page_units);
+
+    page new_page;
+    new_page.buffer = make_unique_buffer();
+    new_page.allocator = range_allocator(capacity);
+
+    glBindBuffer(target, new_page.buffer.get());
+    glBufferData(target, capacity * unit_size, nullptr, GL_STATIC_DRAW);
+
+    pages.push_back(std::move(new_page));
+
+    return {pages.size() - 1, *pages.back().allocator.allocate(units)};
+}
+
+auto mesh_arena::allocate(const mesh_blob& blob) -> arena_mesh_group {
+    const auto& encoding = blob.format;
+    const auto stride = std::size_t(encoding.interleaved.stride);
+
+    arena_mesh_group group;
+    group.options = blob.options;
+    group.options.layout = vertex_layout::INTERLEAVED;
+    group.meshes = blob.meshes;
+    group.bounds = blob.bounds;
+
+    if (stride == 0) {
+        std::cerr << "mesh_arena: Meshes have no vertex attributes.\n";
+        return group;
+    }
+
+    // Separate attribute arrays are interleaved, using the layout the encoding already describes.
+    auto interleaved = std::vector<unsigned char>();
+    auto vertex_data = blob.vertex_data.data();
+    auto num_vertices = blob.vertex_data.size() / stride;
+
+    if (blob.options.layout == vertex_layout::SEPARATE) {
+        num_vertices = 0;
+
+        for (auto i = std::size_t{0}; i < encoding.num_attribs; ++i) {
+            if (encoding.attribs[i].data) {
+                num_vertices = blob.attrib_data[i].size() / _detail::get_attrib_size(encoding.attribs[i]);
+                break;
+            }
+        }
+
+        interleaved.resize(num_vertices * stride);
+
+        for (auto i = std::size_t{0}; i < encoding.num_attribs; ++i) {
+            const auto& attr = encoding.attribs[i];
+
+            if (attr.data) {
+                auto size = _detail::get_attrib_size(attr);
+                auto dst = interleaved.data() + encoding.interleaved.offsets[static_cast<GLuint>(attr.loc)];
+
+                for (auto v = std::size_t{0}; v < num_vertices; ++v) {
+                    std::memcpy(dst + v * stride, blob.attrib_data[i].data() + v * size, size);
+                }
+            }
+        }
+
+        vertex_data = interleaved.data();
+    }
+
+    // Without base-vertex draws, indices must be rebased onto the page, which can overflow 16 bits.
+    auto rebased = std::vector<GLuint>();
+    auto index_data = blob.index_data.data();
+    auto index_bytes = blob.index_data.size();
+
+    group.index_type = blob.index_type;
+
+    auto format = get_format(encoding);
+    auto& pool = formats[format];
+
+    glBindVertexArray(pool.vao.get());
+    SUSHI_DEFER { unbind(); };
+
+    group.arena = this;
+    group.format = format;
+
+    ++num_groups;
+
+    if (num_vertices > 0) {
+        auto [vertex_page, vertex_range] = allocate_range(
+            pool.pages, num_vertices, options.vertex_page_size / stride, stride, GL_ARRAY_BUFFER);
+
+        glBindBuffer(GL_ARRAY_BUFFER, pool.pages[vertex_page].buffer.get());
+        glBufferSubData(GL_ARRAY_BUFFER, vertex_range.offset * stride, num_vertices * stride, vertex_data);
+
+        group.vertex_page = vertex_page;
+        group.vertex_range = vertex_range;
+    }
+
+    auto first_vertex = group.vertex_range.offset;
+
+    if (!_detail::use_base_vertex && first_vertex > 0) {
+        auto index_size = _detail::get_type_size(blob.index_type);
+        rebased.resize(index_bytes / index_size);
+
+        for (auto i = std::size_t{0}; i < rebased.size(); ++i) {
+            if (blob.index_type == GL_UNSIGNED_SHORT) {
+                GLushort idx;
+                std::memcpy(&idx, index_data + i * index_size, sizeof(idx));
+                rebased[i] = idx + GLuint(first_vertex);
+            } else {
+                GLuint idx;
+                std::memcpy(&idx, index_data + i * index_size, sizeof(idx));
+                rebased[i] = idx + GLuint(first_vertex);
+            }
+        }
+
+        index_data = reinterpret_cast<const unsigned char*>(rebased.data());
+        index_bytes = rebased.size() * sizeof(GLuint);
+        group.index_type = GL_UNSIGNED_INT;
+    }
+
+    auto index_offset = std::size_t{0};
+
+    // Index ranges are allocated in 4-byte units, which keeps every range aligned for either index type.
+    if (index_bytes > 0) {
+        auto [index_page, index_range] = allocate_range(
+            index_pages, (index_bytes + 3) / 4, options.index_page_size / 4, 4, GL_ELEMENT_ARRAY_BUFFER);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_pages[index_page].buffer.get());
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, index_range.offset * 4, index_bytes, index_data);
+        pool.bound_index_page = index_page;
+
+        group.index_page = index_page;
+        group.index_range = index_range;
+
+        index_offset = index_range.offset * 4 / _detail::get_type_size(group.index_type);
+    }
+
+    for (auto& mesh : group.meshes) {
+        mesh.first_index += GLsizei(index_offset);
+
+        if (_detail::use_base_vertex) {
+            mesh.base_vertex += GLint(first_vertex);
+        }
+
+        for (auto& lod : mesh.lods) {
+            lod.first_index += GLsizei(index_offset);
+        }
+    }
+
+    return group;
+}
+
+void mesh_arena::free(arena_mesh_group& group) {
+    if (group.vertex_page != arena_mesh_group::no_page) {
+        formats[group.format].pages[group.vertex_page].allocator.free(group.vertex_range);
+    }
+
+    if (group.index_page != arena_mesh_group::no_page) {
+        index_pages[group.index_page].allocator.free(group.index_range);
+    }
+
+    group.arena = nullptr;
+
+    --num_groups;
+}
+
+void mesh_arena::bind(const arena_mesh_group& group) {
+    auto& pool = formats[group.format];
+    const auto& key = pool.key;
+
+    // Other code may have bound another VAO or changed constant attributes since the last draw,
+    // so both are always set. Pages are only bound when they differ, since they're state of the arena's own VAO.
+    glBindVertexArray(pool.vao.get());
+
+    for (const auto& attr : key.attribs) {
+        if (!attr.data) {
+            glVertexAttrib4fv(static_cast<GLuint>(attr.loc), attr.init.data());
+        }
+    }
+
+    if (group.vertex_page != arena_mesh_group::no_page && pool.bound_vertex_page != group.vertex_page) {
+        const auto& buffer = pool.pages[group.vertex_page].buffer;
+
+#ifndef __EMSCRIPTEN__
+        if (has_attrib_binding()) {
+            glBindVertexBuffer(0, buffer.get(), 0, key.stride);
+        } else
+#endif
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer.get());
+
+            for (const auto& attr : key.attribs) {
+                if (attr.data) {
+                    auto loc = static_cast<GLuint>(attr.loc);
+                    auto offset = reinterpret_cast<const void*>(key.offsets[loc]);
+                    glVertexAttribPointer(loc, attr.size, attr.type, attr.normalize, key.stride, offset);
+                }
+            }
+        }
+
+        pool.bound_vertex_page = group.vertex_page;
+    }
+
+    if (group.index_page != arena_mesh_group::no_page && pool.bound_index_page != group.index_page) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_pages[group.index_page].buffer.get());
+        pool.bound_index_page = group.index_page;
+    }
+}
+
+void mesh_arena::unbind() {
+    glBindVertexArray(0);
+}
+
+auto mesh_arena::get_stats() const -> mesh_arena_stats {
+    mesh_arena_stats stats;
+    stats.num_formats = formats.size();
+    stats.num_index_pages = index_pages.size();
+    stats.num_groups = num_groups;
+
+    for (const auto& pool : formats) {
+        stats.num_vertex_pages += pool.pages.size();
+
+        for (const auto& p : pool.pages) {
+            stats.bytes_reserved += p.allocator.get_capacity() * pool.key.stride;
+            stats.bytes_used += p.allocator.get_used() * pool.key.stride;
+        }
+    }
+
+    for (const auto& p : index_pages) {
+        stats.bytes_reserved += p.allocator.get_capacity() * 4;
+        stats.bytes_used += p.allocator.get_used() * 4;
+    }
+
+    return stats;
+}
+
+namespace {
+
+void set_draw_uniforms(const arena_mesh_group& group) {
+    GLint program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+    auto animated_uniform = glGetUniformLocation(program, "Animated");
+    auto octahedral_uniform = glGetUniformLocation(program, "OctahedralNormals");
+
+    glUniform1i(animated_uniform, 0);
+    glUniform1i(octahedral_uniform, group.options.octahedral_normals);
+    _detail::set_bone_palette_unit(program);
+}
+
+} // namespace
+
+void draw_mesh(const arena_mesh_group& group) {
+    if (!group.get_arena()) {
+        return;
+    }
+
+    set_draw_uniforms(group);
+    group.get_arena()->bind(group);
+
+    for (const auto& mesh : group.meshes) {
+        _detail::draw_elements(group.index_type, mesh);
+    }
+}
+
+void draw_mesh(const arena_mesh_group& group, float lod_scale, float max_pixel_error) {
+    if (!group.get_arena()) {
+        return;
+    }
+
+    set_draw_uniforms(group);
+    group.get_arena()->bind(group);
+
+    for (const auto& mesh : group.meshes) {
+        _detail::draw_elements(group.index_type, mesh, select_lod(mesh, lod_scale, max_pixel_error));
+    }
+}
+
+} // namespace sushi
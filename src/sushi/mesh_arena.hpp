@@ -0,0 +1,148 @@
+#ifndef SUSHI_MESH_ARENA_HPP
+#define SUSHI_MESH_ARENA_HPP
+
+#include "gl.hpp"
+#include "mesh_group.hpp"
+#include "range_allocator.hpp"
+#include "vertex_encoding.hpp"
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+/// Sushi
+namespace sushi {
+
+class mesh_arena;
+
+/// Meshes whose vertices and indices are sub-allocated from a mesh_arena.
+/// Their ranges are freed back into the arena on destruction, so the arena must outlive them.
+class arena_mesh_group {
+public:
+    arena_mesh_group() = default;
+    arena_mesh_group(arena_mesh_group&& other) noexcept;
+    auto operator=(arena_mesh_group&& other) noexcept -> arena_mesh_group&;
+    ~arena_mesh_group();
+
+    mesh_options options;
+    std::vector<mesh_group::mesh> meshes; /** Index ranges and base vertices are relative to the arena's pages. */
+    mesh_bounds bounds;
+    GLenum index_type = GL_UNSIGNED_INT;
+
+    /// Gets the arena holding this group, or null if it holds nothing.
+    auto get_arena() const -> mesh_arena* { return arena; }
+
+private:
+    friend class mesh_arena;
+
+    static constexpr std::size_t no_page = ~std::size_t{0};
+
+    mesh_arena* arena = nullptr;
+    std::size_t format = 0;
+    std::size_t vertex_page = no_page;
+    range_allocator::allocation vertex_range;
+    std::size_t index_page = no_page;
+    range_allocator::allocation index_range;
+};
+
+/// Options for a mesh_arena.
+struct mesh_arena_options {
+    std::size_t vertex_page_size = 16 << 20; /** Size of each vertex buffer page, in bytes. */
+    std::size_t index_page_size = 4 << 20; /** Size of each index buffer page, in bytes. */
+};
+
+/// Memory usage of a mesh_arena.
+struct mesh_arena_stats {
+    std::size_t num_formats = 0;
+    std::size_t num_vertex_pages = 0;
+    std::size_t num_index_pages = 0;
+    std::size_t num_groups = 0;
+    std::size_t bytes_reserved = 0; /** Total size of every page. */
+    std::size_t bytes_used = 0; /** Total size of every allocated range. */
+};
+
+/// Stores the vertices and indices of many mesh groups in a few large buffers.
+/// Vertices are grouped by format, and each format has a single VAO shared by every group in that format,
+/// so drawing many groups only rebinds buffers when they live in different pages.
+/// Where `ARB_vertex_attrib_binding` is available, switching pages doesn't respecify any attributes.
+/// Ranges within pages are handed out by a range_allocator.
+class mesh_arena {
+public:
+    /// Constructs an empty arena. No GL objects are created until the first allocation.
+    explicit mesh_arena(const mesh_arena_options& options = {});
+
+    mesh_arena(const mesh_arena&) = delete;
+    mesh_arena& operator=(const mesh_arena&) = delete;
+
+    /// Copies baked meshes into the arena. Must be called on the GL context's thread.
+    /// Vertices are always stored interleaved, regardless of the blob's layout.
+    /// \param blob The baked meshes, from e.g. `mesh_group_builder::bake` or `bake_meshes`.
+    /// \return The meshes, which can be drawn with `draw_mesh`.
+    auto allocate(const mesh_blob& blob) -> arena_mesh_group;
+
+    /// Binds the VAO and pages a group is drawn from, skipping pages already bound in the VAO.
+    /// `draw_mesh` calls this, and leaves the arena bound afterwards.
+    void bind(const arena_mesh_group& group);
+
+    /// Unbinds the arena's VAO, so that later GL calls can't change it by accident.
+    void unbind();
+
+    auto get_stats() const -> mesh_arena_stats;
+
+private:
+    friend class arena_mesh_group;
+
+    static constexpr std::size_t none = ~std::size_t{0};
+
+    struct page {
+        unique_buffer buffer;
+        range_allocator allocator;
+    };
+
+    /// Layout of each attribute location, which identifies a vertex format.
+    struct format_key {
+        std::array<_detail::attrib_source, 7> attribs; /** Indexed by attrib_location, with null `data` if not present. */
+        std::array<std::size_t, 7> offsets;
+        GLsizei stride;
+
+        auto operator==(const format_key& other) const -> bool;
+    };
+
+    struct format_pool {
+        format_key key;
+        unique_vertex_array vao;
+        std::vector<page> pages;
+        std::size_t bound_vertex_page = none; /** Vertex page bound in the VAO. */
+        std::size_t bound_index_page = none; /** Index page bound in the VAO. */
+    };
+
+    struct page_range {
+        std::size_t page;
+        range_allocator::allocation range;
+    };
+
+    void free(arena_mesh_group& group);
+    auto get_format(const _detail::vertex_encoding& encoding) -> std::size_t;
+    auto allocate_range(std::vector<page>& pages, std::size_t units, std::size_t page_units, std::size_t unit_size, GLenum target)
+        -> page_range;
+
+    mesh_arena_options options;
+    std::vector<format_pool> formats;
+    std::vector<page> index_pages;
+    std::size_t num_groups = 0;
+};
+
+/// Draws every mesh of an arena group. The arena stays bound afterwards, see `mesh_arena::unbind`.
+/// \param group The meshes to draw.
+void draw_mesh(const arena_mesh_group& group);
+
+/// Draws every mesh of an arena group, selecting levels of detail as in `draw_mesh(const mesh_group&, float, float)`.
+/// The arena stays bound afterwards, see `mesh_arena::unbind`.
+/// \param group The meshes to draw.
+/// \param lod_scale Pixels per model unit, from `get_lod_scale`.
+/// \param max_pixel_error Largest screen-space error allowed, in pixels.
+void draw_mesh(const arena_mesh_group& group, float lod_scale, float max_pixel_error = 1);
+
+} // namespace sushi
+
+#endif // SUSHI_MESH_ARENA_HPP
@@ -3,7 +3,9 @@
 #include "mesh_utils.hpp"
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <type_traits>
 
 namespace sushi {
 
@@ -52,7 +54,76 @@ auto mesh_group_builder::vertex_builder::color(const glm::vec4& vec) -> vertex_b
     return *this;
 }
 
-mesh_group_builder::mesh_group_builder() : num_vertices(0), enabled_arrs(0) {}
+mesh_group_builder::vertex_range_builder::vertex_range_builder(mesh_group_builder& mgb, GLuint first, std::size_t count)
+    : mgb(&mgb), first(first), count(count) {}
+
+auto mesh_group_builder::vertex_range_builder::get_count(std::size_t size) const -> std::size_t {
+    if (size != count) {
+        std::cerr << "mesh_group_builder: Expected " << count << " attribute values, got " << size << ".\n";
+    }
+
+    return std::min(size, count);
+}
+
+namespace {
+
+/// Copies whole glm vectors into a flat array of their components.
+template <typename Vec, typename T>
+void copy_vecs(span<const Vec> vecs, std::size_t count, std::vector<T>& arr, std::size_t first) {
+    using component = std::remove_cv_t<std::remove_reference_t<decltype(std::declval<const Vec&>()[0])>>;
+    static_assert(std::is_same_v<component, T>, "Vector components must match the array");
+    constexpr auto n = sizeof(Vec) / sizeof(T);
+    std::memcpy(arr.data() + first * n, vecs.data(), count * sizeof(Vec));
+}
+
+/// Narrows integer vectors into a flat array of bytes.
+void copy_ubyte_vecs(span<const glm::ivec4> vecs, std::size_t count, std::vector<GLubyte>& arr, std::size_t first) {
+    auto out = arr.data() + first * 4;
+    for (auto i = std::size_t{0}; i < count; ++i) {
+        for (auto c = 0; c < 4; ++c) {
+            out[i * 4 + c] = GLubyte(vecs[i][c]);
+        }
+    }
+}
+
+} // namespace
+
+auto mesh_group_builder::vertex_range_builder::positions(span<const glm::vec3> vecs) -> vertex_range_builder& {
+    copy_vecs(vecs, get_count(vecs.size()), mgb->position_arr, first);
+    return *this;
+}
+
+auto mesh_group_builder::vertex_range_builder::texcoords(span<const glm::vec2> vecs) -> vertex_range_builder& {
+    copy_vecs(vecs, get_count(vecs.size()), mgb->texcoord_arr, first);
+    return *this;
+}
+
+auto mesh_group_builder::vertex_range_builder::normals(span<const glm::vec3> vecs) -> vertex_range_builder& {
+    copy_vecs(vecs, get_count(vecs.size()), mgb->normal_arr, first);
+    return *this;
+}
+
+auto mesh_group_builder::vertex_range_builder::tangents(span<const glm::vec3> vecs) -> vertex_range_builder& {
+    copy_vecs(vecs, get_count(vecs.size()), mgb->tangent_arr, first);
+    return *this;
+}
+
+auto mesh_group_builder::vertex_range_builder::blendindices(span<const glm::ivec4> vecs) -> vertex_range_builder& {
+    copy_ubyte_vecs(vecs, get_count(vecs.size()), mgb->blendindices_arr, first);
+    return *this;
+}
+
+auto mesh_group_builder::vertex_range_builder::blendweights(span<const glm::ivec4> vecs) -> vertex_range_builder& {
+    copy_ubyte_vecs(vecs, get_count(vecs.size()), mgb->blendweights_arr, first);
+    return *this;
+}
+
+auto mesh_group_builder::vertex_range_builder::colors(span<const glm::vec4> vecs) -> vertex_range_builder& {
+    copy_vecs(vecs, get_count(vecs.size()), mgb->color_arr, first);
+    return *this;
+}
+
+mesh_group_builder::mesh_group_builder() : num_vertices(0), reserved_indices(0), enabled_arrs(0) {}
 
 void mesh_group_builder::enable(attrib_location loc) {
     if (!meshes.empty()) {
@@ -78,84 +149,224 @@ void mesh_group_builder::mesh(std::string name) {
     }
 
     meshes.push_back({ std::move(name), {} });
+    meshes.back().elements.reserve(reserved_indices);
+    reserved_indices = 0;
 }
 
-auto mesh_group_builder::vertex() -> vertex_builder {
-    for (int i = 0; i < 7; ++i) {
-        auto loc = static_cast<attrib_location>(i);
-        if (enabled_arrs[loc]) {
-            switch (loc) {
-                case attrib_location::POSITION: position_arr.insert(end(position_arr), { 0, 0, 0 }); break;
-                case attrib_location::TEXCOORD: texcoord_arr.insert(end(texcoord_arr), { 0, 0 }); break;
-                case attrib_location::NORMAL: normal_arr.insert(end(normal_arr), { 0, 0, 0 }); break;
-                case attrib_location::TANGENT: tangent_arr.insert(end(tangent_arr), { 0, 0, 0 }); break;
-                case attrib_location::BLENDINDICES: blendindices_arr.insert(end(blendindices_arr), { 0, 0, 0, 0 }); break;
-                case attrib_location::BLENDWEIGHTS: blendweights_arr.insert(end(blendweights_arr), { 0, 0, 0, 0 }); break;
-                case attrib_location::COLOR: color_arr.insert(end(color_arr), { 1, 1, 1, 1 }); break;
-            }
-        }
+void mesh_group_builder::reserve(std::size_t vertices, std::size_t indices) {
+    if (enabled_arrs[attrib_location::POSITION]) position_arr.reserve(vertices * 3);
+    if (enabled_arrs[attrib_location::TEXCOORD]) texcoord_arr.reserve(vertices * 2);
+    if (enabled_arrs[attrib_location::NORMAL]) normal_arr.reserve(vertices * 3);
+    if (enabled_arrs[attrib_location::TANGENT]) tangent_arr.reserve(vertices * 3);
+    if (enabled_arrs[attrib_location::BLENDINDICES]) blendindices_arr.reserve(vertices * 4);
+    if (enabled_arrs[attrib_location::BLENDWEIGHTS]) blendweights_arr.reserve(vertices * 4);
+    if (enabled_arrs[attrib_location::COLOR]) color_arr.reserve(vertices * 4);
+
+    if (meshes.empty()) {
+        reserved_indices = indices;
+    } else {
+        auto& elements = meshes.back().elements;
+        elements.reserve(elements.size() + indices);
     }
+}
 
-    auto vb = vertex_builder(*this, num_vertices);
+void mesh_group_builder::add_vertices(std::size_t count) {
+    auto total = num_vertices + count;
 
-    ++num_vertices;
+    if (enabled_arrs[attrib_location::POSITION]) position_arr.resize(total * 3, 0);
+    if (enabled_arrs[attrib_location::TEXCOORD]) texcoord_arr.resize(total * 2, 0);
+    if (enabled_arrs[attrib_location::NORMAL]) normal_arr.resize(total * 3, 0);
+    if (enabled_arrs[attrib_location::TANGENT]) tangent_arr.resize(total * 3, 0);
+    if (enabled_arrs[attrib_location::BLENDINDICES]) blendindices_arr.resize(total * 4, 0);
+    if (enabled_arrs[attrib_location::BLENDWEIGHTS]) blendweights_arr.resize(total * 4, 0);
+    if (enabled_arrs[attrib_location::COLOR]) color_arr.resize(total * 4, 1);
 
-    return vb;
+    num_vertices = total;
 }
 
-void mesh_group_builder::tri(GLuint a, GLuint b, GLuint c) {
+auto mesh_group_builder::current_mesh() -> mesh_data& {
     if (meshes.empty()) {
         meshes.push_back({});
+        meshes.back().elements.reserve(reserved_indices);
+        reserved_indices = 0;
     }
 
-    auto& elements = meshes.back().elements;
+    return meshes.back();
+}
+
+auto mesh_group_builder::vertex() -> vertex_builder {
+    auto vb = vertex_builder(*this, num_vertices);
+
+    add_vertices(1);
+
+    return vb;
+}
+
+auto mesh_group_builder::vertices(std::size_t count) -> vertex_range_builder {
+    auto vrb = vertex_range_builder(*this, num_vertices, count);
+
+    add_vertices(count);
+
+    return vrb;
+}
+
+void mesh_group_builder::tri(GLuint a, GLuint b, GLuint c) {
+    auto& elements = current_mesh().elements;
 
     elements.insert(end(elements), { a, b, c });
 }
 
-auto mesh_group_builder::get() const -> mesh_group {
-    using _detail::load_buffer;
-    using _detail::bind_attrib;
+void mesh_group_builder::tris(span<const GLuint> indices, GLuint base_vertex) {
+    if (indices.size() % 3 != 0) {
+        std::cerr << "mesh_group_builder: Index count " << indices.size() << " is not a multiple of 3.\n";
+    }
+
+    auto& elements = current_mesh().elements;
+    auto count = indices.size() / 3 * 3;
+    auto first = elements.size();
+
+    elements.insert(end(elements), indices.begin(), indices.begin() + count);
+
+    if (base_vertex != 0) {
+        for (auto i = first; i < elements.size(); ++i) {
+            elements[i] += base_vertex;
+        }
+    }
+}
+
+auto mesh_group_builder::get_all_elements() const -> std::vector<GLuint> {
+    auto all_elements = std::vector<GLuint>();
+
+    for (const auto& my_mesh : meshes) {
+        all_elements.insert(end(all_elements), begin(my_mesh.elements), end(my_mesh.elements));
+    }
+
+    return all_elements;
+}
+
+void mesh_group_builder::generate_normals(normal_weighting weighting, thread_pool& pool) {
+    if (!enabled_arrs[attrib_location::POSITION]) {
+        std::cerr << "mesh_group_builder: Generating normals requires positions.\n";
+        return;
+    }
+
+    if (!enabled_arrs[attrib_location::NORMAL]) {
+        normal_arr.resize(num_vertices * 3);
+        enabled_arrs[attrib_location::NORMAL] = 1;
+    }
+
+    auto positions = span<const glm::vec3>(reinterpret_cast<const glm::vec3*>(position_arr.data()), num_vertices);
+    auto normals = span<glm::vec3>(reinterpret_cast<glm::vec3*>(normal_arr.data()), num_vertices);
+
+    // A single mesh can be used in place, but triangles of every mesh contribute to shared vertices.
+    if (meshes.size() == 1) {
+        sushi::generate_normals(meshes[0].elements, positions, normals, weighting, pool);
+    } else {
+        auto all_elements = get_all_elements();
+        sushi::generate_normals(all_elements, positions, normals, weighting, pool);
+    }
+}
+
+void mesh_group_builder::generate_tangents(normal_weighting weighting, thread_pool& pool) {
+    if (!enabled_arrs[attrib_location::POSITION]
+        || !enabled_arrs[attrib_location::TEXCOORD]
+        || !enabled_arrs[attrib_location::NORMAL]) {
+        std::cerr << "mesh_group_builder: Generating tangents requires positions, texcoords, and normals.\n";
+        return;
+    }
+
+    if (!enabled_arrs[attrib_location::TANGENT]) {
+        tangent_arr.resize(num_vertices * 3);
+        enabled_arrs[attrib_location::TANGENT] = 1;
+    }
+
+    auto positions = span<const glm::vec3>(reinterpret_cast<const glm::vec3*>(position_arr.data()), num_vertices);
+    auto texcoords = span<const glm::vec2>(reinterpret_cast<const glm::vec2*>(texcoord_arr.data()), num_vertices);
+    auto normals = span<const glm::vec3>(reinterpret_cast<const glm::vec3*>(normal_arr.data()), num_vertices);
+    auto tangents = span<glm::vec3>(reinterpret_cast<glm::vec3*>(tangent_arr.data()), num_vertices);
+
+    if (meshes.size() == 1) {
+        sushi::generate_tangents(meshes[0].elements, positions, texcoords, normals, tangents, weighting, pool);
+    } else {
+        auto all_elements = get_all_elements();
+        sushi::generate_tangents(all_elements, positions, texcoords, normals, tangents, weighting, pool);
+    }
+}
+
+auto mesh_group_builder::optimize() -> mesh_optimization_report {
+    mesh_optimization_report report;
+
+    for (auto& my_mesh : meshes) {
+        auto indices = span<GLuint>(my_mesh.elements);
+
+        report.before += analyze_vertex_cache(indices, num_vertices);
+
+        optimize_vertex_cache(indices, num_vertices);
 
-    mesh_group group;
+        if (enabled_arrs[attrib_location::POSITION]) {
+            auto positions = reinterpret_cast<const glm::vec3*>(position_arr.data());
+            optimize_overdraw(indices, span<const glm::vec3>(positions, num_vertices));
+        }
+    }
+
+    // Meshes may share vertices, so every mesh is renumbered together, in mesh order.
+    auto all_indices = get_all_elements();
+
+    auto remap = optimize_vertex_fetch(span<GLuint>(all_indices), num_vertices);
+    auto remap_span = span<const GLuint>(remap);
 
-    group.position_buffer = load_buffer(position_arr);
-    group.texcoord_buffer = load_buffer(texcoord_arr);
-    group.normal_buffer = load_buffer(normal_arr);
-    group.tangent_buffer = load_buffer(tangent_arr);
-    group.blendindices_buffer = load_buffer(blendindices_arr);
-    group.blendweights_buffer = load_buffer(blendweights_arr);
-    group.color_buffer = load_buffer(color_arr);
+    auto next_index = begin(all_indices);
 
     for (auto& my_mesh : meshes) {
-        auto mesh = mesh_group::mesh{};
-        mesh.name = my_mesh.name;
-        mesh.num_tris = my_mesh.elements.size() / 3;
-        mesh.tris = make_unique_buffer();
-        mesh.vao = make_unique_vertex_array();
-
-        glBindVertexArray(mesh.vao.get());
-        SUSHI_DEFER { glBindVertexArray(0); };
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.tris.get());
-        glBufferData(
-            GL_ELEMENT_ARRAY_BUFFER,
-            my_mesh.elements.size() * sizeof(GLuint),
-            my_mesh.elements.data(),
-            GL_STATIC_DRAW);
-
-        bind_attrib(attrib_location::POSITION, group.position_buffer, 3, GL_FLOAT, false, 0, {});
-        bind_attrib(attrib_location::TEXCOORD, group.texcoord_buffer, 2, GL_FLOAT, false, 0, {});
-        bind_attrib(attrib_location::NORMAL, group.normal_buffer, 3, GL_FLOAT, false, 0, {});
-        bind_attrib(attrib_location::TANGENT, group.tangent_buffer, 3, GL_FLOAT, false, 0, {});
-        bind_attrib(attrib_location::BLENDINDICES, group.blendindices_buffer, 4, GL_UNSIGNED_BYTE, GL_FALSE, 0, {});
-        bind_attrib(attrib_location::BLENDWEIGHTS, group.blendweights_buffer, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, {});
-        bind_attrib(attrib_location::COLOR, group.color_buffer, 4, GL_FLOAT, false, 0, {1.f, 1.f, 1.f, 1.f});
-
-        group.meshes.push_back(std::move(mesh));
-    }
-
-    return group;
+        std::copy_n(next_index, my_mesh.elements.size(), begin(my_mesh.elements));
+        next_index += my_mesh.elements.size();
+        report.after += analyze_vertex_cache(span<const GLuint>(my_mesh.elements), num_vertices);
+    }
+
+    remap_vertex_array(span<GLfloat>(position_arr), 3, remap_span);
+    remap_vertex_array(span<GLfloat>(texcoord_arr), 2, remap_span);
+    remap_vertex_array(span<GLfloat>(normal_arr), 3, remap_span);
+    remap_vertex_array(span<GLfloat>(tangent_arr), 3, remap_span);
+    remap_vertex_array(span<GLubyte>(blendindices_arr), 4, remap_span);
+    remap_vertex_array(span<GLubyte>(blendweights_arr), 4, remap_span);
+    remap_vertex_array(span<GLfloat>(color_arr), 4, remap_span);
+
+    return report;
+}
+
+auto mesh_group_builder::bake(const mesh_options& options) const -> mesh_blob {
+    using _detail::attrib_source;
+
+    auto data_or_null = [](const auto& vec) -> const void* { return vec.empty() ? nullptr : vec.data(); };
+
+    const attrib_source sources[] = {
+        {attrib_location::POSITION, 3, GL_FLOAT, GL_FALSE, {0, 0, 0, 0}, data_or_null(position_arr)},
+        {attrib_location::TEXCOORD, 2, GL_FLOAT, GL_FALSE, {0, 0, 0, 0}, data_or_null(texcoord_arr)},
+        {attrib_location::NORMAL, 3, GL_FLOAT, GL_FALSE, {0, 0, 0, 0}, data_or_null(normal_arr)},
+        {attrib_location::TANGENT, 3, GL_FLOAT, GL_FALSE, {0, 0, 0, 0}, data_or_null(tangent_arr)},
+        {attrib_location::BLENDINDICES, 4, GL_UNSIGNED_BYTE, GL_FALSE, {0, 0, 0, 0}, data_or_null(blendindices_arr)},
+        {attrib_location::BLENDWEIGHTS, 4, GL_UNSIGNED_BYTE, GL_TRUE, {0, 0, 0, 0}, data_or_null(blendweights_arr)},
+        {attrib_location::COLOR, 4, GL_FLOAT, GL_FALSE, {1, 1, 1, 1}, data_or_null(color_arr)},
+    };
+
+    mesh_blob blob;
+    blob.options = options;
+
+    _detail::bake_vertex_data(blob, span<const attrib_source>(sources, 7), num_vertices);
+
+    auto positions = span<const glm::vec3>();
+
+    if (!position_arr.empty()) {
+        positions = span<const glm::vec3>(reinterpret_cast<const glm::vec3*>(position_arr.data()), num_vertices);
+    }
+
+    _detail::bake_elements(blob, span<const mesh_data>(meshes), num_vertices, positions);
+
+    return blob;
+}
+
+auto mesh_group_builder::get(const mesh_options& options) const -> mesh_group {
+    return upload(bake(options));
 }
 
 } // namespace sushi
@@ -3,6 +3,10 @@
 
 #include "mesh_group.hpp"
 #include "attrib_location.hpp"
+#include "common.hpp"
+#include "mesh_normals.hpp"
+#include "mesh_optimizer.hpp"
+#include "thread_pool.hpp"
 
 #include <bitset>
 #include <string>
@@ -32,17 +36,85 @@ public:
         GLuint index;
     };
 
+    /// Sets the attributes of a contiguous range of vertices from whole arrays.
+    /// Each array must hold one element for each vertex in the range.
+    class vertex_range_builder {
+    public:
+        vertex_range_builder(mesh_group_builder& mgb, GLuint first, std::size_t count);
+
+        auto positions(span<const glm::vec3> vecs) -> vertex_range_builder&;
+        auto texcoords(span<const glm::vec2> vecs) -> vertex_range_builder&;
+        auto normals(span<const glm::vec3> vecs) -> vertex_range_builder&;
+        auto tangents(span<const glm::vec3> vecs) -> vertex_range_builder&;
+        auto blendindices(span<const glm::ivec4> vecs) -> vertex_range_builder&;
+        auto blendweights(span<const glm::ivec4> vecs) -> vertex_range_builder&;
+        auto colors(span<const glm::vec4> vecs) -> vertex_range_builder&;
+
+        /// Gets the index of the first vertex in the range.
+        auto get() -> GLuint { return first; }
+
+    private:
+        auto get_count(std::size_t size) const -> std::size_t;
+
+        mesh_group_builder* mgb;
+        GLuint first;
+        std::size_t count;
+    };
+
     mesh_group_builder();
 
     void enable(attrib_location loc);
 
     void mesh(std::string name);
 
+    /// Reserves memory for vertices and indices, to avoid reallocation while building.
+    /// Only the currently enabled attributes are reserved for.
+    /// \param vertices Number of vertices which will be added in total.
+    /// \param indices Number of indices which will be added to the current (or next) mesh.
+    void reserve(std::size_t vertices, std::size_t indices);
+
     auto vertex() -> vertex_builder;
 
+    /// Adds `count` vertices with default attributes, which can then be set in bulk.
+    auto vertices(std::size_t count) -> vertex_range_builder;
+
     void tri(GLuint a, GLuint b, GLuint c);
 
-    auto get() const -> mesh_group;
+    /// Adds triangles to the current mesh.
+    /// \param indices Vertex indices, three per triangle.
+    /// \param base_vertex Added to every index, so that indices can be relative to the start of a `vertices()` range.
+    void tris(span<const GLuint> indices, GLuint base_vertex = 0);
+
+    /// Reorders triangles and vertices to improve vertex cache hits, overdraw, and vertex fetch locality.
+    /// Should be called after all meshes are complete, just before `get()`.
+    /// Vertex indices previously returned by the builder are invalidated.
+    /// \return The combined vertex cache statistics of all meshes.
+    auto optimize() -> mesh_optimization_report;
+
+    /// Computes smooth normals for every vertex used by a mesh, from the positions and triangles of all meshes.
+    /// Enables normals if they are not already enabled. Requires positions.
+    /// Vertices are never merged, so duplicated vertices (such as along texture seams) leave a visible crease.
+    /// \param weighting How triangles are weighted.
+    /// \param pool Thread pool to run on. The result does not depend on the number of threads.
+    void generate_normals(normal_weighting weighting = normal_weighting::ANGLE, thread_pool& pool = default_thread_pool());
+
+    /// Computes tangents for every vertex used by a mesh, in the direction of increasing texture coordinate `u`.
+    /// Enables tangents if they are not already enabled. Requires positions, texture coordinates, and normals.
+    /// Tangents have no handedness, so texture coordinates which are mirrored across shared vertices will cancel out.
+    /// \param weighting How triangles are weighted.
+    /// \param pool Thread pool to run on. The result does not depend on the number of threads.
+    void generate_tangents(normal_weighting weighting = normal_weighting::ANGLE, thread_pool& pool = default_thread_pool());
+
+    /// Encodes the meshes for upload, without any GL calls.
+    /// Since this only reads the builder, separate builders can be baked on separate threads concurrently.
+    /// \param options How to store the vertex and index data.
+    /// \return The baked data, to be passed to `upload` on the GL thread.
+    auto bake(const mesh_options& options = {}) const -> mesh_blob;
+
+    /// Bakes and uploads the meshes. Must be called on the GL context's thread.
+    /// \param options How to store the vertex and index data.
+    /// \return The meshes.
+    auto get(const mesh_options& options = {}) const -> mesh_group;
 
 private:
     struct mesh_data {
@@ -56,7 +128,12 @@ private:
         auto operator[](attrib_location loc) { return (*this)[static_cast<GLuint>(loc)]; }
     };
 
+    void add_vertices(std::size_t count);
+    auto current_mesh() -> mesh_data&;
+    auto get_all_elements() const -> std::vector<GLuint>;
+
     std::size_t num_vertices;
+    std::size_t reserved_indices;
     std::vector<GLfloat> position_arr;
     std::vector<GLfloat> texcoord_arr;
     std::vector<GLfloat> normal_arr;
@@ -3,50 +3,384 @@
 #include "mesh_utils.hpp"
 #include "attrib_location.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
 namespace sushi {
 
-auto load_meshes(const iqm::iqm_data& data) -> mesh_group {
+namespace {
+
+using iqm_attrib_sources = std::array<_detail::attrib_source, 7>;
+
+/// Gets the formats of the IQM vertex arrays, without any data.
+auto get_iqm_attrib_sources() -> iqm_attrib_sources {
+    return {{
+        {attrib_location::POSITION, 3, GL_FLOAT, GL_FALSE, {0, 0, 0, 0}, nullptr},
+        {attrib_location::TEXCOORD, 2, GL_FLOAT, GL_FALSE, {0, 0, 0, 0}, nullptr},
+        {attrib_location::NORMAL, 3, GL_FLOAT, GL_FALSE, {0, 0, 0, 0}, nullptr},
+        {attrib_location::TANGENT, 3, GL_FLOAT, GL_FALSE, {0, 0, 0, 0}, nullptr},
+        {attrib_location::BLENDINDICES, 4, GL_UNSIGNED_BYTE, GL_FALSE, {0, 0, 0, 0}, nullptr},
+        {attrib_location::BLENDWEIGHTS, 4, GL_UNSIGNED_BYTE, GL_TRUE, {0, 0, 0, 0}, nullptr},
+        {attrib_location::COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, {1, 1, 1, 1}, nullptr},
+    }};
+}
+
+constexpr iqm::vertexarray_type iqm_attrib_types[] = {
+    iqm::vertexarray_type::POSITION,
+    iqm::vertexarray_type::TEXCOORD,
+    iqm::vertexarray_type::NORMAL,
+    iqm::vertexarray_type::TANGENT,
+    iqm::vertexarray_type::BLENDINDEXES,
+    iqm::vertexarray_type::BLENDWEIGHTS,
+    iqm::vertexarray_type::COLOR,
+};
+
+/// Computes the bounds of each mesh, and of the whole group, from positions which are decoded a chunk at a time,
+/// so that they are never all in memory at once.
+/// Each mesh's positions are decoded twice: once for the boxes, and once for the spheres, which are centered on the boxes.
+/// The group's box is merged from the meshes' boxes, so vertices outside every mesh's range are not included.
+/// \param decode Called as `decode(first, count, dst)`, must write `count` positions starting at `first` to `dst`.
+/// \return The bounds of the group.
+template <typename Decode>
+auto compute_chunked_mesh_bounds(
+    std::vector<mesh_group::mesh>& meshes, span<const _detail::element_range> ranges, Decode&& decode) -> mesh_bounds {
+    constexpr auto chunk_size = std::size_t{4096};
+
+    auto chunk = std::vector<glm::vec3>(chunk_size);
+
+    auto for_each_chunk = [&](const _detail::element_range& range, auto&& func) {
+        for (auto offset = std::size_t{0}; offset < range.num_vertices; offset += chunk_size) {
+            auto n = std::min(chunk_size, range.num_vertices - offset);
+            decode(range.first_vertex + offset, n, chunk.data());
+            func(span<const glm::vec3>(chunk.data(), n));
+        }
+    };
+
+    mesh_bounds group_bounds;
+    auto has_vertices = false;
+
+    for (auto i = std::size_t{0}; i < ranges.size(); ++i) {
+        auto& bounds = meshes[i].bounds;
+        bounds = {};
+
+        if (ranges[i].num_vertices == 0) {
+            continue;
+        }
+
+        auto first_chunk = true;
+
+        for_each_chunk(ranges[i], [&](span<const glm::vec3> positions) {
+            auto chunk_bounds = compute_bounds(positions);
+            bounds.min = first_chunk ? chunk_bounds.min : glm::min(bounds.min, chunk_bounds.min);
+            bounds.max = first_chunk ? chunk_bounds.max : glm::max(bounds.max, chunk_bounds.max);
+            first_chunk = false;
+        });
+
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+        group_bounds.min = has_vertices ? glm::min(group_bounds.min, bounds.min) : bounds.min;
+        group_bounds.max = has_vertices ? glm::max(group_bounds.max, bounds.max) : bounds.max;
+        has_vertices = true;
+    }
+
+    if (!has_vertices) {
+        return group_bounds;
+    }
+
+    group_bounds.center = (group_bounds.min + group_bounds.max) * 0.5f;
+
+    // Both spheres are measured from the same decoded chunks.
+    auto group_radius_sq = 0.f;
+
+    for (auto i = std::size_t{0}; i < ranges.size(); ++i) {
+        auto& bounds = meshes[i].bounds;
+        auto radius_sq = 0.f;
+
+        for_each_chunk(ranges[i], [&](span<const glm::vec3> positions) {
+            for (const auto& p : positions) {
+                auto d = p - bounds.center;
+                auto g = p - group_bounds.center;
+                radius_sq = std::max(radius_sq, glm::dot(d, d));
+                group_radius_sq = std::max(group_radius_sq, glm::dot(g, g));
+            }
+        });
+
+        bounds.radius = std::sqrt(radius_sq);
+    }
+
+    group_bounds.radius = std::sqrt(group_radius_sq);
+
+    return group_bounds;
+}
+
+template <typename T>
+auto data_or_null(const std::vector<T>& vec) -> const void* {
+    return vec.empty() ? nullptr : vec.data();
+}
+
+} // namespace
+
+auto compute_bounds(span<const glm::vec3> positions) -> mesh_bounds {
+    mesh_bounds bounds;
+
+    if (positions.empty()) {
+        return bounds;
+    }
+
+    // Positions are scanned as a flat float array, four vertices at a time, with independent accumulators per lane.
+    // This keeps the loops free of dependencies, so compilers can use packed SIMD min, max, and multiply-add.
+    constexpr auto block = std::size_t{12};
+
+    const auto floats = reinterpret_cast<const float*>(positions.data());
+    const auto num_floats = positions.size() * 3;
+    const auto num_block_floats = num_floats / block * block;
+
+    float lo[block];
+    float hi[block];
+
+    for (auto l = std::size_t{0}; l < block; ++l) {
+        lo[l] = hi[l] = floats[l % 3];
+    }
+
+    for (auto i = std::size_t{0}; i < num_block_floats; i += block) {
+        for (auto l = std::size_t{0}; l < block; ++l) {
+            auto f = floats[i + l];
+            lo[l] = f < lo[l] ? f : lo[l];
+            hi[l] = f > hi[l] ? f : hi[l];
+        }
+    }
+
+    for (auto i = num_block_floats; i < num_floats; ++i) {
+        auto c = i % 3;
+        lo[c] = std::min(lo[c], floats[i]);
+        hi[c] = std::max(hi[c], floats[i]);
+    }
+
+    for (auto l = std::size_t{3}; l < block; ++l) {
+        lo[l % 3] = std::min(lo[l % 3], lo[l]);
+        hi[l % 3] = std::max(hi[l % 3], hi[l]);
+    }
+
+    bounds.min = {lo[0], lo[1], lo[2]};
+    bounds.max = {hi[0], hi[1], hi[2]};
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+    const float center[3] = {bounds.center.x, bounds.center.y, bounds.center.z};
+    float radius_sq[4] = {0, 0, 0, 0};
+
+    const auto num_blocks = positions.size() / 4;
+
+    for (auto b = std::size_t{0}; b < num_blocks; ++b) {
+        const auto p = floats + b * block;
+        for (auto v = 0; v < 4; ++v) {
+            auto dx = p[v * 3 + 0] - center[0];
+            auto dy = p[v * 3 + 1] - center[1];
+            auto dz = p[v * 3 + 2] - center[2];
+            auto d = dx * dx + dy * dy + dz * dz;
+            radius_sq[v] = d > radius_sq[v] ? d : radius_sq[v];
+        }
+    }
+
+    for (auto v = num_blocks * 4; v < positions.size(); ++v) {
+        auto d = positions[v] - bounds.center;
+        radius_sq[0] = std::max(radius_sq[0], glm::dot(d, d));
+    }
+
+    bounds.radius = std::sqrt(std::max({radius_sq[0], radius_sq[1], radius_sq[2], radius_sq[3]}));
+
+    return bounds;
+}
+
+auto upload(const mesh_blob& blob) -> mesh_group {
+    using _detail::bind_attribs;
     using _detail::load_buffer;
-    using _detail::bind_attrib;
 
     mesh_group group;
+    group.options = blob.options;
+    group.meshes = blob.meshes;
+    group.bounds = blob.bounds;
+
+    if (blob.options.layout == vertex_layout::INTERLEAVED) {
+        group.vertex_buffer = load_buffer(GL_ARRAY_BUFFER, blob.vertex_data.data(), blob.vertex_data.size());
+    } else {
+        for (auto i = std::size_t{0}; i < blob.format.num_attribs; ++i) {
+            const auto& attr = blob.format.attribs[i];
+            if (attr.data) {
+                const auto& data = blob.attrib_data[i];
+                _detail::get_attrib_buffer(group, attr.loc) = load_buffer(GL_ARRAY_BUFFER, data.data(), data.size());
+            }
+        }
+    }
+
+    group.vao = make_unique_vertex_array();
+    glBindVertexArray(group.vao.get());
+    SUSHI_DEFER { glBindVertexArray(0); };
+
+    group.index_type = blob.index_type;
+    group.index_buffer = load_buffer(GL_ELEMENT_ARRAY_BUFFER, blob.index_data.data(), blob.index_data.size());
+
+    bind_attribs(group, blob.format);
+
+    return group;
+}
+
+auto bake_meshes(const iqm::iqm_data& data, const mesh_options& options) -> mesh_blob {
+    auto sources = get_iqm_attrib_sources();
+    sources[0].data = data_or_null(data.vertexarrays.position);
+    sources[1].data = data_or_null(data.vertexarrays.texcoord);
+    sources[2].data = data_or_null(data.vertexarrays.normal);
+    sources[3].data = data_or_null(data.vertexarrays.tangent);
+    sources[4].data = data_or_null(data.vertexarrays.blendindexes);
+    sources[5].data = data_or_null(data.vertexarrays.blendweights);
+    sources[6].data = data_or_null(data.vertexarrays.color);
 
-    group.position_buffer = load_buffer(data.vertexarrays.position);
-    group.texcoord_buffer = load_buffer(data.vertexarrays.texcoord);
-    group.normal_buffer = load_buffer(data.vertexarrays.normal);
-    group.tangent_buffer = load_buffer(data.vertexarrays.tangent);
-    group.blendindices_buffer = load_buffer(data.vertexarrays.blendindexes);
-    group.blendweights_buffer = load_buffer(data.vertexarrays.blendweights);
-    group.color_buffer = load_buffer(data.vertexarrays.color);
+    auto num_vertices = data.vertexarrays.position.size() / 3;
+
+    // Texcoords and byte arrays may have 1 to 4 components, as many as the file stored.
+    auto set_size = [&](_detail::attrib_source& src, std::size_t array_size) {
+        if (num_vertices != 0 && array_size != 0) {
+            src.size = GLint(std::clamp(array_size / num_vertices, std::size_t{1}, std::size_t{4}));
+        }
+    };
+
+    set_size(sources[1], data.vertexarrays.texcoord.size());
+    set_size(sources[4], data.vertexarrays.blendindexes.size());
+    set_size(sources[5], data.vertexarrays.blendweights.size());
+    set_size(sources[6], data.vertexarrays.color.size());
+
+    mesh_blob blob;
+    blob.options = options;
+
+    _detail::bake_vertex_data(blob, span<const _detail::attrib_source>(sources.data(), sources.size()), num_vertices);
+
+    auto ranges = std::vector<_detail::element_range>();
+    ranges.reserve(data.meshes.size());
 
     for (auto& iqm_mesh : data.meshes) {
         auto mesh = mesh_group::mesh{};
         mesh.name = iqm_mesh.name;
         mesh.num_tris = iqm_mesh.num_triangles;
-        mesh.tris = make_unique_buffer();
-        mesh.vao = make_unique_vertex_array();
-        glBindVertexArray(mesh.vao.get());
-        SUSHI_DEFER { glBindVertexArray(0); };
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.tris.get());
-        glBufferData(
-            GL_ELEMENT_ARRAY_BUFFER,
-            iqm_mesh.num_triangles * 3 * 4,
-            &data.triangles[iqm_mesh.first_triangle],
-            GL_STATIC_DRAW);
-
-        bind_attrib(attrib_location::POSITION, group.position_buffer, 3, GL_FLOAT, false, iqm_mesh.first_vertex, {});
-        bind_attrib(attrib_location::TEXCOORD, group.texcoord_buffer, 2, GL_FLOAT, false,  iqm_mesh.first_vertex, {});
-        bind_attrib(attrib_location::NORMAL, group.normal_buffer, 3, GL_FLOAT, false,  iqm_mesh.first_vertex, {});
-        bind_attrib(attrib_location::TANGENT, group.tangent_buffer, 3, GL_FLOAT, false,  iqm_mesh.first_vertex, {});
-        bind_attrib(attrib_location::BLENDINDICES, group.blendindices_buffer, 4, GL_UNSIGNED_BYTE, GL_FALSE, iqm_mesh.first_vertex, {});
-        bind_attrib(attrib_location::BLENDWEIGHTS, group.blendweights_buffer, 4, GL_UNSIGNED_BYTE, GL_TRUE, iqm_mesh.first_vertex, {});
-        bind_attrib(attrib_location::COLOR, group.color_buffer, 4, GL_UNSIGNED_BYTE, GL_TRUE, iqm_mesh.first_vertex, {255, 255, 255, 255});
+        blob.meshes.push_back(std::move(mesh));
+        ranges.push_back({std::size_t(iqm_mesh.num_triangles) * 3, iqm_mesh.first_vertex, iqm_mesh.num_vertexes});
+    }
+
+    auto range_span = span<const _detail::element_range>(ranges.data(), ranges.size());
+
+    auto positions = span<const glm::vec3>(
+        reinterpret_cast<const glm::vec3*>(data.vertexarrays.position.data()), num_vertices);
+
+    auto elements = _detail::build_elements(
+        blob.meshes, options, range_span, num_vertices, positions, [&](std::size_t i, GLuint* dst) {
+            auto first = data.triangles.begin() + data.meshes[i].first_triangle;
+            for (auto iter = first; iter != first + data.meshes[i].num_triangles; ++iter) {
+                for (auto v : iter->verts) {
+                    *dst++ = GLuint(v);
+                }
+            }
+        });
+
+    blob.index_type = elements.type;
+    _detail::pack_indices(elements, blob.index_data);
+
+    blob.bounds = _detail::compute_mesh_bounds(blob.meshes, range_span, positions);
+
+    return blob;
+}
+
+auto load_meshes(const iqm::iqm_data& data, const mesh_options& options) -> mesh_group {
+    return upload(bake_meshes(data, options));
+}
+
+auto load_meshes(const iqm::iqm_file& file, const mesh_options& options) -> std::optional<mesh_group> try {
+    using _detail::bind_attribs;
+    using _detail::load_elements;
+    using _detail::load_vertex_buffers;
 
+    auto num_vertices = std::size_t(file.get_header().num_vertexes);
+    auto sources = get_iqm_attrib_sources();
+
+    // The data pointers only mark which attributes are present, they are never read through.
+    // Texcoords and byte arrays may have 1 to 4 components, so sizes come from the file rather than the defaults.
+    for (auto i = 0; i < 7; ++i) {
+        auto components = iqm::get_vertexarray_components(file, iqm_attrib_types[i]);
+        sources[i].data = components != 0 ? &file : nullptr;
+
+        if (components != 0) {
+            sources[i].size = GLint(components);
+        }
+    }
+
+    // Generating levels of detail needs every position at once, so only then are they kept on the CPU.
+    // Otherwise they're decoded straight into the buffer like any other array, and bounds are computed in chunks.
+    auto positions = std::vector<glm::vec3>();
+
+    if (sources[0].data && options.lods.max_lods > 0) {
+        positions.resize(num_vertices);
+        iqm::decode_vertexarray(file, iqm::vertexarray_type::POSITION, positions.data());
+    }
+
+    mesh_group group;
+    group.options = options;
+
+    // Arrays which need no re-encoding are decoded straight into the mapped buffers,
+    // others go through scratch memory one array at a time.
+    auto format = load_vertex_buffers(
+        group,
+        span<const _detail::attrib_source>(sources.data(), sources.size()),
+        num_vertices,
+        [&](std::size_t i, void* dst) {
+            if (iqm_attrib_types[i] == iqm::vertexarray_type::POSITION && !positions.empty()) {
+                std::memcpy(dst, positions.data(), positions.size() * sizeof(glm::vec3));
+            } else {
+                iqm::decode_vertexarray(file, iqm_attrib_types[i], dst);
+            }
+        });
+
+    auto iqm_meshes = iqm::decode_meshes(file);
+    auto ranges = std::vector<_detail::element_range>();
+    ranges.reserve(iqm_meshes.size());
+
+    for (auto& iqm_mesh : iqm_meshes) {
+        auto mesh = mesh_group::mesh{};
+        mesh.name = iqm_mesh.name;
+        mesh.num_tris = iqm_mesh.num_triangles;
         group.meshes.push_back(std::move(mesh));
+        ranges.push_back({std::size_t(iqm_mesh.num_triangles) * 3, iqm_mesh.first_vertex, iqm_mesh.num_vertexes});
+    }
+
+    group.vao = make_unique_vertex_array();
+    glBindVertexArray(group.vao.get());
+    SUSHI_DEFER { glBindVertexArray(0); };
+
+    auto range_span = span<const _detail::element_range>(ranges.data(), ranges.size());
+
+    auto position_span = span<const glm::vec3>(positions);
+
+    load_elements(group, range_span, num_vertices, position_span, [&](std::size_t i, GLuint* dst) {
+        static_assert(sizeof(iqm::triangle) == 3 * sizeof(GLuint));
+        iqm::decode_triangles(
+            file, iqm_meshes[i].first_triangle, iqm_meshes[i].num_triangles, reinterpret_cast<iqm::triangle*>(dst));
+    });
+
+    bind_attribs(group, format);
+
+    if (!positions.empty()) {
+        group.bounds = _detail::compute_mesh_bounds(group.meshes, range_span, position_span);
+    } else if (sources[0].data) {
+        auto decode = [&](std::size_t first, std::size_t count, glm::vec3* dst) {
+            iqm::decode_vertexarray(file, iqm::vertexarray_type::POSITION, first, count, dst);
+        };
+
+        group.bounds = compute_chunked_mesh_bounds(group.meshes, range_span, decode);
     }
 
     return group;
+} catch (const std::exception& e) {
+    std::cerr << "ERROR: sushi::load_meshes: " << e.what() << "\n";
+    return std::nullopt;
 }
 
 void draw_mesh(const mesh_group& group) {
@@ -54,14 +388,72 @@ void draw_mesh(const mesh_group& group) {
     glGetIntegerv(GL_CURRENT_PROGRAM, &program);
 
     auto animated_uniform = glGetUniformLocation(program, "Animated");
+    auto octahedral_uniform = glGetUniformLocation(program, "OctahedralNormals");
+
+    glUniform1i(animated_uniform, 0);
+    glUniform1i(octahedral_uniform, group.options.octahedral_normals);
+    _detail::set_bone_palette_unit(program);
+
+    glBindVertexArray(group.vao.get());
+    SUSHI_DEFER { glBindVertexArray(0); };
+
+    for (const auto& mesh : group.meshes) {
+        _detail::draw_elements(group, mesh);
+    }
+}
+
+auto get_lod_scale(const glm::mat4& projection, const glm::mat4& modelview, float viewport_height) -> float {
+    // The longest axis of the model transform bounds its scale.
+    auto scale = std::max({
+        glm::length(glm::vec3(modelview[0])),
+        glm::length(glm::vec3(modelview[1])),
+        glm::length(glm::vec3(modelview[2]))});
+
+    auto distance = glm::length(glm::vec3(modelview[3]));
+
+    // Orthographic projections don't shrink with distance.
+    auto is_perspective = projection[2][3] != 0;
+    auto pixels_per_unit = viewport_height * 0.5f * projection[1][1];
+
+    if (is_perspective) {
+        if (distance <= 0) {
+            return std::numeric_limits<float>::infinity();
+        }
+        pixels_per_unit /= distance;
+    }
+
+    return pixels_per_unit * scale;
+}
+
+auto select_lod(const mesh_group::mesh& mesh, float lod_scale, float max_pixel_error) -> std::size_t {
+    auto level = std::size_t{0};
+
+    for (auto i = std::size_t{0}; i < mesh.lods.size(); ++i) {
+        if (mesh.lods[i].error * lod_scale > max_pixel_error) {
+            break;
+        }
+        level = i + 1;
+    }
+
+    return level;
+}
+
+void draw_mesh(const mesh_group& group, float lod_scale, float max_pixel_error) {
+    GLint program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+    auto animated_uniform = glGetUniformLocation(program, "Animated");
+    auto octahedral_uniform = glGetUniformLocation(program, "OctahedralNormals");
 
     glUniform1i(animated_uniform, 0);
+    glUniform1i(octahedral_uniform, group.options.octahedral_normals);
+    _detail::set_bone_palette_unit(program);
 
+    glBindVertexArray(group.vao.get());
     SUSHI_DEFER { glBindVertexArray(0); };
 
     for (const auto& mesh : group.meshes) {
-        glBindVertexArray(mesh.vao.get());
-        glDrawElements(GL_TRIANGLES, mesh.num_tris * 3, GL_UNSIGNED_INT, nullptr);
+        _detail::draw_elements(group, mesh, select_lod(mesh, lod_scale, max_pixel_error));
     }
 }
 
@@ -4,9 +4,11 @@
 #include "gl.hpp"
 #include "common.hpp"
 #include "iqm.hpp"
+#include "vertex_encoding.hpp"
 
 #include <string>
 #include <memory>
+#include <optional>
 #include <vector>
 
 /// Sushi
@@ -54,12 +56,81 @@ inline unique_vertex_array make_unique_vertex_array() {
     return unique_vertex_array(buf);
 }
 
+/// How the vertex attributes of a mesh_group are stored.
+enum class vertex_layout {
+    SEPARATE, /** One buffer per attribute. */
+    INTERLEAVED, /** A single buffer holding every attribute of each vertex together. */
+};
+
+/// Storage formats for texture coordinates.
+enum class texcoord_format {
+    FLOAT, /** 32-bit floats. */
+    HALF_FLOAT, /** 16-bit floats. */
+    UNORM16, /** 16-bit normalized integers. Only suitable for texture coordinates within [0,1]. */
+};
+
+/// Bounding volumes of a set of vertices, in model space.
+struct mesh_bounds {
+    glm::vec3 min = {0, 0, 0};
+    glm::vec3 max = {0, 0, 0};
+    glm::vec3 center = {0, 0, 0}; /** Center of the bounding sphere, which is also the center of the box. */
+    float radius = 0; /** Radius of the bounding sphere. */
+};
+
+/// Computes the bounding box and bounding sphere of a set of positions.
+/// \param positions The positions.
+/// \return The bounds, or empty bounds at the origin if there are no positions.
+auto compute_bounds(span<const glm::vec3> positions) -> mesh_bounds;
+
+/// Options for generating simplified levels of detail.
+struct lod_options {
+    std::size_t max_lods = 0; /** Maximum number of simplified levels per mesh. 0 disables generation. */
+    float reduction = 0.5f; /** Target triangle count of each level, relative to the previous level. */
+    float max_error = 0.02f; /** Largest allowed geometric error, relative to the size of the mesh's bounding box. */
+};
+
+/// Options controlling how a mesh_group stores its vertex and index data.
+/// The defaults store everything at full precision.
+struct mesh_options {
+    vertex_layout layout = vertex_layout::SEPARATE;
+
+    texcoord_format texcoords = texcoord_format::FLOAT;
+
+    /// Stores normals and tangents as octahedral-encoded pairs of 16-bit normalized integers.
+    /// Shaders must decode them, see `decode_octahedral` in `assets/vert.glsl`.
+    /// `draw_mesh` sets the `OctahedralNormals` uniform to indicate this.
+    bool octahedral_normals = false;
+
+    /// Stores colors as 8-bit normalized integers.
+    bool unorm8_colors = false;
+
+    /// Uses 16-bit indices when every mesh has fewer than 65536 vertices.
+    bool compact_indices = false;
+
+    /// Generates simplified levels of detail for each mesh, selected by `draw_mesh` with a LOD scale.
+    lod_options lods;
+
+    /// Gets options with every compact encoding enabled.
+    static auto compact(vertex_layout layout = vertex_layout::SEPARATE) -> mesh_options {
+        return {layout, texcoord_format::HALF_FLOAT, true, true, true, lod_options{}};
+    }
+};
+
 struct mesh_group {
+    /// A simplified level of detail of a mesh, sharing the mesh's vertices.
+    struct lod {
+        int num_tris = 0;
+        GLsizei first_index = 0;
+        float error = 0; /** Largest geometric deviation from the full detail mesh, in model units. */
+    };
+
     struct mesh {
         std::string name;
         int num_tris = 0;
-        unique_buffer tris;
-        unique_vertex_array vao;
+        GLsizei first_index = 0; /** Offset into the group's index buffer, in indices. */
+        GLint base_vertex = 0; /** Added to each index before fetching vertices. */
+        std::vector<lod> lods; /** Simplified levels, from most to least detailed. */
+        mesh_bounds bounds; /** Bounds of the mesh's vertex range. */
     };
 
     unique_buffer position_buffer;
@@ -69,15 +140,81 @@ struct mesh_group {
     unique_buffer blendindices_buffer;
     unique_buffer blendweights_buffer;
     unique_buffer color_buffer;
+    unique_buffer vertex_buffer; /** Only used by vertex_layout::INTERLEAVED. */
+    unique_buffer index_buffer; /** Holds the indices of every mesh. */
+    std::vector<std::shared_ptr<const unique_buffer>> shared_buffers; /** Used instead of the buffers above by groups from a mesh_registry. */
+    GLenum index_type = GL_UNSIGNED_INT;
+    unique_vertex_array vao; /** Shared by every mesh. */
+    mesh_options options;
     std::vector<mesh> meshes;
+    mesh_bounds bounds; /** Bounds of every vertex in the group. */
 };
 
-auto load_meshes(const iqm::iqm_data& data) -> mesh_group;
+/// Vertex and index data of a mesh_group, encoded and laid out for upload, but not yet in GL buffers.
+/// Blobs are produced without any GL calls, so they can be baked on worker threads and uploaded later.
+struct mesh_blob {
+    mesh_options options;
+    _detail::vertex_encoding format; /** Attributes with null `data` are absent. Other `data` pointers are not used after baking. */
+    std::array<std::vector<unsigned char>, 7> attrib_data; /** Same order as `format.attribs`. Only used by vertex_layout::SEPARATE. */
+    std::vector<unsigned char> vertex_data; /** Only used by vertex_layout::INTERLEAVED. */
+    std::vector<unsigned char> index_data;
+    GLenum index_type = GL_UNSIGNED_INT;
+    std::vector<mesh_group::mesh> meshes;
+    mesh_bounds bounds;
+};
+
+/// Creates GL buffers and a VAO from a baked blob. Must be called on the GL context's thread.
+/// This only copies the blob's data into buffers, all encoding was done when baking.
+/// \param blob The baked data.
+/// \return The meshes.
+auto upload(const mesh_blob& blob) -> mesh_group;
+
+/// Bakes the meshes of an IQM file for upload, without any GL calls.
+/// \param data The IQM data.
+/// \param options How to store the vertex and index data.
+/// \return The baked data.
+auto bake_meshes(const iqm::iqm_data& data, const mesh_options& options = {}) -> mesh_blob;
+
+/// Loads the meshes of an IQM file.
+/// \param data The IQM data.
+/// \param options How to store the vertex and index data.
+/// \return The meshes.
+auto load_meshes(const iqm::iqm_data& data, const mesh_options& options = {}) -> mesh_group;
+
+/// Loads the meshes of an opened IQM file.
+/// Vertex arrays and triangles are decoded straight from the mapped file into GL buffer memory,
+/// so no intermediate `iqm_data` copy is ever made.
+/// Bounds are computed from positions decoded a chunk at a time.
+/// Only when levels of detail are requested is a full copy of the positions kept, since simplification needs them all.
+/// \param file The opened file.
+/// \param options How to store the vertex and index data.
+/// \return The meshes, or nothing if the file's geometry is malformed.
+auto load_meshes(const iqm::iqm_file& file, const mesh_options& options = {}) -> std::optional<mesh_group>;
 
 /// Draws a mesh.
 /// \param mesh The mesh to draw.
 void draw_mesh(const mesh_group& group);
 
+/// Gets the projected size of one model unit, in pixels, at the model's origin.
+/// \param projection The projection matrix.
+/// \param modelview The combined model and view matrix.
+/// \param viewport_height Height of the viewport, in pixels.
+/// \return The LOD scale, for use with `select_lod` and `draw_mesh`.
+auto get_lod_scale(const glm::mat4& projection, const glm::mat4& modelview, float viewport_height) -> float;
+
+/// Selects the least detailed level of a mesh whose projected error is within the limit.
+/// \param mesh The mesh.
+/// \param lod_scale Projected size of one model unit, in pixels, as returned by `get_lod_scale`.
+/// \param max_pixel_error Largest allowed projected error, in pixels.
+/// \return 0 for full detail, or `i + 1` for `mesh.lods[i]`.
+auto select_lod(const mesh_group::mesh& mesh, float lod_scale, float max_pixel_error = 1.f) -> std::size_t;
+
+/// Draws a mesh, selecting a level of detail for each of its meshes.
+/// \param group The mesh to draw.
+/// \param lod_scale Projected size of one model unit, in pixels, as returned by `get_lod_scale`.
+/// \param max_pixel_error Largest allowed projected error, in pixels.
+void draw_mesh(const mesh_group& group, float lod_scale, float max_pixel_error = 1.f);
+
 } // namespace sushi
 
 #endif // SUSHI_MESH_GROUP_HPP
\ No newline at end of file
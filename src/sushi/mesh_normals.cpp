@@ -0,0 +1,212 @@
+#include "mesh_normals.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace sushi {
+
+namespace {
+
+/// Triangles or vertices handled by each task.
+/// This is fixed, rather than derived from the pool size, so that results never depend on the number of threads.
+constexpr std::size_t block_size = 16384;
+
+auto get_num_blocks(std::size_t count) -> std::size_t {
+    return (count + block_size - 1) / block_size;
+}
+
+/// The corners referencing each vertex, where corner `c` is `indices[c]`.
+struct vertex_corners {
+    std::vector<std::size_t> offsets; /** Start of each vertex's corners, plus one past the last. */
+    std::vector<GLuint> corners; /** Grouped by vertex, in increasing order within each vertex. */
+};
+
+auto get_vertex_corners(span<const GLuint> indices, std::size_t num_vertices) -> vertex_corners {
+    vertex_corners result;
+    result.offsets.assign(num_vertices + 1, 0);
+    result.corners.resize(indices.size());
+
+    auto& offsets = result.offsets;
+
+    for (auto v : indices) {
+        ++offsets[v + 1];
+    }
+
+    for (auto v = std::size_t{0}; v < num_vertices; ++v) {
+        offsets[v + 1] += offsets[v];
+    }
+
+    // Filling advances each vertex's offset to the start of the next vertex, so they are shifted back afterwards.
+    for (auto c = std::size_t{0}; c < indices.size(); ++c) {
+        result.corners[offsets[indices[c]]++] = GLuint(c);
+    }
+
+    for (auto v = num_vertices; v > 0; --v) {
+        offsets[v] = offsets[v - 1];
+    }
+
+    offsets[0] = 0;
+
+    return result;
+}
+
+/// Angle between two vectors, which need not be normalized. Zero if either is zero.
+auto get_angle(const glm::vec3& a, const glm::vec3& b) -> float {
+    return std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b));
+}
+
+/// Gets the weight of each corner of a triangle.
+auto get_corner_weights(const glm::vec3 (&p)[3], normal_weighting weighting) -> glm::vec3 {
+    auto e01 = p[1] - p[0];
+    auto e02 = p[2] - p[0];
+    auto e12 = p[2] - p[1];
+
+    switch (weighting) {
+        case normal_weighting::AREA:
+            return glm::vec3(glm::length(glm::cross(e01, e02)) * 0.5f);
+        case normal_weighting::ANGLE:
+            return {get_angle(e01, e02), get_angle(-e01, e12), get_angle(e02, e12)};
+    }
+
+    return glm::vec3(0);
+}
+
+/// Sums weighted per-corner vectors into each vertex, in parallel.
+/// Each vertex's corners are always summed in the same order, so the sums are identical for any number of threads.
+/// \param get_corners Called as `get_corners(t, dst)`, must write the vectors of the 3 corners of triangle `t` to `dst`.
+/// \param finish Called as `finish(v, sum)` for every vertex referenced by the indices.
+template <typename GetCorners, typename Finish>
+void accumulate_corners(
+    span<const GLuint> indices,
+    std::size_t num_vertices,
+    thread_pool& pool,
+    GetCorners&& get_corners,
+    Finish&& finish) {
+
+    auto num_tris = indices.size() / 3;
+    auto corner_vecs = std::vector<glm::vec3>(num_tris * 3);
+
+    pool.parallel_for(get_num_blocks(num_tris), [&](std::size_t block, unsigned) {
+        auto last = std::min(num_tris, (block + 1) * block_size);
+        for (auto t = block * block_size; t < last; ++t) {
+            get_corners(t, corner_vecs.data() + t * 3);
+        }
+    });
+
+    auto adjacency = get_vertex_corners(span<const GLuint>(indices.data(), num_tris * 3), num_vertices);
+
+    pool.parallel_for(get_num_blocks(num_vertices), [&](std::size_t block, unsigned) {
+        auto last = std::min(num_vertices, (block + 1) * block_size);
+        for (auto v = block * block_size; v < last; ++v) {
+            auto first_corner = adjacency.offsets[v];
+            auto last_corner = adjacency.offsets[v + 1];
+
+            if (first_corner == last_corner) {
+                continue;
+            }
+
+            auto sum = glm::vec3(0);
+
+            for (auto c = first_corner; c < last_corner; ++c) {
+                sum += corner_vecs[adjacency.corners[c]];
+            }
+
+            finish(v, sum);
+        }
+    });
+}
+
+/// Gets any unit vector perpendicular to a unit vector.
+auto get_perpendicular(const glm::vec3& n) -> glm::vec3 {
+    auto axis = std::abs(n.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+    return glm::normalize(glm::cross(n, axis));
+}
+
+} // namespace
+
+void generate_normals(
+    span<const GLuint> indices,
+    span<const glm::vec3> positions,
+    span<glm::vec3> normals,
+    normal_weighting weighting,
+    thread_pool& pool) {
+
+    auto get_corners = [&](std::size_t t, glm::vec3* dst) {
+        const glm::vec3 p[3] = {positions[indices[t * 3]], positions[indices[t * 3 + 1]], positions[indices[t * 3 + 2]]};
+
+        // Front faces are clockwise, as with `load_obj_file` and `glFrontFace(GL_CW)`.
+        auto face = glm::cross(p[2] - p[0], p[1] - p[0]);
+        auto len = glm::length(face);
+
+        if (len == 0) {
+            std::fill_n(dst, 3, glm::vec3(0));
+            return;
+        }
+
+        auto n = face / len;
+        auto w = get_corner_weights(p, weighting);
+
+        dst[0] = n * w[0];
+        dst[1] = n * w[1];
+        dst[2] = n * w[2];
+    };
+
+    accumulate_corners(indices, positions.size(), pool, get_corners, [&](std::size_t v, const glm::vec3& sum) {
+        auto len = glm::length(sum);
+        if (len > 0) {
+            normals[v] = sum / len;
+        }
+    });
+}
+
+void generate_tangents(
+    span<const GLuint> indices,
+    span<const glm::vec3> positions,
+    span<const glm::vec2> texcoords,
+    span<const glm::vec3> normals,
+    span<glm::vec3> tangents,
+    normal_weighting weighting,
+    thread_pool& pool) {
+
+    auto get_corners = [&](std::size_t t, glm::vec3* dst) {
+        const GLuint v[3] = {indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]};
+        const glm::vec3 p[3] = {positions[v[0]], positions[v[1]], positions[v[2]]};
+
+        auto e1 = p[1] - p[0];
+        auto e2 = p[2] - p[0];
+        auto d1 = texcoords[v[1]] - texcoords[v[0]];
+        auto d2 = texcoords[v[2]] - texcoords[v[0]];
+
+        // Only the direction is kept, so the division by the texture space area reduces to its sign.
+        auto det = d1.x * d2.y - d2.x * d1.y;
+        auto dir = (e1 * d2.y - e2 * d1.y) * (det < 0 ? -1.f : 1.f);
+        auto len = glm::length(dir);
+
+        if (det == 0 || len == 0) {
+            std::fill_n(dst, 3, glm::vec3(0));
+            return;
+        }
+
+        auto tangent = dir / len;
+        auto w = get_corner_weights(p, weighting);
+
+        dst[0] = tangent * w[0];
+        dst[1] = tangent * w[1];
+        dst[2] = tangent * w[2];
+    };
+
+    accumulate_corners(indices, positions.size(), pool, get_corners, [&](std::size_t v, const glm::vec3& sum) {
+        const auto& n = normals[v];
+        auto tangent = sum - n * glm::dot(n, sum);
+        auto len = glm::length(tangent);
+
+        if (len > 1e-6f * glm::length(sum)) {
+            tangents[v] = tangent / len;
+        } else if (glm::dot(n, n) > 0) {
+            tangents[v] = get_perpendicular(n);
+        }
+    });
+}
+
+} // namespace sushi
@@ -0,0 +1,58 @@
+#ifndef SUSHI_MESH_NORMALS_HPP
+#define SUSHI_MESH_NORMALS_HPP
+
+#include "common.hpp"
+#include "gl.hpp"
+#include "thread_pool.hpp"
+
+#include <glm/glm.hpp>
+
+/// Sushi
+namespace sushi {
+
+/// How each triangle contributes to the smooth normals of its vertices.
+enum class normal_weighting {
+    AREA, /** By triangle area. Cheapest, but long thin triangles dominate. */
+    ANGLE, /** By the triangle's angle at the vertex. Independent of how a surface is tessellated. */
+};
+
+/// Computes smooth vertex normals from triangles.
+/// Triangles are front-facing when their vertices are clockwise, as in meshes loaded by `load_obj_file`,
+/// and normals point out of the front face.
+/// Vertices which are not referenced by any triangle, or only by degenerate ones, keep their existing normal.
+/// The result does not depend on the number of threads in the pool.
+/// \param indices Triangle list indices, which must be less than `positions.size()`.
+/// \param positions Vertex positions.
+/// \param normals Receives the unit normal of each vertex. Must be the same size as `positions`.
+/// \param weighting How triangles are weighted.
+/// \param pool Thread pool to run on.
+void generate_normals(
+    span<const GLuint> indices,
+    span<const glm::vec3> positions,
+    span<glm::vec3> normals,
+    normal_weighting weighting,
+    thread_pool& pool);
+
+/// Computes smooth vertex tangents from triangles, following the direction of increasing texture coordinate `u`.
+/// Each tangent is orthogonalized against the vertex's normal.
+/// Vertices which are not referenced by any triangle keep their existing tangent.
+/// The result does not depend on the number of threads in the pool.
+/// \param indices Triangle list indices, which must be less than `positions.size()`.
+/// \param positions Vertex positions.
+/// \param texcoords Vertex texture coordinates.
+/// \param normals Unit vertex normals.
+/// \param tangents Receives the unit tangent of each vertex. Must be the same size as `positions`.
+/// \param weighting How triangles are weighted.
+/// \param pool Thread pool to run on.
+void generate_tangents(
+    span<const GLuint> indices,
+    span<const glm::vec3> positions,
+    span<const glm::vec2> texcoords,
+    span<const glm::vec3> normals,
+    span<glm::vec3> tangents,
+    normal_weighting weighting,
+    thread_pool& pool);
+
+} // namespace sushi
+
+#endif // SUSHI_MESH_NORMALS_HPP
@@ -0,0 +1,700 @@
+#include "mesh_optimizer.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <unordered_set>
+
+namespace sushi {
+
+namespace {
+
+constexpr auto no_triangle = std::numeric_limits<std::size_t>::max();
+
+// Scoring parameters from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+constexpr int forsyth_cache_size = 32;
+constexpr float forsyth_cache_decay_power = 1.5f;
+constexpr float forsyth_last_tri_score = 0.75f;
+constexpr float forsyth_valence_boost_scale = 2.0f;
+constexpr float forsyth_valence_boost_power = 0.5f;
+
+auto get_forsyth_score(int cache_pos, std::size_t remaining_tris) -> float {
+    if (remaining_tris == 0) {
+        return -1.f;
+    }
+
+    auto score = 0.f;
+
+    if (cache_pos >= 0) {
+        if (cache_pos < 3) {
+            // The vertices of the last triangle are penalized, to discourage strips from doubling back.
+            score = forsyth_last_tri_score;
+        } else {
+            auto scale = 1.f / (forsyth_cache_size - 3);
+            score = std::pow(1.f - (cache_pos - 3) * scale, forsyth_cache_decay_power);
+        }
+    }
+
+    score += forsyth_valence_boost_scale * std::pow(float(remaining_tris), -forsyth_valence_boost_power);
+
+    return score;
+}
+
+/// The triangles referencing each vertex, in compressed rows.
+/// Each row holds the triangles not yet emitted first, followed by those already emitted.
+struct vertex_adjacency {
+    std::vector<std::size_t> offsets;
+    std::vector<std::size_t> remaining;
+    std::vector<std::size_t> triangles;
+
+    vertex_adjacency(span<const GLuint> indices, std::size_t num_vertices)
+        : offsets(num_vertices + 1, 0), remaining(num_vertices, 0), triangles(indices.size()) {
+
+        for (auto idx : indices) {
+            ++remaining[idx];
+        }
+
+        for (auto v = std::size_t{0}; v < num_vertices; ++v) {
+            offsets[v + 1] = offsets[v] + remaining[v];
+        }
+
+        auto fill = std::vector<std::size_t>(offsets.begin(), offsets.end() - 1);
+
+        for (auto i = std::size_t{0}; i < indices.size(); ++i) {
+            triangles[fill[indices[i]]++] = i / 3;
+        }
+    }
+
+    auto get_remaining(GLuint v) const -> span<const std::size_t> {
+        return {triangles.data() + offsets[v], remaining[v]};
+    }
+
+    void remove(GLuint v, std::size_t tri) {
+        auto first = triangles.data() + offsets[v];
+        auto last = first + remaining[v];
+        auto iter = std::find(first, last, tri);
+
+        if (iter != last) {
+            std::swap(*iter, *(last - 1));
+            --remaining[v];
+        }
+    }
+};
+
+} // namespace
+
+auto analyze_vertex_cache(span<const GLuint> indices, std::size_t num_vertices, unsigned cache_size)
+    -> vertex_cache_stats {
+
+    vertex_cache_stats stats;
+    stats.num_triangles = indices.size() / 3;
+
+    // A vertex is in the cache if fewer than `cache_size` misses happened since it was loaded.
+    auto timestamps = std::vector<std::size_t>(num_vertices, 0);
+    auto time = std::size_t{cache_size} + 1;
+
+    for (auto idx : indices) {
+        if (timestamps[idx] == 0) {
+            ++stats.num_vertices;
+        }
+
+        if (time - timestamps[idx] > cache_size) {
+            timestamps[idx] = time++;
+            ++stats.num_transformed;
+        }
+    }
+
+    return stats;
+}
+
+void optimize_vertex_cache(span<GLuint> indices, std::size_t num_vertices) {
+    auto num_tris = indices.size() / 3;
+
+    if (num_tris == 0) {
+        return;
+    }
+
+    auto adjacency = vertex_adjacency(indices, num_vertices);
+
+    auto cache_pos = std::vector<int>(num_vertices, -1);
+    auto vertex_scores = std::vector<float>(num_vertices);
+
+    for (auto v = std::size_t{0}; v < num_vertices; ++v) {
+        vertex_scores[v] = get_forsyth_score(-1, adjacency.remaining[v]);
+    }
+
+    auto tri_scores = std::vector<float>(num_tris);
+    auto tri_emitted = std::vector<bool>(num_tris, false);
+    auto best_tri = std::size_t{0};
+
+    for (auto t = std::size_t{0}; t < num_tris; ++t) {
+        const auto tri = indices.data() + t * 3;
+        tri_scores[t] = vertex_scores[tri[0]] + vertex_scores[tri[1]] + vertex_scores[tri[2]];
+        if (tri_scores[t] > tri_scores[best_tri]) {
+            best_tri = t;
+        }
+    }
+
+    auto output = std::vector<GLuint>();
+    output.reserve(indices.size());
+
+    auto cache = std::vector<GLuint>();
+    auto new_cache = std::vector<GLuint>();
+    cache.reserve(forsyth_cache_size + 3);
+    new_cache.reserve(forsyth_cache_size + 3);
+
+    auto next_unemitted = std::size_t{0};
+
+    for (auto emitted = std::size_t{0}; emitted < num_tris; ++emitted) {
+        if (best_tri == no_triangle) {
+            // Nothing in the cache touches a remaining triangle, so restart from the next one in input order.
+            while (tri_emitted[next_unemitted]) {
+                ++next_unemitted;
+            }
+            best_tri = next_unemitted;
+        }
+
+        const auto tri = indices.data() + best_tri * 3;
+
+        output.insert(output.end(), tri, tri + 3);
+        tri_emitted[best_tri] = true;
+
+        new_cache.clear();
+
+        for (auto c = 0; c < 3; ++c) {
+            adjacency.remove(tri[c], best_tri);
+            if (std::find(new_cache.begin(), new_cache.end(), tri[c]) == new_cache.end()) {
+                new_cache.push_back(tri[c]);
+            }
+        }
+
+        for (auto v : cache) {
+            if (std::find(new_cache.begin(), new_cache.end(), v) == new_cache.end()) {
+                new_cache.push_back(v);
+            }
+        }
+
+        for (auto i = std::size_t{0}; i < new_cache.size(); ++i) {
+            auto v = new_cache[i];
+            cache_pos[v] = i < std::size_t(forsyth_cache_size) ? int(i) : -1;
+            vertex_scores[v] = get_forsyth_score(cache_pos[v], adjacency.remaining[v]);
+        }
+
+        // Only triangles touching the cache can have changed score.
+        best_tri = no_triangle;
+        auto best_score = -1.f;
+
+        for (auto v : new_cache) {
+            for (auto t : adjacency.get_remaining(v)) {
+                const auto adj = indices.data() + t * 3;
+                tri_scores[t] = vertex_scores[adj[0]] + vertex_scores[adj[1]] + vertex_scores[adj[2]];
+                if (tri_scores[t] > best_score) {
+                    best_score = tri_scores[t];
+                    best_tri = t;
+                }
+            }
+        }
+
+        if (new_cache.size() > std::size_t(forsyth_cache_size)) {
+            new_cache.resize(forsyth_cache_size);
+        }
+
+        std::swap(cache, new_cache);
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void optimize_overdraw(span<GLuint> indices, span<const glm::vec3> positions) {
+    constexpr auto cache_size = std::size_t{16};
+
+    auto num_tris = indices.size() / 3;
+
+    if (num_tris == 0) {
+        return;
+    }
+
+    struct cluster {
+        std::size_t first_tri;
+        std::size_t num_tris;
+        float sort_key;
+    };
+
+    // Split wherever every vertex of a triangle misses the cache, since the cache is effectively cold there anyway.
+    auto clusters = std::vector<cluster>();
+    auto timestamps = std::vector<std::size_t>(positions.size(), 0);
+    auto time = cache_size + 1;
+
+    for (auto t = std::size_t{0}; t < num_tris; ++t) {
+        auto misses = 0;
+
+        for (auto c = 0; c < 3; ++c) {
+            auto idx = indices[t * 3 + c];
+            if (time - timestamps[idx] > cache_size) {
+                timestamps[idx] = time++;
+                ++misses;
+            }
+        }
+
+        if (clusters.empty() || misses == 3) {
+            clusters.push_back({t, 0, 0.f});
+        }
+
+        ++clusters.back().num_tris;
+    }
+
+    if (clusters.size() < 2) {
+        return;
+    }
+
+    auto get_tri = [&](std::size_t t, glm::vec3& centroid, glm::vec3& normal) {
+        const auto& a = positions[indices[t * 3 + 0]];
+        const auto& b = positions[indices[t * 3 + 1]];
+        const auto& c = positions[indices[t * 3 + 2]];
+        centroid = (a + b + c) / 3.f;
+        normal = glm::cross(b - a, c - a); // Length is twice the area.
+    };
+
+    auto mesh_centroid = glm::vec3{0, 0, 0};
+    auto mesh_area = 0.f;
+
+    for (auto t = std::size_t{0}; t < num_tris; ++t) {
+        glm::vec3 centroid, normal;
+        get_tri(t, centroid, normal);
+        auto area = glm::length(normal);
+        mesh_centroid += centroid * area;
+        mesh_area += area;
+    }
+
+    if (mesh_area > 0) {
+        mesh_centroid /= mesh_area;
+    }
+
+    for (auto& cl : clusters) {
+        auto cluster_centroid = glm::vec3{0, 0, 0};
+        auto cluster_normal = glm::vec3{0, 0, 0};
+        auto cluster_area = 0.f;
+
+        for (auto t = cl.first_tri; t < cl.first_tri + cl.num_tris; ++t) {
+            glm::vec3 centroid, normal;
+            get_tri(t, centroid, normal);
+            auto area = glm::length(normal);
+            cluster_centroid += centroid * area;
+            cluster_normal += normal;
+            cluster_area += area;
+        }
+
+        auto normal_length = glm::length(cluster_normal);
+
+        if (cluster_area > 0 && normal_length > 0) {
+            cluster_centroid /= cluster_area;
+            cl.sort_key = glm::dot(cluster_centroid - mesh_centroid, cluster_normal / normal_length);
+        }
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const cluster& a, const cluster& b) {
+        return a.sort_key > b.sort_key;
+    });
+
+    auto output = std::vector<GLuint>();
+    output.reserve(indices.size());
+
+    for (const auto& cl : clusters) {
+        auto first = indices.begin() + cl.first_tri * 3;
+        output.insert(output.end(), first, first + cl.num_tris * 3);
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
+
+auto optimize_vertex_fetch(span<GLuint> indices, std::size_t num_vertices) -> std::vector<GLuint> {
+    constexpr auto unassigned = std::numeric_limits<GLuint>::max();
+
+    auto remap = std::vector<GLuint>(num_vertices, unassigned);
+    auto next = GLuint{0};
+
+    for (auto& idx : indices) {
+        if (remap[idx] == unassigned) {
+            remap[idx] = next++;
+        }
+        idx = remap[idx];
+    }
+
+    for (auto& r : remap) {
+        if (r == unassigned) {
+            r = next++;
+        }
+    }
+
+    return remap;
+}
+
+namespace {
+
+/// A sum of squared distances to planes, weighted by the area the planes came from.
+struct quadric {
+    double a2 = 0, b2 = 0, c2 = 0, ab = 0, ac = 0, bc = 0, ad = 0, bd = 0, cd = 0, d2 = 0;
+    double weight = 0;
+
+    void add_plane(double a, double b, double c, double d, double w) {
+        a2 += w * a * a; b2 += w * b * b; c2 += w * c * c;
+        ab += w * a * b; ac += w * a * c; bc += w * b * c;
+        ad += w * a * d; bd += w * b * d; cd += w * c * d;
+        d2 += w * d * d;
+        weight += w;
+    }
+
+    void add(const quadric& q) {
+        a2 += q.a2; b2 += q.b2; c2 += q.c2;
+        ab += q.ab; ac += q.ac; bc += q.bc;
+        ad += q.ad; bd += q.bd; cd += q.cd;
+        d2 += q.d2;
+        weight += q.weight;
+    }
+
+    /// Gets the mean squared distance from `p` to the planes.
+    auto get_error(const glm::vec3& p) const -> double {
+        if (weight <= 0) {
+            return 0;
+        }
+
+        double x = p.x, y = p.y, z = p.z;
+        auto sum =
+            a2 * x * x + b2 * y * y + c2 * z * z +
+            2 * (ab * x * y + ac * x * z + bc * y * z) +
+            2 * (ad * x + bd * y + cd * z) +
+            d2;
+
+        return std::max(sum / weight, 0.0);
+    }
+};
+
+auto get_edge_key(GLuint a, GLuint b) -> std::uint64_t {
+    return (std::uint64_t(a) << 32) | b;
+}
+
+/// Checks whether moving `from` onto `to` would flip any remaining triangle around `from`.
+bool has_flips(
+    const vertex_adjacency& adjacency,
+    span<const GLuint> indices,
+    span<const glm::vec3> positions,
+    GLuint from,
+    GLuint to) {
+
+    for (auto t : adjacency.get_remaining(from)) {
+        const auto tri = indices.data() + t * 3;
+
+        if (tri[0] == to || tri[1] == to || tri[2] == to) {
+            continue; // Becomes degenerate and is removed.
+        }
+
+        glm::vec3 before[3];
+        glm::vec3 after[3];
+
+        for (auto c = 0; c < 3; ++c) {
+            before[c] = positions[tri[c]];
+            after[c] = positions[tri[c] == from ? to : tri[c]];
+        }
+
+        auto n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+        auto n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+
+        if (glm::dot(n0, n1) <= 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace
+
+auto simplify(
+    span<const GLuint> indices,
+    span<const glm::vec3> positions,
+    std::size_t target_index_count,
+    float target_error,
+    float* result_error) -> std::vector<GLuint> {
+
+    const auto num_vertices = positions.size();
+
+    auto result = std::vector<GLuint>(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+    auto quadrics = std::vector<quadric>(num_vertices);
+    auto locked = std::vector<bool>(num_vertices, false);
+    auto max_error = 0.0;
+
+    {
+        auto edges = std::unordered_set<std::uint64_t>();
+        edges.reserve(result.size());
+
+        for (auto i = std::size_t{0}; i < result.size(); i += 3) {
+            const auto tri = result.data() + i;
+            const auto& p0 = positions[tri[0]];
+            auto normal = glm::cross(positions[tri[1]] - p0, positions[tri[2]] - p0);
+            auto length = glm::length(normal);
+
+            if (length > 0) {
+                normal = normal / length;
+                auto d = -glm::dot(normal, p0);
+                for (auto c = 0; c < 3; ++c) {
+                    quadrics[tri[c]].add_plane(normal.x, normal.y, normal.z, d, length * 0.5);
+                }
+            }
+
+            for (auto c = 0; c < 3; ++c) {
+                edges.insert(get_edge_key(tri[c], tri[(c + 1) % 3]));
+            }
+        }
+
+        // An edge without a twin is on a border, such as a hole or an attribute seam.
+        for (auto i = std::size_t{0}; i < result.size(); i += 3) {
+            const auto tri = result.data() + i;
+            for (auto c = 0; c < 3; ++c) {
+                auto a = tri[c];
+                auto b = tri[(c + 1) % 3];
+                if (!edges.count(get_edge_key(b, a))) {
+                    locked[a] = true;
+                    locked[b] = true;
+                }
+            }
+        }
+    }
+
+    struct collapse {
+        GLuint from;
+        GLuint to;
+        double error;
+    };
+
+    const auto error_limit = double(target_error) * target_error;
+
+    auto collapses = std::vector<collapse>();
+    auto remap = std::vector<GLuint>(num_vertices);
+    auto touched = std::vector<bool>(num_vertices);
+
+    // Each pass performs the cheapest independent collapses, then rebuilds the triangle list.
+    while (result.size() > target_index_count) {
+        collapses.clear();
+
+        for (auto i = std::size_t{0}; i < result.size(); i += 3) {
+            const auto tri = result.data() + i;
+
+            for (auto c = 0; c < 3; ++c) {
+                auto a = tri[c];
+                auto b = tri[(c + 1) % 3];
+
+                // Interior edges appear once in each direction, so this visits each of them once.
+                if (a > b || (locked[a] && locked[b])) {
+                    continue;
+                }
+
+                auto q = quadrics[a];
+                q.add(quadrics[b]);
+
+                auto error_ab = locked[a] ? error_limit + 1 : q.get_error(positions[b]);
+                auto error_ba = locked[b] ? error_limit + 1 : q.get_error(positions[a]);
+
+                if (error_ab <= error_ba && error_ab <= error_limit) {
+                    collapses.push_back({a, b, error_ab});
+                } else if (error_ba < error_ab && error_ba <= error_limit) {
+                    collapses.push_back({b, a, error_ba});
+                }
+            }
+        }
+
+        if (collapses.empty()) {
+            break;
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const collapse& a, const collapse& b) {
+            return a.error < b.error;
+        });
+
+        auto adjacency = vertex_adjacency(span<const GLuint>(result), num_vertices);
+
+        for (auto v = std::size_t{0}; v < num_vertices; ++v) {
+            remap[v] = GLuint(v);
+        }
+
+        std::fill(touched.begin(), touched.end(), false);
+
+        auto num_indices = result.size();
+        auto num_collapsed = std::size_t{0};
+
+        for (const auto& c : collapses) {
+            if (num_indices <= target_index_count) {
+                break;
+            }
+
+            if (touched[c.from] || touched[c.to]) {
+                continue;
+            }
+
+            if (has_flips(adjacency, span<const GLuint>(result), positions, c.from, c.to)) {
+                continue;
+            }
+
+            // The whole neighborhood is locked for the rest of the pass, so that flip checks stay valid.
+            for (auto t : adjacency.get_remaining(c.from)) {
+                const auto tri = result.data() + t * 3;
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                    num_indices -= 3;
+                }
+            }
+
+            remap[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            max_error = std::max(max_error, c.error);
+            ++num_collapsed;
+        }
+
+        if (num_collapsed == 0) {
+            break;
+        }
+
+        auto out = std::size_t{0};
+
+        for (auto i = std::size_t{0}; i < result.size(); i += 3) {
+            auto a = remap[result[i + 0]];
+            auto b = remap[result[i + 1]];
+            auto c = remap[result[i + 2]];
+
+            if (a != b && b != c && c != a) {
+                result[out++] = a;
+                result[out++] = b;
+                result[out++] = c;
+            }
+        }
+
+        result.resize(out);
+    }
+
+    if (result_error) {
+        *result_error = float(std::sqrt(max_error));
+    }
+
+    return result;
+}
+
+auto generate_lods(span<const GLuint> indices, span<const glm::vec3> positions, const lod_options& options)
+    -> std::vector<lod_level> {
+
+    auto levels = std::vector<lod_level>();
+
+    if (options.max_lods == 0 || indices.size() < 3) {
+        return levels;
+    }
+
+    auto min = positions[indices[0]];
+    auto max = min;
+
+    for (auto idx : indices) {
+        min = glm::min(min, positions[idx]);
+        max = glm::max(max, positions[idx]);
+    }
+
+    auto error_limit = options.max_error * glm::length(max - min);
+    auto prev_count = indices.size() / 3 * 3;
+
+    for (auto i = std::size_t{0}; i < options.max_lods; ++i) {
+        auto target_count = std::size_t(prev_count * options.reduction) / 3 * 3;
+        auto error = 0.f;
+
+        // Each level is simplified from the original, so its error is measured against full detail.
+        auto lod = simplify(indices, positions, target_count, error_limit, &error);
+
+        if (lod.empty() || lod.size() >= prev_count) {
+            break;
+        }
+
+        prev_count = lod.size();
+        levels.push_back({std::move(lod), error});
+    }
+
+    return levels;
+}
+
+auto optimize_meshes(iqm::iqm_data& data) -> mesh_optimization_report {
+    mesh_optimization_report report;
+
+    auto& arrays = data.vertexarrays;
+    auto total_vertices = arrays.position.size() / 3;
+
+    if (total_vertices == 0) {
+        return report;
+    }
+
+    auto indices = std::vector<GLuint>();
+
+    for (const auto& mesh : data.meshes) {
+        auto first_vertex = std::size_t{mesh.first_vertex};
+        auto num_vertices = std::size_t{mesh.num_vertexes};
+        auto first_tri = data.triangles.begin() + mesh.first_triangle;
+
+        if (first_vertex + num_vertices > total_vertices) {
+            std::cerr << "sushi::optimize_meshes: Mesh \"" << mesh.name << "\" has an invalid vertex range, skipping.\n";
+            continue;
+        }
+
+        indices.clear();
+
+        auto valid = true;
+
+        for (auto iter = first_tri; iter != first_tri + mesh.num_triangles; ++iter) {
+            for (auto v : iter->verts) {
+                if (v < int(first_vertex) || std::size_t(v) - first_vertex >= num_vertices) {
+                    valid = false;
+                }
+                indices.push_back(GLuint(v - int(first_vertex)));
+            }
+        }
+
+        if (!valid) {
+            std::cerr << "sushi::optimize_meshes: Mesh \"" << mesh.name << "\" has out-of-range indices, skipping.\n";
+            continue;
+        }
+
+        auto index_span = span<GLuint>(indices);
+
+        report.before += analyze_vertex_cache(index_span, num_vertices);
+
+        optimize_vertex_cache(index_span, num_vertices);
+
+        auto positions = reinterpret_cast<const glm::vec3*>(arrays.position.data()) + first_vertex;
+        optimize_overdraw(index_span, span<const glm::vec3>(positions, num_vertices));
+
+        auto remap = optimize_vertex_fetch(index_span, num_vertices);
+
+        auto remap_array = [&](auto& arr) {
+            if (!arr.empty()) {
+                auto components = arr.size() / total_vertices;
+                auto first = arr.data() + first_vertex * components;
+                remap_vertex_array(span(first, num_vertices * components), components, span<const GLuint>(remap));
+            }
+        };
+
+        remap_array(arrays.position);
+        remap_array(arrays.texcoord);
+        remap_array(arrays.normal);
+        remap_array(arrays.tangent);
+        remap_array(arrays.blendindexes);
+        remap_array(arrays.blendweights);
+        remap_array(arrays.color);
+
+        report.after += analyze_vertex_cache(index_span, num_vertices);
+
+        auto src = indices.begin();
+
+        for (auto iter = first_tri; iter != first_tri + mesh.num_triangles; ++iter) {
+            for (auto& v : iter->verts) {
+                v = int(*src++ + first_vertex);
+            }
+        }
+    }
+
+    return report;
+}
+
+} // namespace sushi
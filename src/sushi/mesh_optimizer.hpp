@@ -0,0 +1,131 @@
+#ifndef SUSHI_MESH_OPTIMIZER_HPP
+#define SUSHI_MESH_OPTIMIZER_HPP
+
+#include "common.hpp"
+#include "gl.hpp"
+#include "iqm.hpp"
+#include "mesh_group.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/// Sushi
+namespace sushi {
+
+/// Post-transform vertex cache statistics for an index buffer, assuming a FIFO cache.
+struct vertex_cache_stats {
+    std::size_t num_triangles = 0;
+    std::size_t num_vertices = 0; /** Distinct vertices referenced by the indices. */
+    std::size_t num_transformed = 0; /** Vertex shader invocations. */
+
+    /// Average cache miss ratio: transformed vertices per triangle.
+    /// Ranges from 3 (no reuse) down to about 0.5 for large regular grids.
+    auto get_acmr() const -> float { return num_triangles ? float(num_transformed) / num_triangles : 0.f; }
+
+    /// Average transformed vertex ratio: transformed vertices per distinct vertex. 1 is optimal.
+    auto get_atvr() const -> float { return num_vertices ? float(num_transformed) / num_vertices : 0.f; }
+
+    auto operator+=(const vertex_cache_stats& other) -> vertex_cache_stats& {
+        num_triangles += other.num_triangles;
+        num_vertices += other.num_vertices;
+        num_transformed += other.num_transformed;
+        return *this;
+    }
+};
+
+/// Vertex cache statistics of a set of meshes, before and after optimization.
+struct mesh_optimization_report {
+    vertex_cache_stats before;
+    vertex_cache_stats after;
+};
+
+/// Simulates a FIFO post-transform vertex cache over a triangle list.
+/// \param indices Triangle list indices.
+/// \param num_vertices Number of vertices the indices refer to.
+/// \param cache_size Number of vertices the simulated cache holds.
+/// \return The statistics.
+auto analyze_vertex_cache(span<const GLuint> indices, std::size_t num_vertices, unsigned cache_size = 16)
+    -> vertex_cache_stats;
+
+/// Reorders triangles to improve post-transform vertex cache hits, using Forsyth's algorithm.
+/// The winding of each triangle is preserved.
+/// \param indices Triangle list indices, reordered in place.
+/// \param num_vertices Number of vertices the indices refer to.
+void optimize_vertex_cache(span<GLuint> indices, std::size_t num_vertices);
+
+/// Reorders triangles to reduce overdraw, while mostly keeping their vertex cache order.
+/// The triangles are split into clusters wherever the vertex cache would restart,
+/// and clusters facing away from the mesh's center are moved to the front, so that they occlude the rest.
+/// This should be run after `optimize_vertex_cache`.
+/// \param indices Triangle list indices, reordered in place.
+/// \param positions Vertex positions.
+void optimize_overdraw(span<GLuint> indices, span<const glm::vec3> positions);
+
+/// Renumbers vertices in the order they are first referenced, to improve vertex fetch locality.
+/// Vertices which are never referenced are placed at the end, in their original order.
+/// This should be run last, since it depends on the triangle order.
+/// \param indices Triangle list indices, renumbered in place.
+/// \param num_vertices Number of vertices the indices refer to.
+/// \return The new index of each vertex, for use with `remap_vertex_array`.
+auto optimize_vertex_fetch(span<GLuint> indices, std::size_t num_vertices) -> std::vector<GLuint>;
+
+/// Moves each vertex of an attribute array to its new index.
+/// \param arr The attribute array, with `components` elements per vertex. Empty arrays are left alone.
+/// \param components Number of elements per vertex.
+/// \param remap The new index of each vertex, as returned by `optimize_vertex_fetch`.
+template <typename T>
+void remap_vertex_array(span<T> arr, std::size_t components, span<const GLuint> remap) {
+    if (arr.empty()) {
+        return;
+    }
+
+    auto old = std::vector<T>(arr.begin(), arr.end());
+
+    for (auto v = std::size_t{0}; v < remap.size(); ++v) {
+        std::copy_n(old.data() + v * components, components, arr.data() + remap[v] * components);
+    }
+}
+
+/// Simplifies a mesh by collapsing edges in order of quadric error, without creating or moving vertices.
+/// Vertices on open borders (including attribute seams) are never collapsed, so no cracks are introduced.
+/// \param indices Triangle list indices.
+/// \param positions Vertex positions.
+/// \param target_index_count Number of indices to stop at.
+/// \param target_error Largest collapse error allowed, in the same units as `positions`.
+/// \param result_error If not null, receives the largest collapse error actually used.
+/// \return Indices of the simplified triangles, referring to the same vertices.
+auto simplify(
+    span<const GLuint> indices,
+    span<const glm::vec3> positions,
+    std::size_t target_index_count,
+    float target_error,
+    float* result_error = nullptr) -> std::vector<GLuint>;
+
+/// A simplified version of a mesh.
+struct lod_level {
+    std::vector<GLuint> indices;
+    float error; /** Largest geometric deviation from the original mesh, in the same units as its positions. */
+};
+
+/// Generates a chain of successively simplified index buffers.
+/// Each level targets `options.reduction` times the triangles of the previous one.
+/// Generation stops early once a level would exceed the error limit or fails to reduce the triangle count.
+/// \param indices Triangle list indices of the full detail mesh.
+/// \param positions Vertex positions.
+/// \param options The chain's length and error limit.
+/// \return The levels, from most to least detailed, not including the original.
+auto generate_lods(span<const GLuint> indices, span<const glm::vec3> positions, const lod_options& options)
+    -> std::vector<lod_level>;
+
+/// Optimizes the triangle and vertex order of every mesh in IQM data, prior to `load_meshes`.
+/// Each mesh is optimized within its own vertex range, so the vertex ranges of meshes must not overlap.
+/// \param data The IQM data, modified in place.
+/// \return The combined vertex cache statistics of all meshes.
+auto optimize_meshes(iqm::iqm_data& data) -> mesh_optimization_report;
+
+} // namespace sushi
+
+#endif // SUSHI_MESH_OPTIMIZER_HPP
@@ -0,0 +1,178 @@
+#include "mesh_registry.hpp"
+
+#include "mesh_utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace sushi {
+
+namespace {
+
+/// Hashes a block of memory with MurmurHash64A, which processes 8 bytes at a time.
+auto hash_bytes(const void* data, std::size_t size) -> std::uint64_t {
+    constexpr auto m = std::uint64_t{0xc6a4a7935bd1e995};
+    constexpr auto r = 47;
+
+    auto bytes = static_cast<const unsigned char*>(data);
+    auto h = std::uint64_t{0x8445d61a4e774912} ^ (size * m);
+
+    const auto num_words = size / 8;
+
+    for (auto i = std::size_t{0}; i < num_words; ++i) {
+        std::uint64_t k;
+        std::memcpy(&k, bytes + i * 8, 8);
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    const auto tail = bytes + num_words * 8;
+
+    switch (size & 7) {
+        case 7: h ^= std::uint64_t(tail[6]) << 48; [[fallthrough]];
+        case 6: h ^= std::uint64_t(tail[5]) << 40; [[fallthrough]];
+        case 5: h ^= std::uint64_t(tail[4]) << 32; [[fallthrough]];
+        case 4: h ^= std::uint64_t(tail[3]) << 24; [[fallthrough]];
+        case 3: h ^= std::uint64_t(tail[2]) << 16; [[fallthrough]];
+        case 2: h ^= std::uint64_t(tail[1]) << 8; [[fallthrough]];
+        case 1:
+            h ^= std::uint64_t(tail[0]);
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+} // namespace
+
+auto mesh_registry::get_buffer(GLenum target, const void* data, std::size_t size)
+    -> std::shared_ptr<const unique_buffer> {
+    if (size == 0) {
+        return nullptr;
+    }
+
+    auto key = stream_key{hash_bytes(data, size), size, target};
+    auto [first, last] = streams.equal_range(key);
+
+    // Different streams can share a hash, so only a byte-for-byte match is reused.
+    for (auto iter = first; iter != last; ++iter) {
+        if (auto buf = iter->second.buffer.lock()) {
+            if (std::memcmp(iter->second.bytes.data(), data, size) == 0) {
+                return buf;
+            }
+        }
+    }
+
+    auto buf = std::make_shared<const unique_buffer>(_detail::load_buffer(target, data, size));
+    auto bytes = static_cast<const unsigned char*>(data);
+    streams.emplace(key, stream_entry{std::vector<unsigned char>(bytes, bytes + size), buf});
+
+    if (streams.size() >= prune_threshold) {
+        for (auto iter = streams.begin(); iter != streams.end();) {
+            if (iter->second.buffer.expired()) {
+                iter = streams.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+
+        prune_threshold = std::max(prune_threshold, streams.size() * 2);
+    }
+
+    return buf;
+}
+
+auto mesh_registry::upload(const mesh_blob& blob) -> mesh_group {
+    using _detail::bind_attrib;
+
+    static const unique_buffer no_buffer;
+
+    mesh_group group;
+    group.options = blob.options;
+    group.meshes = blob.meshes;
+    group.bounds = blob.bounds;
+    group.index_type = blob.index_type;
+
+    // Buffers are all created before the VAO is bound, since creating one binds it to its target.
+    const auto& format = blob.format;
+    const auto interleaved = blob.options.layout == vertex_layout::INTERLEAVED;
+
+    std::array<std::shared_ptr<const unique_buffer>, 7> attrib_buffers;
+
+    if (interleaved) {
+        attrib_buffers[0] = get_buffer(GL_ARRAY_BUFFER, blob.vertex_data.data(), blob.vertex_data.size());
+    } else {
+        for (auto i = std::size_t{0}; i < format.num_attribs; ++i) {
+            if (format.attribs[i].data) {
+                const auto& data = blob.attrib_data[i];
+                attrib_buffers[i] = get_buffer(GL_ARRAY_BUFFER, data.data(), data.size());
+            }
+        }
+    }
+
+    auto index_buffer = get_buffer(GL_ELEMENT_ARRAY_BUFFER, blob.index_data.data(), blob.index_data.size());
+
+    group.vao = make_unique_vertex_array();
+    glBindVertexArray(group.vao.get());
+    SUSHI_DEFER { glBindVertexArray(0); };
+
+    if (index_buffer) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer->get());
+    }
+
+    const auto& layout = format.interleaved;
+
+    for (auto i = std::size_t{0}; i < format.num_attribs; ++i) {
+        const auto& attr = format.attribs[i];
+        const auto& shared = interleaved ? attrib_buffers[0] : attrib_buffers[i];
+        const auto& buf = attr.data && shared ? *shared : no_buffer;
+
+        if (interleaved) {
+            auto offset = layout.offsets[static_cast<GLuint>(attr.loc)];
+            bind_attrib(attr.loc, buf, attr.size, attr.type, attr.normalize, layout.stride, offset, attr.init);
+        } else {
+            bind_attrib(attr.loc, buf, attr.size, attr.type, attr.normalize, 0, 0, attr.init);
+        }
+    }
+
+    for (auto& buf : attrib_buffers) {
+        if (buf) {
+            group.shared_buffers.push_back(std::move(buf));
+        }
+    }
+
+    if (index_buffer) {
+        group.shared_buffers.push_back(std::move(index_buffer));
+    }
+
+    return group;
+}
+
+auto mesh_registry::get_stats() const -> mesh_registry_stats {
+    mesh_registry_stats stats;
+
+    for (const auto& [key, entry] : streams) {
+        auto refs = std::size_t(entry.buffer.use_count());
+
+        if (refs > 0) {
+            ++stats.num_buffers;
+            stats.bytes_uploaded += key.size;
+            stats.bytes_requested += key.size * refs;
+        }
+    }
+
+    stats.bytes_saved = stats.bytes_requested - stats.bytes_uploaded;
+
+    return stats;
+}
+
+} // namespace sushi
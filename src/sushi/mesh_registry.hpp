@@ -0,0 +1,69 @@
+#ifndef SUSHI_MESH_REGISTRY_HPP
+#define SUSHI_MESH_REGISTRY_HPP
+
+#include "gl.hpp"
+#include "mesh_group.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/// Sushi
+namespace sushi {
+
+/// GPU memory shared by the groups of a mesh_registry.
+struct mesh_registry_stats {
+    std::size_t num_buffers = 0; /** Distinct buffers still referenced by any group. */
+    std::size_t bytes_uploaded = 0; /** Total size of those buffers. */
+    std::size_t bytes_requested = 0; /** Total size the referencing groups would have used without sharing. */
+    std::size_t bytes_saved = 0; /** `bytes_requested - bytes_uploaded`. */
+};
+
+/// Uploads mesh groups, sharing GL buffers between groups whose vertex or index data is identical.
+/// Each attribute stream and the index stream is looked up by a 64-bit hash of its contents,
+/// so the same prop loaded from many levels only occupies GPU memory once.
+/// A CPU copy of each uploaded stream is kept, so that streams whose hashes collide are never shared.
+/// Shared buffers are reference counted by the groups using them, and are deleted with the last of those groups.
+/// Must only be used on the GL context's thread.
+class mesh_registry {
+public:
+    /// Creates GL buffers and a VAO from a baked blob, reusing buffers with identical contents where possible.
+    /// Each group still gets its own VAO.
+    /// \param blob The baked data, from e.g. `bake_meshes` or `bake_obj_file`.
+    /// \return The meshes, drawn the same as those from `sushi::upload`.
+    auto upload(const mesh_blob& blob) -> mesh_group;
+
+    /// Measures how much GPU memory sharing has saved across every group still alive.
+    auto get_stats() const -> mesh_registry_stats;
+
+private:
+    struct stream_key {
+        std::uint64_t hash;
+        std::size_t size;
+        GLenum target;
+
+        auto operator==(const stream_key& other) const -> bool {
+            return hash == other.hash && size == other.size && target == other.target;
+        }
+    };
+
+    struct stream_key_hash {
+        auto operator()(const stream_key& key) const -> std::size_t { return std::size_t(key.hash); }
+    };
+
+    struct stream_entry {
+        std::vector<unsigned char> bytes; /** Contents of the buffer, compared with new streams of the same key. */
+        std::weak_ptr<const unique_buffer> buffer;
+    };
+
+    auto get_buffer(GLenum target, const void* data, std::size_t size) -> std::shared_ptr<const unique_buffer>;
+
+    std::unordered_multimap<stream_key, stream_entry, stream_key_hash> streams;
+    std::size_t prune_threshold = 64; /** Expired streams are removed once the map grows to this size. */
+};
+
+} // namespace sushi
+
+#endif // SUSHI_MESH_REGISTRY_HPP
@@ -3,32 +3,586 @@
 
 #include "gl.hpp"
 #include "attrib_location.hpp"
+#include "common.hpp"
+#include "mesh_group.hpp"
+#include "mesh_optimizer.hpp"
+#include "vertex_encoding.hpp"
 
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
 #include <vector>
 
 namespace sushi {
 
 namespace _detail {
 
-template <typename T>
-auto load_buffer(const std::vector<T>& arr) -> unique_buffer {
-    if (!arr.empty()) {
-        auto buf = make_unique_buffer();
-        glBindBuffer(GL_ARRAY_BUFFER, buf.get());
-        glBufferData(GL_ARRAY_BUFFER, arr.size() * sizeof(arr[0]), &arr[0], GL_STATIC_DRAW);
-        return buf;
-    } else {
+/// Creates a buffer holding a copy of `size` bytes of `data`.
+inline auto load_buffer(GLenum target, const void* data, std::size_t size) -> unique_buffer {
+    if (size == 0) {
+        return nullptr;
+    }
+
+    auto buf = make_unique_buffer();
+    glBindBuffer(target, buf.get());
+    glBufferData(target, size, data, GL_STATIC_DRAW);
+    return buf;
+}
+
+/// Creates a buffer with room for `capacity` bytes, holding a copy of the first `size` bytes of `data`.
+inline auto load_buffer(GLenum target, const void* data, std::size_t size, std::size_t capacity, GLenum usage)
+    -> unique_buffer {
+    if (capacity == 0) {
+        return nullptr;
+    }
+
+    auto buf = make_unique_buffer();
+    glBindBuffer(target, buf.get());
+    glBufferData(target, capacity, nullptr, usage);
+
+    if (size > 0) {
+        glBufferSubData(target, 0, size, data);
+    }
+
+    return buf;
+}
+
+/// Creates a buffer of `size` bytes and fills it by calling `fill(void* dst)`.
+/// Where supported, `fill` writes directly into mapped buffer memory, so no CPU-side copy of the data is needed.
+template <typename F>
+auto stream_buffer(GLenum target, std::size_t size, F&& fill) -> unique_buffer {
+    if (size == 0) {
         return nullptr;
     }
+
+    auto buf = make_unique_buffer();
+    glBindBuffer(target, buf.get());
+
+#ifndef __EMSCRIPTEN__
+    glBufferData(target, size, nullptr, GL_STATIC_DRAW);
+
+    // The contents of a mapped buffer can be lost (e.g. on a display mode change), in which case unmapping fails.
+    // Mapping itself can fail too (e.g. when out of memory), so after a few attempts the data goes through a copy instead.
+    constexpr auto max_map_attempts = 3;
+
+    for (auto attempt = 0; attempt < max_map_attempts; ++attempt) {
+        auto dst = glMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+        if (!dst) {
+            break;
+        }
+
+        fill(dst);
+
+        if (glUnmapBuffer(target) == GL_TRUE) {
+            return buf;
+        }
+    }
+#endif
+
+    auto staging = std::vector<unsigned char>(size);
+    fill(static_cast<void*>(staging.data()));
+    glBufferData(target, size, staging.data(), GL_STATIC_DRAW);
+
+    return buf;
+}
+
+/// Texture unit of the `BonePalette` sampler in `assets/vert.glsl`.
+/// Samplers of different types may not share a unit, even when unused, so every draw points the sampler here,
+/// rather than leaving it on unit 0 with the diffuse texture.
+constexpr GLint bone_palette_unit = 13;
+
+/// Points the current program's `BonePalette` sampler at `bone_palette_unit`, if it has one.
+inline void set_bone_palette_unit(GLint program) {
+    glUniform1i(glGetUniformLocation(program, "BonePalette"), bone_palette_unit);
+}
+
+/// Gets the buffer which holds an attribute when using `vertex_layout::SEPARATE`.
+inline auto get_attrib_buffer(mesh_group& group, attrib_location loc) -> unique_buffer& {
+    switch (loc) {
+        case attrib_location::POSITION: return group.position_buffer;
+        case attrib_location::TEXCOORD: return group.texcoord_buffer;
+        case attrib_location::NORMAL: return group.normal_buffer;
+        case attrib_location::TANGENT: return group.tangent_buffer;
+        case attrib_location::BLENDINDICES: return group.blendindices_buffer;
+        case attrib_location::BLENDWEIGHTS: return group.blendweights_buffer;
+        case attrib_location::COLOR: return group.color_buffer;
+    }
+    return group.position_buffer;
 }
 
+inline auto get_attrib_buffer(const mesh_group& group, attrib_location loc) -> const unique_buffer& {
+    return get_attrib_buffer(const_cast<mesh_group&>(group), loc);
+}
+
+/// Gets the format an attribute is stored in under the given options.
+inline auto get_encoded_source(const attrib_source& src, const mesh_options& options) -> attrib_source {
+    auto rv = src;
+
+    if (src.type != GL_FLOAT) {
+        return rv;
+    }
+
+    switch (src.loc) {
+        case attrib_location::TEXCOORD:
+            switch (options.texcoords) {
+                case texcoord_format::FLOAT: break;
+                case texcoord_format::HALF_FLOAT: rv.type = GL_HALF_FLOAT; rv.normalize = GL_FALSE; break;
+                case texcoord_format::UNORM16: rv.type = GL_UNSIGNED_SHORT; rv.normalize = GL_TRUE; break;
+            }
+            break;
+        case attrib_location::NORMAL:
+        case attrib_location::TANGENT:
+            if (options.octahedral_normals && src.size == 3) {
+                rv.size = 2;
+                rv.type = GL_SHORT;
+                rv.normalize = GL_TRUE;
+            }
+            break;
+        case attrib_location::COLOR:
+            if (options.unorm8_colors) {
+                rv.type = GL_UNSIGNED_BYTE;
+                rv.normalize = GL_TRUE;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return rv;
+}
+
+/// Converts an attribute array from one format into another, writing each element `dst_stride` bytes apart.
+/// Only conversions produced by `get_encoded_source` are supported.
+inline void convert_attrib(
+    const attrib_source& from,
+    const void* src,
+    const attrib_source& to,
+    void* dst,
+    std::size_t dst_stride,
+    std::size_t num_vertices) {
+
+    auto in = static_cast<const unsigned char*>(src);
+    auto out = static_cast<unsigned char*>(dst);
+    auto from_size = get_attrib_size(from);
+    auto to_size = get_attrib_size(to);
+
+    if (from.type == to.type && from.size == to.size) {
+        if (dst_stride == to_size) {
+            std::memcpy(out, in, to_size * num_vertices);
+        } else {
+            for (auto v = std::size_t{0}; v < num_vertices; ++v) {
+                std::memcpy(out + v * dst_stride, in + v * from_size, to_size);
+            }
+        }
+        return;
+    }
+
+    // Every encoding starts from 32-bit floats.
+    float f[4];
+
+    for (auto v = std::size_t{0}; v < num_vertices; ++v) {
+        std::memcpy(f, in + v * from_size, from_size);
+
+        auto o = out + v * dst_stride;
+
+        if (to.size == 2 && from.size == 3) {
+            auto e = encode_octahedral(f[0], f[1], f[2]);
+            std::int16_t q[2] = {quantize_snorm<std::int16_t>(e[0]), quantize_snorm<std::int16_t>(e[1])};
+            std::memcpy(o, q, sizeof(q));
+        } else {
+            for (auto c = 0; c < to.size; ++c) {
+                switch (to.type) {
+                    case GL_HALF_FLOAT: {
+                        auto h = glm::packHalf1x16(f[c]);
+                        std::memcpy(o + c * 2, &h, 2);
+                        break;
+                    }
+                    case GL_UNSIGNED_SHORT: {
+                        auto q = quantize_unorm<std::uint16_t>(f[c]);
+                        std::memcpy(o + c * 2, &q, 2);
+                        break;
+                    }
+                    case GL_UNSIGNED_BYTE: {
+                        o[c] = quantize_unorm<std::uint8_t>(f[c]);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// Gets the formats attributes are stored in under the given options.
+inline auto make_vertex_encoding(span<const attrib_source> sources, const mesh_options& options) -> vertex_encoding {
+    vertex_encoding format;
+    format.num_attribs = sources.size();
+
+    for (auto i = std::size_t{0}; i < sources.size(); ++i) {
+        format.attribs[i] = get_encoded_source(sources[i], options);
+    }
+
+    format.interleaved = make_interleaved_layout(format.get_attribs());
+
+    return format;
+}
+
+/// Writes vertex data in the encodings of `format`, in the given layout.
+/// \param fetch Called as `fetch(i, dst)`, must write the data of `sources[i]`, in its original format, to `dst`.
+/// \param store Called as `store(i, size, fill)` once per buffer, must call `fill(void* dst)` with `size` bytes of storage.
+/// `i` is the index of the attribute the buffer holds, or `sources.size()` for the interleaved buffer.
+template <typename Fetch, typename Store>
+void write_vertex_data(
+    const vertex_encoding& format,
+    vertex_layout layout,
+    span<const attrib_source> sources,
+    std::size_t num_vertices,
+    Fetch&& fetch,
+    Store&& store) {
+
+    auto scratch = std::vector<unsigned char>();
+
+    auto write_attrib = [&](std::size_t i, unsigned char* dst, std::size_t stride) {
+        const auto& from = sources[i];
+        const auto& to = format.attribs[i];
+
+        if (from.type == to.type && from.size == to.size && stride == get_attrib_size(to)) {
+            fetch(i, static_cast<void*>(dst));
+        } else {
+            scratch.resize(get_attrib_size(from) * num_vertices);
+            fetch(i, static_cast<void*>(scratch.data()));
+            convert_attrib(from, scratch.data(), to, dst, stride, num_vertices);
+        }
+    };
+
+    if (layout == vertex_layout::INTERLEAVED) {
+        const auto& interleaved = format.interleaved;
+        store(sources.size(), interleaved.stride * num_vertices, [&](void* dst) {
+            for (auto i = std::size_t{0}; i < sources.size(); ++i) {
+                if (sources[i].data) {
+                    auto offset = interleaved.offsets[static_cast<GLuint>(sources[i].loc)];
+                    write_attrib(i, static_cast<unsigned char*>(dst) + offset, interleaved.stride);
+                }
+            }
+        });
+    } else {
+        for (auto i = std::size_t{0}; i < sources.size(); ++i) {
+            if (sources[i].data) {
+                auto size = get_attrib_size(format.attribs[i]);
+                store(i, size * num_vertices, [&](void* dst) {
+                    write_attrib(i, static_cast<unsigned char*>(dst), size);
+                });
+            }
+        }
+    }
+}
+
+/// Uploads vertex data into the group, in the layout and encodings given by the group's options.
+/// \param fetch Called as `fetch(i, dst)`, must write the data of `sources[i]`, in its original format, to `dst`.
+/// \return The formats the attributes were stored in.
+template <typename Fetch>
+auto load_vertex_buffers(
+    mesh_group& group,
+    span<const attrib_source> sources,
+    std::size_t num_vertices,
+    Fetch&& fetch) -> vertex_encoding {
+
+    auto format = make_vertex_encoding(sources, group.options);
+
+    write_vertex_data(format, group.options.layout, sources, num_vertices, fetch,
+        [&](std::size_t i, std::size_t size, auto&& fill) {
+            auto& buf = i < sources.size() ? get_attrib_buffer(group, sources[i].loc) : group.vertex_buffer;
+            buf = stream_buffer(GL_ARRAY_BUFFER, size, fill);
+        });
+
+    return format;
+}
+
+/// Encodes in-memory vertex data into a blob, in the layout and encodings given by the blob's options.
+inline void bake_vertex_data(mesh_blob& blob, span<const attrib_source> sources, std::size_t num_vertices) {
+    blob.format = make_vertex_encoding(sources, blob.options);
+
+    auto fetch = [&](std::size_t i, void* dst) {
+        std::memcpy(dst, sources[i].data, get_attrib_size(sources[i]) * num_vertices);
+    };
+
+    write_vertex_data(blob.format, blob.options.layout, sources, num_vertices, fetch,
+        [&](std::size_t i, std::size_t size, auto&& fill) {
+            auto& data = i < sources.size() ? blob.attrib_data[i] : blob.vertex_data;
+            data.resize(size);
+            fill(static_cast<void*>(data.data()));
+        });
+
+    // Point at the blob's own data, so that the sources don't need to outlive it.
+    for (auto i = std::size_t{0}; i < sources.size(); ++i) {
+        auto& attr = blob.format.attribs[i];
+        if (attr.data) {
+            if (blob.options.layout == vertex_layout::INTERLEAVED) {
+                attr.data = blob.vertex_data.data() + blob.format.interleaved.offsets[static_cast<GLuint>(attr.loc)];
+            } else {
+                attr.data = blob.attrib_data[i].data();
+            }
+        }
+    }
+}
+
+#ifdef __EMSCRIPTEN__
+// GLES2 has no base-vertex draws, so indices are stored relative to the whole group instead.
+constexpr bool use_base_vertex = false;
+#else
+constexpr bool use_base_vertex = true;
+#endif
+
+/// The indices of one mesh, prior to upload.
+struct element_range {
+    std::size_t num_indices;
+    std::size_t first_vertex; /** First vertex the source indices may refer to. */
+    std::size_t num_vertices; /** Number of vertices the source indices may refer to. */
+};
+
+/// Triangle indices of every mesh in a group, rebased and ready for upload.
+struct element_data {
+    std::vector<GLuint> indices;
+    GLenum type = GL_UNSIGNED_INT; /** The type the indices should be stored as. */
+};
+
+/// Gathers the triangle indices of every mesh, and fills in each mesh's index ranges.
+/// Each range is stored after the previous one, and indices are rebased onto the mesh's base vertex.
+/// Indices are stored in 16 bits when the options allow it and every rebased index fits.
+/// Indices outside of their mesh's vertex range are replaced with its first vertex.
+/// If the options ask for levels of detail, they are generated from `positions` and stored after each mesh's indices.
+/// \param meshes The meshes, whose index ranges and levels of detail are filled in.
+/// \param ranges One range for each mesh, in order.
+/// \param num_vertices Total number of vertices in the group.
+/// \param positions Positions of every vertex in the group. May be empty if no levels of detail are generated.
+/// \param fetch Called as `fetch(i, dst)`, must write the `ranges[i].num_indices` 32-bit indices of mesh `i` to `dst`.
+template <typename Fetch>
+auto build_elements(
+    std::vector<mesh_group::mesh>& meshes,
+    const mesh_options& options,
+    span<const element_range> ranges,
+    std::size_t num_vertices,
+    span<const glm::vec3> positions,
+    Fetch&& fetch) -> element_data {
+
+    auto total_indices = std::size_t{0};
+    auto max_index = std::size_t{0};
+
+    for (const auto& range : ranges) {
+        total_indices += range.num_indices;
+        if (range.num_vertices > 0) {
+            max_index = std::max(max_index, use_base_vertex ? range.num_vertices - 1 : num_vertices - 1);
+        }
+    }
+
+    const auto& lod_opts = options.lods;
+    const auto make_lods = lod_opts.max_lods > 0 && !positions.empty();
+
+    element_data elements;
+    elements.type = options.compact_indices && max_index < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    auto& indices = elements.indices;
+    indices.reserve(make_lods ? total_indices * 2 : total_indices);
+
+    auto local = std::vector<GLuint>();
+
+    for (auto i = std::size_t{0}; i < ranges.size(); ++i) {
+        const auto& range = ranges[i];
+        auto& mesh = meshes[i];
+        auto first_index = indices.size();
+
+        local.resize(range.num_indices);
+        fetch(i, local.data());
+
+        auto num_invalid = std::size_t{0};
+
+        for (auto& idx : local) {
+            if (idx < range.first_vertex || idx - range.first_vertex >= range.num_vertices) {
+                idx = 0;
+                ++num_invalid;
+            } else {
+                idx -= GLuint(range.first_vertex);
+            }
+        }
+
+        if (num_invalid > 0) {
+            std::cerr << "sushi: Warning: Mesh \"" << mesh.name << "\" has " << num_invalid << " out-of-range indices.\n";
+        }
+
+        auto base_vertex = use_base_vertex ? range.first_vertex : 0;
+        auto rebase = GLuint(range.first_vertex - base_vertex);
+
+        auto append = [&](const std::vector<GLuint>& src) {
+            for (auto idx : src) {
+                indices.push_back(idx + rebase);
+            }
+        };
+
+        append(local);
+
+        mesh.first_index = GLsizei(first_index);
+        mesh.base_vertex = GLint(base_vertex);
+        mesh.lods.clear();
+
+        if (make_lods) {
+            auto mesh_positions = span<const glm::vec3>(positions.data() + range.first_vertex, range.num_vertices);
+
+            for (auto& level : generate_lods(span<const GLuint>(local), mesh_positions, lod_opts)) {
+                auto lod = mesh_group::lod{};
+                lod.num_tris = int(level.indices.size() / 3);
+                lod.first_index = GLsizei(indices.size());
+                lod.error = level.error;
+                append(level.indices);
+                mesh.lods.push_back(lod);
+            }
+        }
+    }
+
+    return elements;
+}
+
+/// Creates an element buffer holding the indices, in their stored type.
+inline auto load_index_buffer(const element_data& elements) -> unique_buffer {
+    const auto& indices = elements.indices;
+
+    if (elements.type == GL_UNSIGNED_SHORT) {
+        return stream_buffer(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), [&](void* dst) {
+            auto out = static_cast<GLushort*>(dst);
+            for (auto i = std::size_t{0}; i < indices.size(); ++i) {
+                out[i] = GLushort(indices[i]);
+            }
+        });
+    }
+
+    return load_buffer(GL_ELEMENT_ARRAY_BUFFER, indices.data(), indices.size() * sizeof(GLuint));
+}
+
+/// Packs the indices into bytes, in their stored type.
+inline void pack_indices(const element_data& elements, std::vector<unsigned char>& dst) {
+    const auto& indices = elements.indices;
+
+    if (elements.type == GL_UNSIGNED_SHORT) {
+        dst.resize(indices.size() * sizeof(GLushort));
+        for (auto i = std::size_t{0}; i < indices.size(); ++i) {
+            auto idx = GLushort(indices[i]);
+            std::memcpy(dst.data() + i * sizeof(GLushort), &idx, sizeof(GLushort));
+        }
+    } else {
+        dst.resize(indices.size() * sizeof(GLuint));
+        std::memcpy(dst.data(), indices.data(), dst.size());
+    }
+}
+
+/// Uploads the triangle indices of every mesh into the group's element buffer, which is bound to the current VAO.
+/// See `build_elements` for how indices are arranged.
+template <typename Fetch>
+void load_elements(
+    mesh_group& group,
+    span<const element_range> ranges,
+    std::size_t num_vertices,
+    span<const glm::vec3> positions,
+    Fetch&& fetch) {
+
+    auto elements = build_elements(group.meshes, group.options, ranges, num_vertices, positions, fetch);
+    group.index_type = elements.type;
+    group.index_buffer = load_index_buffer(elements);
+}
+
+/// Computes the bounds of each mesh's vertex range.
+/// \param ranges One range for each mesh, in order.
+/// \param positions Positions of every vertex in the group. If empty, the bounds are left empty.
+/// \return The bounds of the whole group.
+inline auto compute_mesh_bounds(
+    std::vector<mesh_group::mesh>& meshes,
+    span<const element_range> ranges,
+    span<const glm::vec3> positions) -> mesh_bounds {
+
+    if (positions.empty()) {
+        return {};
+    }
+
+    for (auto i = std::size_t{0}; i < ranges.size(); ++i) {
+        const auto& range = ranges[i];
+        meshes[i].bounds = compute_bounds({positions.data() + range.first_vertex, range.num_vertices});
+    }
+
+    return compute_bounds(positions);
+}
+
+/// Bakes the meshes, indices, and bounds of a blob from in-memory triangle lists.
+/// Each mesh's vertex range is tightened to the vertices it actually uses, which lets more meshes fit 16-bit indices.
+/// \param src_meshes Meshes with a `name` and a vector of `elements`, holding absolute vertex indices.
+/// \param positions Positions of every vertex, or empty if there are none.
+template <typename Mesh>
+void bake_elements(mesh_blob& blob, span<const Mesh> src_meshes, std::size_t num_vertices, span<const glm::vec3> positions) {
+    auto ranges = std::vector<element_range>();
+    ranges.reserve(src_meshes.size());
+
+    for (const auto& src_mesh : src_meshes) {
+        auto mesh = mesh_group::mesh{};
+        mesh.name = src_mesh.name;
+        mesh.num_tris = src_mesh.elements.size() / 3;
+        blob.meshes.push_back(std::move(mesh));
+
+        if (src_mesh.elements.empty()) {
+            ranges.push_back({0, 0, 0});
+        } else {
+            auto [min, max] = std::minmax_element(begin(src_mesh.elements), end(src_mesh.elements));
+            ranges.push_back({src_mesh.elements.size(), *min, std::size_t(*max - *min) + 1});
+        }
+    }
+
+    auto range_span = span<const element_range>(ranges.data(), ranges.size());
+
+    auto elements = build_elements(
+        blob.meshes, blob.options, range_span, num_vertices, positions, [&](std::size_t i, GLuint* dst) {
+            std::copy(begin(src_meshes[i].elements), end(src_meshes[i].elements), dst);
+        });
+
+    blob.index_type = elements.type;
+    pack_indices(elements, blob.index_data);
+
+    blob.bounds = compute_mesh_bounds(blob.meshes, range_span, positions);
+}
+
+/// Draws one level of detail of a mesh. The group's VAO must be bound.
+/// \param level 0 for full detail, or `i + 1` for `mesh.lods[i]`.
+inline void draw_elements(GLenum index_type, const mesh_group::mesh& mesh, std::size_t level = 0) {
+    auto first_index = level == 0 ? mesh.first_index : mesh.lods[level - 1].first_index;
+    auto num_tris = level == 0 ? mesh.num_tris : mesh.lods[level - 1].num_tris;
+    auto offset = reinterpret_cast<const void*>(first_index * get_type_size(index_type));
+#ifdef __EMSCRIPTEN__
+    glDrawElements(GL_TRIANGLES, num_tris * 3, index_type, offset);
+#else
+    glDrawElementsBaseVertex(GL_TRIANGLES, num_tris * 3, index_type, offset, mesh.base_vertex);
+#endif
+}
+
+inline void draw_elements(const mesh_group& group, const mesh_group::mesh& mesh, std::size_t level = 0) {
+    draw_elements(group.index_type, mesh, level);
+}
+
+#ifndef __EMSCRIPTEN__
+inline void draw_elements_instanced(const mesh_group& group, const mesh_group::mesh& mesh, GLsizei num_instances) {
+    auto offset = reinterpret_cast<const void*>(mesh.first_index * get_type_size(group.index_type));
+    glDrawElementsInstancedBaseVertex(
+        GL_TRIANGLES, mesh.num_tris * 3, group.index_type, offset, num_instances, mesh.base_vertex);
+}
+#endif
+
 inline void bind_attrib(
     sushi::attrib_location loc,
     const unique_buffer& buf,
     GLint size,
     GLenum type,
     GLboolean normalize,
+    GLsizei stride,
     std::size_t offset,
     std::array<float, 4> init) {
 
@@ -42,8 +596,26 @@ inline void bind_attrib(
             size,
             type,
             normalize,
-            0,
-            reinterpret_cast<const void*>(offset * size * sizeof(GLfloat)));
+            stride,
+            reinterpret_cast<const void*>(offset));
+    }
+}
+
+/// Binds every attribute to the current vertex array object, in the group's layout.
+inline void bind_attribs(const mesh_group& group, const vertex_encoding& format) {
+    static const unique_buffer no_buffer;
+
+    const auto& layout = format.interleaved;
+
+    for (const auto& attr : format.get_attribs()) {
+        if (group.options.layout == vertex_layout::INTERLEAVED) {
+            const auto& buf = attr.data ? group.vertex_buffer : no_buffer;
+            auto offset = layout.offsets[static_cast<GLuint>(attr.loc)];
+            bind_attrib(attr.loc, buf, attr.size, attr.type, attr.normalize, layout.stride, offset, attr.init);
+        } else {
+            const auto& buf = get_attrib_buffer(group, attr.loc);
+            bind_attrib(attr.loc, buf, attr.size, attr.type, attr.normalize, 0, 0, attr.init);
+        }
     }
 }
 
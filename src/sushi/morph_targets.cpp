@@ -0,0 +1,396 @@
+#include "morph_targets.hpp"
+
+#ifndef __EMSCRIPTEN__
+
+#include "mesh_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace sushi {
+
+namespace {
+
+/// Width of the per-vertex sum textures, which wrap onto further rows.
+constexpr GLsizei sums_width = 1024;
+
+/// A quantized delta, as stored in the delta buffer.
+struct packed_delta {
+    std::uint32_t vertex;
+    std::int16_t position[3];
+    std::uint16_t target;
+    std::int16_t normal[3];
+    std::uint16_t padding;
+};
+
+static_assert(sizeof(packed_delta) == 20);
+
+const GLchar* const scatter_vertex_source = R"(#version 330 core
+layout(location = 0) in uint DeltaVertex;
+layout(location = 1) in vec3 DeltaPosition;
+layout(location = 2) in uint DeltaTarget;
+layout(location = 3) in vec3 DeltaNormal;
+
+uniform samplerBuffer Weights;
+uniform ivec2 Size;
+
+out vec3 Position;
+out vec3 Normal;
+
+void main() {
+    // Weights are premultiplied by each target's quantization scale.
+    vec2 weight = texelFetch(Weights, int(DeltaTarget)).xy;
+
+    Position = DeltaPosition * weight.x;
+    Normal = DeltaNormal * weight.y;
+
+    ivec2 texel = ivec2(int(DeltaVertex) % Size.x, int(DeltaVertex) / Size.x);
+    gl_Position = vec4((vec2(texel) + 0.5) / vec2(Size) * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+const GLchar* const scatter_fragment_source = R"(#version 330 core
+in vec3 Position;
+in vec3 Normal;
+
+layout(location = 0) out vec4 PositionSum;
+layout(location = 1) out vec4 NormalSum;
+
+void main() {
+    PositionSum = vec4(Position, 0.0);
+    NormalSum = vec4(Normal, 0.0);
+}
+)";
+
+auto make_sums_texture(GLsizei width, GLsizei height) -> texture_2d {
+    texture_2d tex;
+    tex.handle = make_unique_texture();
+    tex.width = width;
+    tex.height = height;
+
+    glBindTexture(GL_TEXTURE_2D, tex.handle.get());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return tex;
+}
+
+auto quantize(float f, float scale) -> std::int16_t {
+    return scale > 0 ? _detail::quantize_snorm<std::int16_t>(f / scale) : 0;
+}
+
+} // namespace
+
+auto make_morph_target(
+    std::string name,
+    span<const glm::vec3> base_positions,
+    span<const glm::vec3> positions,
+    span<const glm::vec3> base_normals,
+    span<const glm::vec3> normals,
+    float epsilon) -> morph_target {
+
+    morph_target target;
+    target.name = std::move(name);
+
+    auto has_normals = !base_normals.empty() && !normals.empty();
+    auto num_vertices = std::min(base_positions.size(), positions.size());
+
+    auto moved = [&](const glm::vec3& d) {
+        return std::abs(d.x) > epsilon || std::abs(d.y) > epsilon || std::abs(d.z) > epsilon;
+    };
+
+    for (auto i = std::size_t{0}; i < num_vertices; ++i) {
+        auto position_delta = positions[i] - base_positions[i];
+        auto normal_delta = has_normals ? normals[i] - base_normals[i] : glm::vec3{0, 0, 0};
+
+        if (moved(position_delta) || moved(normal_delta)) {
+            target.vertices.push_back(GLuint(i));
+            target.position_deltas.push_back(position_delta);
+
+            if (has_normals) {
+                target.normal_deltas.push_back(normal_delta);
+            }
+        }
+    }
+
+    return target;
+}
+
+morph_target_set::morph_target_set(span<const morph_target> targets, std::size_t num_vertices, const morph_options& options)
+    : options(options) {
+
+    auto deltas = std::vector<packed_delta>();
+
+    for (const auto& target : targets) {
+        auto range = target_range{GLint(deltas.size()), GLsizei(target.vertices.size()), 0, 0};
+
+        for (const auto& d : target.position_deltas) {
+            range.position_scale = std::max({range.position_scale, std::abs(d.x), std::abs(d.y), std::abs(d.z)});
+        }
+
+        for (const auto& d : target.normal_deltas) {
+            range.normal_scale = std::max({range.normal_scale, std::abs(d.x), std::abs(d.y), std::abs(d.z)});
+        }
+
+        for (auto i = std::size_t{0}; i < target.vertices.size(); ++i) {
+            if (target.vertices[i] >= num_vertices) {
+                throw std::out_of_range("morph_target_set: Target \"" + target.name + "\" moves a vertex outside of the mesh.");
+            }
+
+            auto pos = target.position_deltas[i];
+            auto nrm = i < target.normal_deltas.size() ? target.normal_deltas[i] : glm::vec3{0, 0, 0};
+
+            packed_delta packed;
+            packed.vertex = target.vertices[i];
+            packed.position[0] = quantize(pos.x, range.position_scale);
+            packed.position[1] = quantize(pos.y, range.position_scale);
+            packed.position[2] = quantize(pos.z, range.position_scale);
+            packed.target = std::uint16_t(ranges.size());
+            packed.normal[0] = quantize(nrm.x, range.normal_scale);
+            packed.normal[1] = quantize(nrm.y, range.normal_scale);
+            packed.normal[2] = quantize(nrm.z, range.normal_scale);
+            packed.padding = 0;
+
+            deltas.push_back(packed);
+        }
+
+        names.push_back(target.name);
+        ranges.push_back(range);
+    }
+
+    num_deltas = deltas.size();
+
+    // Deltas are only ever read by the scatter pass, so they get a VAO of their own.
+    delta_vao = make_unique_vertex_array();
+    glBindVertexArray(delta_vao.get());
+
+    delta_buffer = _detail::load_buffer(GL_ARRAY_BUFFER, deltas.data(), deltas.size() * sizeof(packed_delta));
+
+    if (delta_buffer) {
+        constexpr auto stride = GLsizei(sizeof(packed_delta));
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, stride, reinterpret_cast<const void*>(offsetof(packed_delta, vertex)));
+        glVertexAttribPointer(1, 3, GL_SHORT, GL_TRUE, stride, reinterpret_cast<const void*>(offsetof(packed_delta, position)));
+        glVertexAttribIPointer(2, 1, GL_UNSIGNED_SHORT, stride, reinterpret_cast<const void*>(offsetof(packed_delta, target)));
+        glVertexAttribPointer(3, 3, GL_SHORT, GL_TRUE, stride, reinterpret_cast<const void*>(offsetof(packed_delta, normal)));
+    }
+
+    glBindVertexArray(0);
+
+    weight_buffer = make_unique_buffer();
+    glBindBuffer(GL_TEXTURE_BUFFER, weight_buffer.get());
+    glBufferData(GL_TEXTURE_BUFFER, std::max(ranges.size(), std::size_t{1}) * sizeof(glm::vec2), nullptr, GL_STREAM_DRAW);
+
+    weight_texture = make_unique_texture();
+    glBindTexture(GL_TEXTURE_BUFFER, weight_texture.get());
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, weight_buffer.get());
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    auto width = GLsizei(std::clamp(num_vertices, std::size_t{1}, std::size_t(sums_width)));
+    auto height = GLsizei(std::max((num_vertices + width - 1) / width, std::size_t{1}));
+
+    position_sums = make_sums_texture(width, height);
+    normal_sums = make_sums_texture(width, height);
+
+    GLint prev_framebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_framebuffer);
+
+    sums_framebuffer = make_unique_framebuffer();
+    glBindFramebuffer(GL_FRAMEBUFFER, sums_framebuffer.get());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, position_sums.handle.get(), 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal_sums.handle.get(), 0);
+
+    const GLenum draw_buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, draw_buffers);
+
+    auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, prev_framebuffer);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error("morph_target_set: Float render targets are not supported!");
+    }
+
+    auto shaders = std::vector<unique_shader>();
+    shaders.push_back(compile_shader(shader_type::VERTEX, {scatter_vertex_source}));
+    shaders.push_back(compile_shader(shader_type::FRAGMENT, {scatter_fragment_source}));
+    program = link_program(shaders);
+
+    size_uniform = glGetUniformLocation(program.get(), "Size");
+    weights_uniform = glGetUniformLocation(program.get(), "Weights");
+}
+
+auto morph_target_set::find_target(const std::string& name) const -> std::optional<std::size_t> {
+    auto iter = std::find(names.begin(), names.end(), name);
+
+    if (iter == names.end()) {
+        return std::nullopt;
+    }
+
+    return std::size_t(iter - names.begin());
+}
+
+auto morph_target_set::apply(span<const float> weights) const -> bool {
+    // Active targets are gathered into as few contiguous ranges of deltas as possible.
+    auto firsts = std::vector<GLint>();
+    auto counts = std::vector<GLsizei>();
+    auto scaled_weights = std::vector<glm::vec2>(ranges.size(), glm::vec2{0, 0});
+
+    for (auto i = std::size_t{0}; i < ranges.size() && i < weights.size(); ++i) {
+        const auto& range = ranges[i];
+
+        if (weights[i] == 0 || range.count == 0) {
+            continue;
+        }
+
+        scaled_weights[i] = {weights[i] * range.position_scale, weights[i] * range.normal_scale};
+
+        if (!firsts.empty() && firsts.back() + counts.back() == range.first) {
+            counts.back() += range.count;
+        } else {
+            firsts.push_back(range.first);
+            counts.push_back(range.count);
+        }
+    }
+
+    if (firsts.empty()) {
+        return false;
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, weight_buffer.get());
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, scaled_weights.size() * sizeof(glm::vec2), scaled_weights.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    // Every piece of state the scatter pass touches is restored afterwards.
+    GLint prev_program;
+    GLint prev_framebuffer;
+    GLint prev_viewport[4];
+    GLint prev_active_texture;
+    GLint prev_blend_src_rgb, prev_blend_dst_rgb, prev_blend_src_alpha, prev_blend_dst_alpha;
+    GLint prev_blend_equation_rgb, prev_blend_equation_alpha;
+
+    glGetIntegerv(GL_CURRENT_PROGRAM, &prev_program);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prev_framebuffer);
+    glGetIntegerv(GL_VIEWPORT, prev_viewport);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &prev_active_texture);
+    glGetIntegerv(GL_BLEND_SRC_RGB, &prev_blend_src_rgb);
+    glGetIntegerv(GL_BLEND_DST_RGB, &prev_blend_dst_rgb);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, &prev_blend_src_alpha);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, &prev_blend_dst_alpha);
+    glGetIntegerv(GL_BLEND_EQUATION_RGB, &prev_blend_equation_rgb);
+    glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &prev_blend_equation_alpha);
+
+    auto prev_blend = glIsEnabled(GL_BLEND);
+    auto prev_depth_test = glIsEnabled(GL_DEPTH_TEST);
+    auto prev_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+
+    auto set_enabled = [](GLenum cap, GLboolean enabled) {
+        if (enabled) {
+            glEnable(cap);
+        } else {
+            glDisable(cap);
+        }
+    };
+
+    {
+        SUSHI_DEFER {
+            glUseProgram(prev_program);
+            glBindFramebuffer(GL_FRAMEBUFFER, prev_framebuffer);
+            glViewport(prev_viewport[0], prev_viewport[1], prev_viewport[2], prev_viewport[3]);
+            glBlendFuncSeparate(prev_blend_src_rgb, prev_blend_dst_rgb, prev_blend_src_alpha, prev_blend_dst_alpha);
+            glBlendEquationSeparate(prev_blend_equation_rgb, prev_blend_equation_alpha);
+            set_enabled(GL_BLEND, prev_blend);
+            set_enabled(GL_DEPTH_TEST, prev_depth_test);
+            set_enabled(GL_SCISSOR_TEST, prev_scissor_test);
+            glBindVertexArray(0);
+        };
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sums_framebuffer.get());
+        glViewport(0, 0, position_sums.width, position_sums.height);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_SCISSOR_TEST);
+
+        const GLfloat zero[] = {0, 0, 0, 0};
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClearBufferfv(GL_COLOR, 1, zero);
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glBlendEquation(GL_FUNC_ADD);
+
+        glUseProgram(program.get());
+        glUniform2i(size_uniform, position_sums.width, position_sums.height);
+        glUniform1i(weights_uniform, options.texture_unit);
+
+        glActiveTexture(GL_TEXTURE0 + options.texture_unit);
+        glBindTexture(GL_TEXTURE_BUFFER, weight_texture.get());
+
+        glBindVertexArray(delta_vao.get());
+        glMultiDrawArrays(GL_POINTS, firsts.data(), counts.data(), GLsizei(firsts.size()));
+
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // The sums are bound for the caller's program, which is current again.
+    auto morphed_uniform = glGetUniformLocation(prev_program, "Morphed");
+    auto positions_uniform = glGetUniformLocation(prev_program, "MorphPositions");
+    auto normals_uniform = glGetUniformLocation(prev_program, "MorphNormals");
+
+    glActiveTexture(GL_TEXTURE0 + options.texture_unit);
+    glBindTexture(GL_TEXTURE_2D, position_sums.handle.get());
+    glActiveTexture(GL_TEXTURE0 + options.texture_unit + 1);
+    glBindTexture(GL_TEXTURE_2D, normal_sums.handle.get());
+    glActiveTexture(prev_active_texture);
+
+    glUniform1i(morphed_uniform, 1);
+    glUniform1i(positions_uniform, options.texture_unit);
+    glUniform1i(normals_uniform, options.texture_unit + 1);
+
+    return true;
+}
+
+namespace {
+
+void clear_morphed_uniform() {
+    GLint program;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    glUniform1i(glGetUniformLocation(program, "Morphed"), 0);
+}
+
+} // namespace
+
+void draw_mesh(const mesh_group& group, const morph_target_set& morphs, span<const float> weights) {
+    if (morphs.apply(weights)) {
+        draw_mesh(group);
+        clear_morphed_uniform();
+    } else {
+        draw_mesh(group);
+    }
+}
+
+void draw_mesh(
+    const mesh_group& group,
+    const pose& pose,
+    bone_palette_buffer& palettes,
+    const morph_target_set& morphs,
+    span<const float> weights) {
+    if (morphs.apply(weights)) {
+        draw_mesh(group, pose, palettes);
+        clear_morphed_uniform();
+    } else {
+        draw_mesh(group, pose, palettes);
+    }
+}
+
+} // namespace sushi
+
+#endif // __EMSCRIPTEN__
@@ -0,0 +1,138 @@
+#ifndef SUSHI_MORPH_TARGETS_HPP
+#define SUSHI_MORPH_TARGETS_HPP
+
+#include "gl.hpp"
+#include "common.hpp"
+#include "bone_palette.hpp"
+#include "framebuffer.hpp"
+#include "mesh_group.hpp"
+#include "pose.hpp"
+#include "shader.hpp"
+#include "texture.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Morph targets rely on texture buffers and gl_VertexID, which WebGL 1 lacks.
+#ifndef __EMSCRIPTEN__
+
+/// Sushi
+namespace sushi {
+
+/// A blend shape, stored as offsets from the base mesh for only the vertices it moves.
+struct morph_target {
+    std::string name;
+    std::vector<GLuint> vertices; /** Indices into the group's vertex buffers, as seen by `gl_VertexID`. */
+    std::vector<glm::vec3> position_deltas; /** One per vertex in `vertices`. */
+    std::vector<glm::vec3> normal_deltas; /** One per vertex in `vertices`, or empty if normals don't change. */
+};
+
+/// Extracts a sparse morph target from a full copy of the deformed mesh.
+/// Vertices which move less than `epsilon` along every axis, with normals which do the same, are left out.
+/// \param name Name of the target.
+/// \param base_positions Positions of the base mesh.
+/// \param positions Positions of the deformed mesh, in the same vertex order.
+/// \param base_normals Normals of the base mesh, or empty.
+/// \param normals Normals of the deformed mesh, or empty.
+/// \param epsilon Largest change which is considered no change at all.
+/// \return The target.
+auto make_morph_target(
+    std::string name,
+    span<const glm::vec3> base_positions,
+    span<const glm::vec3> positions,
+    span<const glm::vec3> base_normals = {},
+    span<const glm::vec3> normals = {},
+    float epsilon = 1e-5f) -> morph_target;
+
+/// Options for a morph_target_set.
+struct morph_options {
+    GLint texture_unit = 14; /** Unit of the `MorphPositions` sampler. `MorphNormals` uses the next unit. */
+};
+
+/// Morph targets of a mesh group, uploaded as quantized sparse deltas and blended on the GPU.
+///
+/// Each delta is 20 bytes: the vertex index, and 16-bit normalized position and normal offsets, scaled per target.
+/// Memory therefore scales with the number of moved vertices, not with the size of the mesh.
+///
+/// Drawing scatters the deltas of every target with a nonzero weight into a per-vertex texture with additive blending,
+/// reading weights from a texture buffer, and the vertex shader then adds the sums to its inputs.
+/// Targets with zero weight are never drawn, and if every weight is zero the mesh is drawn without morphing at all.
+/// See `assets/vert.glsl` for the shader side, which reads `MorphPositions` and `MorphNormals` when `Morphed` is set.
+class morph_target_set {
+public:
+    morph_target_set() = default;
+
+    /// Uploads morph targets. Must be called on the GL context's thread.
+    /// \param targets The targets.
+    /// \param num_vertices Number of vertices in the mesh group the targets deform.
+    /// \param options Texture units to bind the blended deltas to.
+    /// \throws std::out_of_range If any target refers to a vertex outside of the group.
+    morph_target_set(span<const morph_target> targets, std::size_t num_vertices, const morph_options& options = {});
+
+    auto get_num_targets() const -> std::size_t { return ranges.size(); }
+
+    /// Gets the number of deltas stored across every target.
+    auto get_num_deltas() const -> std::size_t { return num_deltas; }
+
+    /// Finds a target by name.
+    /// \param name Name of the target.
+    /// \return The index of the target, or nothing if there is no such target.
+    auto find_target(const std::string& name) const -> std::optional<std::size_t>;
+
+    /// Blends the targets into the per-vertex delta textures, and binds those to the shader of the current program.
+    /// Changes no other GL state.
+    /// \param weights One weight per target.
+    /// \return Whether any target was active. If not, nothing was bound, and the mesh should be drawn unmorphed.
+    auto apply(span<const float> weights) const -> bool;
+
+private:
+    struct target_range {
+        GLint first;
+        GLsizei count;
+        float position_scale; /** Largest position offset along any axis, which maps to 1 when quantized. */
+        float normal_scale;
+    };
+
+    std::vector<std::string> names;
+    std::vector<target_range> ranges;
+    std::size_t num_deltas = 0;
+    morph_options options;
+
+    unique_buffer delta_buffer;
+    unique_vertex_array delta_vao;
+    unique_buffer weight_buffer;
+    unique_texture weight_texture; /** Texture buffer view of `weight_buffer`. */
+    texture_2d position_sums; /** Blended position offsets, one texel per vertex. */
+    texture_2d normal_sums;
+    unique_framebuffer sums_framebuffer;
+    unique_program program; /** Scatters deltas into the sums. */
+    GLint size_uniform = -1;
+    GLint weights_uniform = -1;
+};
+
+/// Draws a mesh deformed by morph targets.
+/// \param group The mesh to draw.
+/// \param morphs The morph targets of the group.
+/// \param weights One weight per target.
+void draw_mesh(const mesh_group& group, const morph_target_set& morphs, span<const float> weights);
+
+/// Draws an animated mesh deformed by morph targets, which are applied before skinning.
+/// \param group The mesh to draw.
+/// \param pose The pose of the group's skeleton.
+/// \param palettes Buffer to upload the pose's palette through, as with `draw_mesh(group, pose, palettes)`.
+/// \param morphs The morph targets of the group.
+/// \param weights One weight per target.
+void draw_mesh(
+    const mesh_group& group,
+    const pose& pose,
+    bone_palette_buffer& palettes,
+    const morph_target_set& morphs,
+    span<const float> weights);
+
+} // namespace sushi
+
+#endif // __EMSCRIPTEN__
+
+#endif // SUSHI_MORPH_TARGETS_HPP
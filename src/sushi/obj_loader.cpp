@@ -1,90 +1,524 @@
 #include "obj_loader.hpp"
 
+#include "mapped_file.hpp"
 #include "mesh_builder.hpp"
+#include "thread_pool.hpp"
 
 #include <algorithm>
-#include <fstream>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace sushi {
 
-auto load_obj_file(const std::string &fname) -> std::optional<mesh_group> {
-    std::ifstream file(fname);
+namespace {
 
-    if (!file) {
-        return std::nullopt;
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/// A minimal whitespace tokenizer over a single line.
+class line_tokenizer {
+public:
+    explicit line_tokenizer(std::string_view line) : cur(line.data()), last(line.data() + line.size()) {}
+
+    /// Gets the next whitespace-delimited token, or an empty view if there are none left.
+    auto next() -> std::string_view {
+        while (cur != last && is_space(*cur)) {
+            ++cur;
+        }
+        auto start = cur;
+        while (cur != last && !is_space(*cur)) {
+            ++cur;
+        }
+        return std::string_view(start, cur - start);
+    }
+
+    /// Gets the unparsed remainder of the line.
+    auto rest() const -> std::string_view {
+        return std::string_view(cur, last - cur);
+    }
+
+    /// Parses the next token as a float. Leaves `out` unchanged if there is no valid token.
+    void next_float(float& out) {
+        auto tok = next();
+        parse_float(tok, out);
+    }
+
+    static void parse_float(std::string_view tok, float& out) {
+        if (!tok.empty() && tok.front() == '+') {
+            tok.remove_prefix(1);
+        }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        std::from_chars(tok.data(), tok.data() + tok.size(), out);
+#else
+        if (!tok.empty()) {
+            auto str = std::string(tok);
+            char* end;
+            auto value = std::strtof(str.c_str(), &end);
+            if (end != str.c_str()) {
+                out = value;
+            }
+        }
+#endif
+    }
+
+    /// Parses an integer prefix of `tok`. Leaves `out` unchanged if there is no valid integer.
+    static auto parse_int(std::string_view tok, int& out) -> std::string_view {
+        if (!tok.empty() && tok.front() == '+') {
+            tok.remove_prefix(1);
+        }
+        auto [ptr, ec] = std::from_chars(tok.data(), tok.data() + tok.size(), out);
+        return tok.substr(ptr - tok.data());
     }
 
-    std::string line;
+private:
+    const char* cur;
+    const char* last;
+};
+
+/// Parses a face corner of the form `v`, `v/vt`, `v//vn`, or `v/vt/vn`.
+/// Missing indices keep their existing values.
+void parse_face_corner(std::string_view tok, int (&idx)[3]) {
+    for (auto& i : idx) {
+        tok = line_tokenizer::parse_int(tok, i);
+        auto slash = tok.find('/');
+        if (slash == std::string_view::npos) {
+            break;
+        }
+        tok.remove_prefix(slash + 1);
+    }
+}
+
+/// Resolves a 1-based (or negative, relative) OBJ index into a 0-based index.
+auto resolve_index(int idx, std::size_t count) -> std::optional<std::size_t> {
+    if (idx > 0 && std::size_t(idx) <= count) {
+        return std::size_t(idx - 1);
+    }
+    if (idx < 0 && std::size_t(-idx) <= count) {
+        return count - std::size_t(-idx);
+    }
+    return std::nullopt;
+}
+
+/// A unique combination of attribute indices, used to weld identical face corners into a single vertex.
+struct corner_key {
+    std::size_t position;
+    std::size_t texcoord;
+    std::size_t normal;
+
+    bool operator==(const corner_key& other) const {
+        return position == other.position && texcoord == other.texcoord && normal == other.normal;
+    }
+};
+
+struct corner_key_hash {
+    std::size_t operator()(const corner_key& k) const {
+        auto h = std::uint64_t(k.position) * 0x9E3779B97F4A7C15ull;
+        h ^= std::uint64_t(k.texcoord) * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+        h ^= std::uint64_t(k.normal) * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+        return std::size_t(h ^ (h >> 32));
+    }
+};
+
+/// Marks a texcoord or normal index which was left out of a face corner.
+constexpr auto missing_index = std::numeric_limits<std::size_t>::max();
+
+/// A face corner, as written in the file.
+/// Positive indices are converted to 0-based global indices.
+/// Negative (relative) indices are converted to 0-based indices local to their chunk, and flagged in `relative_mask`.
+/// Indices left out of the corner are flagged in `missing_mask`.
+struct obj_face {
+    std::int32_t corners[3][3];
+    std::uint16_t relative_mask;
+    std::uint16_t missing_mask;
+    std::int32_t line;
+};
+
+struct obj_object {
+    std::string name;
+    std::size_t first_face;
+};
+
+struct obj_warning {
+    std::int32_t line;
     std::string word;
-    int line_number = 0;
+};
 
+/// The records parsed from one line-aligned chunk of an OBJ file.
+/// Line numbers are local to the chunk.
+struct obj_chunk {
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec2> texcoords;
     std::vector<glm::vec3> normals;
+    std::vector<obj_face> faces;
+    std::vector<obj_object> objects;
+    std::vector<obj_warning> warnings;
+    std::int32_t num_lines = 0;
+};
 
-    mesh_group_builder mb;
-    mb.enable(attrib_location::POSITION);
-    mb.enable(attrib_location::TEXCOORD);
-    mb.enable(attrib_location::NORMAL);
+void parse_obj_chunk(std::string_view contents, obj_chunk& chunk) {
+    while (!contents.empty()) {
+        auto eol = contents.find('\n');
+        auto line = contents.substr(0, eol);
+        contents.remove_prefix(eol == std::string_view::npos ? contents.size() : eol + 1);
 
-    auto vb = std::optional<mesh_group_builder::vertex_builder>{};
+        ++chunk.num_lines;
 
-    while (getline(file, line)) {
-        ++line_number;
-        std::istringstream iss(line);
-        iss >> word;
+        auto tok = line_tokenizer(line);
+        auto word = tok.next();
 
-        if (word == "o") {
-            std::string s;
-            std::getline(iss, s);
-            mb.mesh(s);
+        if (word.empty()) {
+            // pass
+        } else if (word == "o") {
+            chunk.objects.push_back({std::string(tok.rest()), chunk.faces.size()});
         } else if (word == "v") {
-            glm::vec3 v;
-            iss >> v.x >> v.y >> v.z;
-            vertices.push_back(v);
+            glm::vec3 v = {0, 0, 0};
+            tok.next_float(v.x);
+            tok.next_float(v.y);
+            tok.next_float(v.z);
+            chunk.vertices.push_back(v);
         } else if (word == "vt") {
-            glm::vec2 v;
-            iss >> v.x >> v.y;
+            glm::vec2 v = {0, 0};
+            tok.next_float(v.x);
+            tok.next_float(v.y);
             v.y = 1.0 - v.y;
-            texcoords.push_back(v);
+            chunk.texcoords.push_back(v);
         } else if (word == "vn") {
-            glm::vec3 v;
-            iss >> v.x >> v.y >> v.z;
-            normals.push_back(v);
+            glm::vec3 v = {0, 0, 0};
+            tok.next_float(v.x);
+            tok.next_float(v.y);
+            tok.next_float(v.z);
+            chunk.normals.push_back(v);
         } else if (word == "f") {
-            GLuint verts[3];
-
-            for (auto& vert : verts) {
-                int pos_idx = 1;
-                int texcoord_idx = 1;
-                int normal_idx = 1;
-
-                iss >> word;
-                std::replace(begin(word), end(word), '/', ' ');
-                std::istringstream iss2(word);
-                iss2 >> pos_idx >> texcoord_idx >> normal_idx;
-
-                vert = mb.vertex()
-                    .position(vertices[pos_idx - 1])
-                    .texcoord(texcoords[texcoord_idx - 1])
-                    .normal(normals[normal_idx - 1])
-                    .get();
+            const std::size_t counts[3] = {chunk.vertices.size(), chunk.texcoords.size(), chunk.normals.size()};
+
+            obj_face face;
+            face.relative_mask = 0;
+            face.missing_mask = 0;
+            face.line = chunk.num_lines;
+
+            for (auto c = 0; c < 3; ++c) {
+                // OBJ indices start at 1, so 0 means the index was left out.
+                int idx[3] = {0, 0, 0};
+
+                parse_face_corner(tok.next(), idx);
+
+                for (auto a = 0; a < 3; ++a) {
+                    if (idx[a] == 0) {
+                        face.corners[c][a] = -1;
+                        face.missing_mask |= 1 << (c * 3 + a);
+                    } else if (idx[a] < 0) {
+                        face.corners[c][a] = std::int32_t(counts[a]) + idx[a];
+                        face.relative_mask |= 1 << (c * 3 + a);
+                    } else {
+                        face.corners[c][a] = idx[a] - 1;
+                    }
+                }
             }
 
-            mb.tri(verts[0], verts[2], verts[1]);
+            chunk.faces.push_back(face);
         } else if (word[0] == '#') {
             // pass
         } else {
+            chunk.warnings.push_back({chunk.num_lines, std::string(word)});
+        }
+    }
+}
+
+/// Splits the file into roughly `count` chunks, each ending at a line boundary.
+auto split_lines(std::string_view contents, std::size_t count) -> std::vector<std::string_view> {
+    std::vector<std::string_view> rv;
+
+    auto target_size = std::max(contents.size() / std::max(count, std::size_t{1}), std::size_t{1});
+
+    while (!contents.empty()) {
+        auto split = std::min(target_size, contents.size());
+        auto eol = contents.find('\n', split - 1);
+        auto len = eol == std::string_view::npos ? contents.size() : eol + 1;
+        rv.push_back(contents.substr(0, len));
+        contents.remove_prefix(len);
+    }
+
+    return rv;
+}
+
+/// Face corners of one chunk, resolved to global attribute indices and welded within the chunk.
+struct obj_chunk_corners {
+    std::vector<corner_key> keys; /** Distinct corners, in order of first use. */
+    std::vector<GLuint> corners; /** Index into `keys` of each corner, in the winding passed to the builder. */
+    std::int32_t error_line = 0; /** Chunk-local line of the first invalid face index, or 0 if there is none. */
+    bool has_normals = false;
+};
+
+/// Resolves and welds the face corners of a chunk.
+/// \param offsets Number of each attribute in all earlier chunks.
+/// \param counts Number of each attribute in the whole file.
+void resolve_obj_chunk(
+    const obj_chunk& chunk, const std::size_t (&offsets)[3], const std::size_t (&counts)[3], obj_chunk_corners& out) {
+    // Closed meshes have about half as many vertices as triangles, so this rarely rehashes.
+    std::unordered_map<corner_key, GLuint, corner_key_hash> welded_corners;
+    welded_corners.reserve(chunk.faces.size());
+
+    out.corners.resize(chunk.faces.size() * 3);
+
+    for (auto f = std::size_t{0}; f < chunk.faces.size(); ++f) {
+        const auto& face = chunk.faces[f];
+        GLuint verts[3];
+
+        for (auto c = 0; c < 3; ++c) {
+            std::size_t idx[3];
+
+            for (auto a = 0; a < 3; ++a) {
+                auto bit = 1 << (c * 3 + a);
+
+                if (a != 0 && (face.missing_mask & bit)) {
+                    idx[a] = missing_index;
+                    continue;
+                }
+
+                auto local = std::int64_t(face.corners[c][a]);
+                auto global = (face.relative_mask & bit) ? std::int64_t(offsets[a]) + local : local;
+
+                if (global < 0 || std::uint64_t(global) >= counts[a]) {
+                    out.error_line = face.line;
+                    return;
+                }
+
+                idx[a] = std::size_t(global);
+            }
+
+            out.has_normals = out.has_normals || idx[2] != missing_index;
+
+            auto [iter, inserted] = welded_corners.try_emplace({idx[0], idx[1], idx[2]}, GLuint(out.keys.size()));
+
+            if (inserted) {
+                out.keys.push_back(iter->first);
+            }
+
+            verts[c] = iter->second;
+        }
+
+        out.corners[f * 3] = verts[0];
+        out.corners[f * 3 + 1] = verts[2];
+        out.corners[f * 3 + 2] = verts[1];
+    }
+}
+
+/// Combines parsed chunks, in file order, into a single mesh.
+/// Corners are resolved and welded within each chunk in parallel, then merged in order, so vertices are numbered
+/// by first use across the file regardless of the number of chunks.
+/// Corners without a texcoord get a zero texcoord. If no corner has a normal, normals are generated on `pool`.
+auto stitch_obj_chunks(const std::string& fname, const std::vector<obj_chunk>& chunks, thread_pool& pool)
+    -> std::optional<mesh_blob> {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+
+    struct chunk_offsets {
+        std::size_t attribs[3];
+        std::int32_t first_line;
+    };
+
+    auto offsets = std::vector<chunk_offsets>(chunks.size());
+
+    {
+        auto totals = chunk_offsets{{0, 0, 0}, 0};
+
+        for (auto i = std::size_t{0}; i < chunks.size(); ++i) {
+            offsets[i] = totals;
+            totals.attribs[0] += chunks[i].vertices.size();
+            totals.attribs[1] += chunks[i].texcoords.size();
+            totals.attribs[2] += chunks[i].normals.size();
+            totals.first_line += chunks[i].num_lines;
+        }
+
+        vertices.reserve(totals.attribs[0]);
+        texcoords.reserve(totals.attribs[1]);
+        normals.reserve(totals.attribs[2]);
+    }
+
+    for (const auto& chunk : chunks) {
+        vertices.insert(end(vertices), begin(chunk.vertices), end(chunk.vertices));
+        texcoords.insert(end(texcoords), begin(chunk.texcoords), end(chunk.texcoords));
+        normals.insert(end(normals), begin(chunk.normals), end(chunk.normals));
+    }
+
+    for (auto i = std::size_t{0}; i < chunks.size(); ++i) {
+        for (const auto& warning : chunks[i].warnings) {
             std::clog << "sushi::load_obj_file(): Warning: Unknown OBJ directive at " << fname << "[" <<
-            line_number
-            << "]: \"" << word << "\"." << std::endl;
+            offsets[i].first_line + warning.line
+            << "]: \"" << warning.word << "\"." << std::endl;
+        }
+    }
+
+    const std::size_t counts[3] = {vertices.size(), texcoords.size(), normals.size()};
+
+    auto chunk_corners = std::vector<obj_chunk_corners>(chunks.size());
+
+    pool.parallel_for(chunks.size(), [&](std::size_t i, unsigned) {
+        resolve_obj_chunk(chunks[i], offsets[i].attribs, counts, chunk_corners[i]);
+    });
+
+    auto has_normals = false;
+    auto num_keys = std::size_t{0};
+
+    for (auto i = std::size_t{0}; i < chunks.size(); ++i) {
+        if (chunk_corners[i].error_line != 0) {
+            std::cerr << "sushi::load_obj_file(): Error: Invalid face index at " << fname << "[" <<
+            offsets[i].first_line + chunk_corners[i].error_line
+            << "]." << std::endl;
+            return std::nullopt;
+        }
+
+        has_normals = has_normals || chunk_corners[i].has_normals;
+        num_keys += chunk_corners[i].keys.size();
+    }
+
+    // Corners shared between chunks are welded here, in file order, which only touches each chunk's distinct corners.
+    std::unordered_map<corner_key, GLuint, corner_key_hash> welded_corners;
+    welded_corners.reserve(num_keys);
+
+    auto vertex_keys = std::vector<corner_key>();
+    vertex_keys.reserve(num_keys);
+
+    auto remaps = std::vector<std::vector<GLuint>>(chunks.size());
+
+    for (auto i = std::size_t{0}; i < chunks.size(); ++i) {
+        auto& remap = remaps[i];
+        remap.reserve(chunk_corners[i].keys.size());
+
+        for (const auto& key : chunk_corners[i].keys) {
+            auto [iter, inserted] = welded_corners.try_emplace(key, GLuint(vertex_keys.size()));
+
+            if (inserted) {
+                vertex_keys.push_back(key);
+            }
+
+            remap.push_back(iter->second);
+        }
+    }
+
+    pool.parallel_for(chunks.size(), [&](std::size_t i, unsigned) {
+        for (auto& corner : chunk_corners[i].corners) {
+            corner = remaps[i][corner];
+        }
+    });
+
+    const auto num_vertices = vertex_keys.size();
+
+    auto vertex_positions = std::vector<glm::vec3>(num_vertices);
+    auto vertex_texcoords = std::vector<glm::vec2>(num_vertices);
+    auto vertex_normals = std::vector<glm::vec3>(num_vertices);
+
+    constexpr auto block_size = std::size_t{16384};
+
+    pool.parallel_for((num_vertices + block_size - 1) / block_size, [&](std::size_t block, unsigned) {
+        auto last = std::min(num_vertices, (block + 1) * block_size);
+
+        for (auto v = block * block_size; v < last; ++v) {
+            const auto& key = vertex_keys[v];
+            vertex_positions[v] = vertices[key.position];
+            vertex_texcoords[v] = key.texcoord != missing_index ? texcoords[key.texcoord] : glm::vec2{0, 0};
+            vertex_normals[v] = key.normal != missing_index ? normals[key.normal] : glm::vec3{0, 0, 0};
+        }
+    });
+
+    mesh_group_builder mb;
+    mb.enable(attrib_location::POSITION);
+    mb.enable(attrib_location::TEXCOORD);
+    mb.enable(attrib_location::NORMAL);
+
+    // Vertices and each object's triangles are added in bulk, so the builder allocates each array once.
+    mb.vertices(num_vertices)
+        .positions(vertex_positions)
+        .texcoords(vertex_texcoords)
+        .normals(vertex_normals);
+
+    for (auto i = std::size_t{0}; i < chunks.size(); ++i) {
+        const auto& chunk = chunks[i];
+        const auto& corners = chunk_corners[i].corners;
+
+        auto first_face = std::size_t{0};
+
+        auto add_faces = [&](std::size_t last_face) {
+            if (last_face > first_face) {
+                mb.tris(span<const GLuint>(corners.data() + first_face * 3, (last_face - first_face) * 3));
+            }
+            first_face = last_face;
+        };
+
+        for (const auto& object : chunk.objects) {
+            add_faces(object.first_face);
+            mb.mesh(object.name);
         }
+
+        add_faces(chunk.faces.size());
+    }
+
+    if (!has_normals) {
+        mb.generate_normals(normal_weighting::ANGLE, pool);
+    }
+
+    return mb.bake();
+}
+
+} // namespace
+
+auto bake_obj_file(const std::string &fname) -> std::optional<mesh_blob> {
+    auto file = map_file(fname);
+
+    if (!file) {
+        return std::nullopt;
+    }
+
+    auto chunks = std::vector<obj_chunk>(1);
+
+    parse_obj_chunk(std::string_view(file->chars(), file->size()), chunks[0]);
+
+    // Stitching runs its loops on a pool without workers, so the whole load stays on the calling thread.
+    thread_pool serial_pool(1);
+
+    return stitch_obj_chunks(fname, chunks, serial_pool);
+}
+
+auto bake_obj_file(const std::string &fname, thread_pool& pool) -> std::optional<mesh_blob> {
+    auto file = map_file(fname);
+
+    if (!file) {
+        return std::nullopt;
+    }
+
+    // Several chunks per thread keeps threads busy when line density varies across the file.
+    auto pieces = split_lines(std::string_view(file->chars(), file->size()), pool.size() * 4);
+    auto chunks = std::vector<obj_chunk>(pieces.size());
+
+    pool.parallel_for(pieces.size(), [&](std::size_t i, unsigned) {
+        parse_obj_chunk(pieces[i], chunks[i]);
+    });
+
+    return stitch_obj_chunks(fname, chunks, pool);
+}
+
+auto load_obj_file(const std::string &fname) -> std::optional<mesh_group> {
+    if (auto blob = bake_obj_file(fname)) {
+        return upload(*blob);
+    }
+
+    return std::nullopt;
+}
+
+auto load_obj_file(const std::string &fname, thread_pool& pool) -> std::optional<mesh_group> {
+    if (auto blob = bake_obj_file(fname, pool)) {
+        return upload(*blob);
     }
 
-    return mb.get();
+    return std::nullopt;
 }
 
 } // namespace sushi
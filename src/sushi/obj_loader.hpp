@@ -2,6 +2,7 @@
 #define SUSHI_OBJ_LOADER_HPP
 
 #include "mesh_group.hpp"
+#include "thread_pool.hpp"
 
 #include <string>
 #include <optional>
@@ -16,10 +17,30 @@ namespace sushi {
 /// - `vn` - Vertex normal.
 /// - `vt` - Vertex texture coordinate.
 /// - `f` - Face (triangles only).
+/// Face corners with identical position, texture coordinate, and normal indices share a single vertex.
+/// Corners without a texture coordinate get a zero one. If no corner has a normal, smooth normals are generated.
 /// \param fname File name.
 /// \return The static mesh described by the file.
 auto load_obj_file(const std::string &fname) -> std::optional<mesh_group>;
 
+/// Loads a mesh from an OBJ file, parsing line-aligned chunks of the file in parallel.
+/// The resulting mesh is identical to the one produced by the serial overload.
+/// \param fname File name.
+/// \param pool Thread pool to parse on, e.g. `default_thread_pool()`.
+/// \return The static mesh described by the file.
+auto load_obj_file(const std::string &fname, thread_pool& pool) -> std::optional<mesh_group>;
+
+/// Parses and bakes a mesh from an OBJ file for upload, without any GL calls.
+/// \param fname File name.
+/// \return The baked data, to be passed to `upload` on the GL thread.
+auto bake_obj_file(const std::string &fname) -> std::optional<mesh_blob>;
+
+/// Parses and bakes a mesh from an OBJ file in parallel, without any GL calls.
+/// \param fname File name.
+/// \param pool Thread pool to parse on, e.g. `default_thread_pool()`.
+/// \return The baked data, to be passed to `upload` on the GL thread.
+auto bake_obj_file(const std::string &fname, thread_pool& pool) -> std::optional<mesh_blob>;
+
 } // namespace sushi
 
 #endif // SUSHI_OBJ_LOADER_HPP
@@ -1,5 +1,8 @@
 #include "pose.hpp"
 
+#include "mesh_utils.hpp"
+#include "pose_evaluator.hpp"
+
 #include <glm/glm.hpp>
 
 #include <algorithm>
@@ -11,98 +14,83 @@ pose::pose(const skeleton& skele, span<const transform> single) : skele(&skele),
 pose::pose(const skeleton& skele, blended_pose_data blended) : skele(&skele), pose_data(blended) {}
 
 void pose::set_uniform(GLint uniform_location) const {
-    glm::mat4 mats[32];
+    evaluate();
 
-    auto sz = std::min(std::size_t{32}, skele->bones.size());
+    auto sz = std::min(std::size_t{32}, skinning_transforms.size());
 
-    switch (pose_data.index()) {
-        case NULLPOSE: {
-            for (auto i = 0; i < sz; ++i) {
-                mats[i] = glm::mat4(1.f);
-            }
-            break;
-        }
-        case SINGLE: {
-            auto& s = std::get<SINGLE>(pose_data);
+    if (sz > 0) {
+        glUniformMatrix4fv(uniform_location, sz, GL_FALSE, glm::value_ptr(skinning_transforms[0]));
+    }
+}
+
+auto pose::get_skinning_transforms() const -> span<const glm::mat4> {
+    evaluate();
+    return {skinning_transforms.data(), skinning_transforms.size()};
+}
 
-            for (auto i = 0; i < sz; ++i) {
-                auto parent = skele->bones[i].parent;
-                auto& mat = mats[i];
+auto pose::get_bone_transform(int i) const -> glm::mat4 {
+    evaluate();
+    return model_transforms[i];
+}
 
-                mat = to_mat4(s[i]);
+void pose::get_bone_transforms(span<const int> bones, span<glm::mat4> out) const {
+    evaluate();
 
-                if (parent >= 0) {
-                    mat = mats[parent] * mat;
-                }
-            }
+    for (auto i = std::size_t{0}; i < bones.size(); ++i) {
+        out[i] = model_transforms[bones[i]];
+    }
+}
+
+void pose::evaluate() const {
+    if (evaluated) {
+        return;
+    }
+
+    // Scratch memory is reused across poses, rather than reallocated per frame.
+    thread_local pose_evaluator evaluator;
+
+    auto sz = skele->get_num_bones();
+
+    switch (pose_data.index()) {
+        case SINGLE: {
+            sz = std::min(sz, std::get<SINGLE>(pose_data).size());
             break;
         }
         case BLENDED: {
             auto& b = std::get<BLENDED>(pose_data);
-
-            for (auto i = 0; i < sz; ++i) {
-                auto parent = skele->bones[i].parent;
-                auto& mat = mats[i];
-
-                mat = to_mat4(mix(b.from[i], b.to[i], b.alpha));
-
-                if (parent >= 0) {
-                    mat = mats[parent] * mat;
-                }
-            }
+            sz = std::min({sz, b.from.size(), b.to.size()});
             break;
         }
     }
 
-    for (auto i = 0; i < sz; ++i) {
-        mats[i] = mats[i] * skele->bones[i].base_pose_inverse;
-    }
+    model_transforms.resize(sz);
+    skinning_transforms.resize(sz);
 
-    glUniformMatrix4fv(uniform_location, sz, GL_FALSE, glm::value_ptr(mats[0]));
-}
-
-auto pose::get_bone_transform(int i) const -> glm::mat4 {
     switch (pose_data.index()) {
         case NULLPOSE: {
-            return skele->bones[i].base_pose;
+            for (auto i = std::size_t{0}; i < sz; ++i) {
+                model_transforms[i] = skele->base_poses[i];
+                skinning_transforms[skele->joint_indices[i]] = skele->base_pose_inverses[i];
+            }
+            evaluated = true;
+            return;
         }
         case SINGLE: {
-            auto& s = std::get<SINGLE>(pose_data);
-
-            auto get_mat = [&](const auto& get_mat, int i) -> glm::mat4 {
-                auto parent = skele->bones[i].parent;
-
-                auto mat = to_mat4(s[i]);
-
-                if (parent >= 0) {
-                    mat = get_mat(get_mat, parent) * mat;
-                }
-
-                return mat;
-            };
-
-            return get_mat(get_mat, i);
+            evaluator.evaluate(*skele, std::get<SINGLE>(pose_data), skinning_transforms);
+            break;
         }
         case BLENDED: {
             auto& b = std::get<BLENDED>(pose_data);
-
-            auto get_mat = [&](const auto& get_mat, int i) -> glm::mat4 {
-                auto parent = skele->bones[i].parent;
-
-                auto mat = to_mat4(mix(b.from[i], b.to[i], b.alpha));
-
-                if (parent >= 0) {
-                    mat = get_mat(get_mat, parent) * mat;
-                }
-
-                return mat;
-            };
-
-            return get_mat(get_mat, i);
+            evaluator.evaluate(*skele, b.from, b.to, b.alpha, skinning_transforms);
+            break;
         }
-        default:
-            return glm::mat4(1.f);
     }
+
+    for (auto i = std::size_t{0}; i < sz; ++i) {
+        model_transforms[i] = evaluator.get_model_transform(i);
+    }
+
+    evaluated = true;
 }
 
 auto get_pose(const skeleton& skele, std::optional<int> anim_index, float time, bool smooth) -> pose {
@@ -125,7 +113,13 @@ auto get_pose(const skeleton& skele, std::optional<int> anim_index, float time,
     }
 }
 
-void draw_mesh(const mesh_group& group, const pose& pose) {
+#ifdef __EMSCRIPTEN__
+
+namespace {
+
+/// Draws an animated mesh, once `set_bones` has been given the location of the `Bones` uniform.
+template <typename SetBones>
+void draw_animated_mesh(const mesh_group& group, SetBones&& set_bones) {
     GLint program;
     glGetIntegerv(GL_CURRENT_PROGRAM, &program);
 
@@ -133,13 +127,36 @@ void draw_mesh(const mesh_group& group, const pose& pose) {
 
     auto bones_uniform = glGetUniformLocation(program, "Bones");
 
+    auto octahedral_uniform = glGetUniformLocation(program, "OctahedralNormals");
+
     glUniform1i(animated_uniform, 1);
-    pose.set_uniform(bones_uniform);
+    glUniform1i(octahedral_uniform, group.options.octahedral_normals);
+    set_bones(bones_uniform);
+
+    glBindVertexArray(group.vao.get());
+    SUSHI_DEFER { glBindVertexArray(0); };
 
     for (const auto& mesh : group.meshes) {
-        glBindVertexArray(mesh.vao.get());
-        glDrawElements(GL_TRIANGLES, mesh.num_tris * 3, GL_UNSIGNED_INT, nullptr);
+        _detail::draw_elements(group, mesh);
     }
 }
 
+} // namespace
+
+void draw_mesh(const mesh_group& group, const pose& pose) {
+    draw_animated_mesh(group, [&](GLint bones_uniform) { pose.set_uniform(bones_uniform); });
+}
+
+void draw_mesh(const mesh_group& group, span<const glm::mat4> palette) {
+    draw_animated_mesh(group, [&](GLint bones_uniform) {
+        auto sz = std::min(std::size_t{32}, palette.size());
+
+        if (sz > 0) {
+            glUniformMatrix4fv(bones_uniform, sz, GL_FALSE, glm::value_ptr(palette[0]));
+        }
+    });
+}
+
+#endif
+
 } // namespace sushi
@@ -15,6 +15,12 @@
 /// Sushi
 namespace sushi {
 
+/// A skeleton's pose for one frame.
+///
+/// Model-space and skinning matrices are evaluated together the first time either is needed, and cached,
+/// so any number of bone queries and uniform uploads cost a single evaluation.
+/// Since the cache is filled from const member functions, a pose must not be shared between threads
+/// until it has been evaluated.
 class pose {
 public:
     struct nullpose {};
@@ -30,10 +36,23 @@ public:
     pose(const skeleton& skele, span<const transform> single);
     pose(const skeleton& skele, blended_pose_data blended);
 
+    /// Uploads the skinning matrices of the first 32 joints, for shaders without a `BonePalette` (such as on WebGL 1).
+    /// \param uniform_location Location of a `mat4[32]` uniform.
     void set_uniform(GLint uniform_location) const;
 
+    /// Gets the skinning matrix of each joint, as uploaded by `set_uniform`.
+    auto get_skinning_transforms() const -> span<const glm::mat4>;
+
+    /// Gets the model-space transform of a bone.
+    /// \param i Index of the bone, as from `get_bone_index`.
+    /// \return The transform.
     auto get_bone_transform(int i) const -> glm::mat4;
 
+    /// Gets the model-space transforms of several bones.
+    /// \param bones Indices of the bones.
+    /// \param out Receives the transform of each bone in `bones`. Must be at least as large.
+    void get_bone_transforms(span<const int> bones, span<glm::mat4> out) const;
+
 private:
     enum pose_type {
         NULLPOSE,
@@ -41,14 +60,33 @@ private:
         BLENDED,
     };
 
+    void evaluate() const;
+
     const skeleton* skele; /** Never null. */
     std::variant<nullpose, span<const transform>, blended_pose_data> pose_data;
+
+    mutable bool evaluated = false;
+    mutable std::vector<glm::mat4> model_transforms;
+    mutable std::vector<glm::mat4> skinning_transforms;
 };
 
 auto get_pose(const skeleton& skele, std::optional<int> anim_index, float time, bool smooth) -> pose;
 
+// Elsewhere, animated meshes are drawn through a `bone_palette_buffer`, which has its own overloads.
+#ifdef __EMSCRIPTEN__
+
+/// Draws an animated mesh, uploading the first 32 skinning matrices to the `Bones` uniform.
+/// \param group The mesh to draw.
+/// \param pose The pose of the group's skeleton.
 void draw_mesh(const mesh_group& group, const pose& pose);
 
+/// Draws an animated mesh with precomputed skinning matrices, such as those of an `animation_batch`.
+/// \param group The mesh to draw.
+/// \param palette Skinning matrix of each joint. Only the first 32 are used.
+void draw_mesh(const mesh_group& group, span<const glm::mat4> palette);
+
+#endif // __EMSCRIPTEN__
+
 } // namespace sushi
 
 #endif // SUSHI_POSE_HPP
\ No newline at end of file
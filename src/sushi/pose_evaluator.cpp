@@ -0,0 +1,370 @@
+#include "pose_evaluator.hpp"
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace sushi {
+
+namespace {
+
+// A group of bones' values for one component, operated on by a single SIMD instruction.
+// Kernels are written once against this type, rather than relying on auto-vectorization,
+// which compilers refuse for loops containing `std::sqrt` unless errno handling is disabled.
+#if defined(__AVX__)
+
+struct lane {
+    static constexpr std::size_t width = 8;
+    __m256 v;
+
+    static auto load(const float* p) -> lane { return {_mm256_loadu_ps(p)}; }
+    static auto broadcast(float f) -> lane { return {_mm256_set1_ps(f)}; }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+    friend auto operator+(lane a, lane b) -> lane { return {_mm256_add_ps(a.v, b.v)}; }
+    friend auto operator-(lane a, lane b) -> lane { return {_mm256_sub_ps(a.v, b.v)}; }
+    friend auto operator*(lane a, lane b) -> lane { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend auto operator/(lane a, lane b) -> lane { return {_mm256_div_ps(a.v, b.v)}; }
+    friend auto sqrt(lane a) -> lane { return {_mm256_sqrt_ps(a.v)}; }
+
+    /// Gets the sign bit of each value.
+    friend auto sign_bit(lane a) -> lane { return {_mm256_and_ps(a.v, _mm256_set1_ps(-0.f))}; }
+
+    /// Flips the sign of each value whose corresponding `sign` has its sign bit set.
+    friend auto flip_sign(lane a, lane sign) -> lane { return {_mm256_xor_ps(a.v, sign.v)}; }
+};
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+struct lane {
+    static constexpr std::size_t width = 4;
+    __m128 v;
+
+    static auto load(const float* p) -> lane { return {_mm_loadu_ps(p)}; }
+    static auto broadcast(float f) -> lane { return {_mm_set1_ps(f)}; }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+
+    friend auto operator+(lane a, lane b) -> lane { return {_mm_add_ps(a.v, b.v)}; }
+    friend auto operator-(lane a, lane b) -> lane { return {_mm_sub_ps(a.v, b.v)}; }
+    friend auto operator*(lane a, lane b) -> lane { return {_mm_mul_ps(a.v, b.v)}; }
+    friend auto operator/(lane a, lane b) -> lane { return {_mm_div_ps(a.v, b.v)}; }
+    friend auto sqrt(lane a) -> lane { return {_mm_sqrt_ps(a.v)}; }
+    friend auto sign_bit(lane a) -> lane { return {_mm_and_ps(a.v, _mm_set1_ps(-0.f))}; }
+    friend auto flip_sign(lane a, lane sign) -> lane { return {_mm_xor_ps(a.v, sign.v)}; }
+};
+
+#else
+
+struct lane {
+    static constexpr std::size_t width = 1;
+    float v;
+
+    static auto load(const float* p) -> lane { return {*p}; }
+    static auto broadcast(float f) -> lane { return {f}; }
+    void store(float* p) const { *p = v; }
+
+    friend auto operator+(lane a, lane b) -> lane { return {a.v + b.v}; }
+    friend auto operator-(lane a, lane b) -> lane { return {a.v - b.v}; }
+    friend auto operator*(lane a, lane b) -> lane { return {a.v * b.v}; }
+    friend auto operator/(lane a, lane b) -> lane { return {a.v / b.v}; }
+    friend auto sqrt(lane a) -> lane { return {std::sqrt(a.v)}; }
+    friend auto sign_bit(lane a) -> lane { return {std::signbit(a.v) ? -0.f : 0.f}; }
+    friend auto flip_sign(lane a, lane sign) -> lane { return {std::signbit(sign.v) ? -a.v : a.v}; }
+};
+
+#endif
+
+static_assert(pose_evaluator::lanes % lane::width == 0, "Planes must be padded to a whole number of SIMD lanes");
+
+enum transform_plane { PX, PY, PZ, RX, RY, RZ, RW, SX, SY, SZ, DOT };
+
+/// Largest rotation error of normalized linear interpolation between two rotations, over every blend factor.
+/// \param theta Angle between the rotations as unit quaternions, which is half the angle between the rotations.
+auto get_nlerp_error(float theta) -> float {
+    auto error = 0.f;
+
+    for (auto i = 1; i < 64; ++i) {
+        auto t = i / 64.f;
+        auto actual = std::atan2(t * std::sin(theta), (1 - t) + t * std::cos(theta));
+        error = std::max(error, 2 * std::abs(t * theta - actual));
+    }
+
+    return error;
+}
+
+/// Finds the cosine of the largest quaternion angle at which nlerp stays within the error limit.
+auto find_nlerp_threshold(const pose_blend_options& options) -> float {
+    if (!options.fast) {
+        return 2; // Above any dot product, so nlerp is never used.
+    }
+
+    // The error grows with the angle, so the largest angle within the limit can be bisected.
+    auto lo = 0.f;
+    auto hi = glm::pi<float>() / 2;
+
+    if (get_nlerp_error(hi) <= options.max_error) {
+        return 0;
+    }
+
+    for (auto i = 0; i < 32; ++i) {
+        auto mid = (lo + hi) / 2;
+
+        if (get_nlerp_error(mid) <= options.max_error) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return std::cos(lo);
+}
+
+/// Multiplies two 3x4 affine matrices, stored row by row.
+void multiply_affine(const float* a, const float* b, float* out) {
+#if defined(__SSE2__) || defined(_M_X64)
+    const auto b0 = _mm_loadu_ps(b);
+    const auto b1 = _mm_loadu_ps(b + 4);
+    const auto b2 = _mm_loadu_ps(b + 8);
+
+    for (auto row = 0; row < 3; ++row) {
+        const auto r = a + row * 4;
+        auto o = _mm_set_ps(r[3], 0, 0, 0);
+        o = _mm_add_ps(o, _mm_mul_ps(_mm_set1_ps(r[0]), b0));
+        o = _mm_add_ps(o, _mm_mul_ps(_mm_set1_ps(r[1]), b1));
+        o = _mm_add_ps(o, _mm_mul_ps(_mm_set1_ps(r[2]), b2));
+        _mm_storeu_ps(out + row * 4, o);
+    }
+#else
+    for (auto row = 0; row < 3; ++row) {
+        const auto r0 = a[row * 4 + 0];
+        const auto r1 = a[row * 4 + 1];
+        const auto r2 = a[row * 4 + 2];
+        const auto r3 = a[row * 4 + 3];
+        const auto o = out + row * 4;
+
+        o[0] = r0 * b[0] + r1 * b[4] + r2 * b[8];
+        o[1] = r0 * b[1] + r1 * b[5] + r2 * b[9];
+        o[2] = r0 * b[2] + r1 * b[6] + r2 * b[10];
+        o[3] = r0 * b[3] + r1 * b[7] + r2 * b[11] + r3;
+    }
+#endif
+}
+
+} // namespace
+
+pose_evaluator::pose_evaluator(const pose_blend_options& options)
+    : nlerp_threshold(find_nlerp_threshold(options)) {}
+
+void pose_evaluator::evaluate(const skeleton& skele, span<const transform> local, span<glm::mat4> out) {
+    resize(std::min(skele.get_num_bones(), local.size()));
+    load(local, from_planes.data());
+    compose(from_planes.data());
+    finish(skele, out);
+}
+
+void pose_evaluator::evaluate(
+    const skeleton& skele,
+    span<const transform> from,
+    span<const transform> to,
+    float alpha,
+    span<glm::mat4> out) {
+
+    resize(std::min({skele.get_num_bones(), from.size(), to.size()}));
+    load(from, from_planes.data());
+    load(to, to_planes.data());
+    blend(alpha);
+    compose(blend_planes.data());
+    finish(skele, out);
+}
+
+auto pose_evaluator::get_model_transform(std::size_t bone) const -> glm::mat4 {
+    auto mat = glm::mat4(1.f);
+
+    for (auto row = 0; row < 3; ++row) {
+        for (auto col = 0; col < 4; ++col) {
+            mat[col][row] = model_transforms[bone][row * 4 + col];
+        }
+    }
+
+    return mat;
+}
+
+void pose_evaluator::resize(std::size_t bones) {
+    num_bones = bones;
+    stride = (bones + lanes - 1) / lanes * lanes;
+
+    from_planes.resize(10 * stride);
+    to_planes.resize(10 * stride);
+    blend_planes.resize(11 * stride);
+    local_planes.resize(12 * stride);
+    model_transforms.resize(bones);
+}
+
+void pose_evaluator::load(span<const transform> local, float* planes) {
+    for (auto i = std::size_t{0}; i < stride; ++i) {
+        // Padding lanes get the identity, so they never produce NaNs.
+        const auto x = i < num_bones ? local[i] : transform{};
+
+        planes[PX * stride + i] = x.pos.x;
+        planes[PY * stride + i] = x.pos.y;
+        planes[PZ * stride + i] = x.pos.z;
+        planes[RX * stride + i] = x.rot.x;
+        planes[RY * stride + i] = x.rot.y;
+        planes[RZ * stride + i] = x.rot.z;
+        planes[RW * stride + i] = x.rot.w;
+        planes[SX * stride + i] = x.scl.x;
+        planes[SY * stride + i] = x.scl.y;
+        planes[SZ * stride + i] = x.scl.z;
+    }
+}
+
+void pose_evaluator::blend(float alpha) {
+    const auto a = from_planes.data();
+    const auto b = to_planes.data();
+    const auto o = blend_planes.data();
+    const auto n = stride;
+
+    const auto t = lane::broadcast(alpha);
+
+    for (auto i = std::size_t{0}; i < n; i += lane::width) {
+        for (auto p : {PX, PY, PZ, SX, SY, SZ}) {
+            auto from = lane::load(a + p * n + i);
+            auto to = lane::load(b + p * n + i);
+            (from + (to - from) * t).store(o + p * n + i);
+        }
+
+        // Rotations are blended with nlerp in every lane, taking the shorter path.
+        auto ax = lane::load(a + RX * n + i), ay = lane::load(a + RY * n + i);
+        auto az = lane::load(a + RZ * n + i), aw = lane::load(a + RW * n + i);
+        auto bx = lane::load(b + RX * n + i), by = lane::load(b + RY * n + i);
+        auto bz = lane::load(b + RZ * n + i), bw = lane::load(b + RW * n + i);
+
+        auto d = ax * bx + ay * by + az * bz + aw * bw;
+        auto sign = sign_bit(d);
+
+        auto qx = ax + (flip_sign(bx, sign) - ax) * t;
+        auto qy = ay + (flip_sign(by, sign) - ay) * t;
+        auto qz = az + (flip_sign(bz, sign) - az) * t;
+        auto qw = aw + (flip_sign(bw, sign) - aw) * t;
+
+        auto inv_len = lane::broadcast(1) / sqrt(qx * qx + qy * qy + qz * qz + qw * qw);
+
+        (qx * inv_len).store(o + RX * n + i);
+        (qy * inv_len).store(o + RY * n + i);
+        (qz * inv_len).store(o + RZ * n + i);
+        (qw * inv_len).store(o + RW * n + i);
+        flip_sign(d, sign).store(o + DOT * n + i);
+    }
+
+    // Lanes whose rotations are too far apart for nlerp's error bound are redone with slerp.
+    for (auto i = std::size_t{0}; i < num_bones; ++i) {
+        if (o[DOT * n + i] < nlerp_threshold) {
+            auto qa = glm::quat(a[RW * n + i], a[RX * n + i], a[RY * n + i], a[RZ * n + i]);
+            auto qb = glm::quat(b[RW * n + i], b[RX * n + i], b[RY * n + i], b[RZ * n + i]);
+            auto q = glm::slerp(qa, qb, alpha);
+
+            o[RX * n + i] = q.x;
+            o[RY * n + i] = q.y;
+            o[RZ * n + i] = q.z;
+            o[RW * n + i] = q.w;
+        }
+    }
+}
+
+void pose_evaluator::compose(const float* planes) {
+    const auto p = planes;
+    const auto m = local_planes.data();
+    const auto n = stride;
+
+    const auto one = lane::broadcast(1);
+    const auto two = lane::broadcast(2);
+
+    // Translation, rotation, and scale are written straight into the rows of a 3x4 matrix.
+    for (auto i = std::size_t{0}; i < n; i += lane::width) {
+        auto x = lane::load(p + RX * n + i), y = lane::load(p + RY * n + i);
+        auto z = lane::load(p + RZ * n + i), w = lane::load(p + RW * n + i);
+        auto sx = lane::load(p + SX * n + i), sy = lane::load(p + SY * n + i), sz = lane::load(p + SZ * n + i);
+
+        auto xx = x * x, yy = y * y, zz = z * z;
+        auto xy = x * y, xz = x * z, yz = y * z;
+        auto wx = w * x, wy = w * y, wz = w * z;
+
+        ((one - two * (yy + zz)) * sx).store(m + 0 * n + i);
+        (two * (xy - wz) * sy).store(m + 1 * n + i);
+        (two * (xz + wy) * sz).store(m + 2 * n + i);
+        lane::load(p + PX * n + i).store(m + 3 * n + i);
+
+        (two * (xy + wz) * sx).store(m + 4 * n + i);
+        ((one - two * (xx + zz)) * sy).store(m + 5 * n + i);
+        (two * (yz - wx) * sz).store(m + 6 * n + i);
+        lane::load(p + PY * n + i).store(m + 7 * n + i);
+
+        (two * (xz - wy) * sx).store(m + 8 * n + i);
+        (two * (yz + wx) * sy).store(m + 9 * n + i);
+        ((one - two * (xx + yy)) * sz).store(m + 10 * n + i);
+        lane::load(p + PZ * n + i).store(m + 11 * n + i);
+    }
+}
+
+void pose_evaluator::finish(const skeleton& skele, span<glm::mat4> out) {
+    const auto n = stride;
+
+    // Each bone depends on its parent, so the hierarchy is walked one bone at a time,
+    // on whole matrices rather than planes, which keeps each bone's chain of multiplies in registers.
+    for (auto i = std::size_t{0}; i < num_bones; ++i) {
+        float local[12];
+
+        for (auto e = 0; e < 12; ++e) {
+            local[e] = local_planes[e * n + i];
+        }
+
+        auto& model = model_transforms[i];
+        auto parent = skele.parents[i];
+
+        if (parent >= 0) {
+            multiply_affine(model_transforms[parent].data(), local, model.data());
+        } else {
+            std::copy(local, local + 12, model.begin());
+        }
+
+        const auto& inverse = skele.base_pose_inverses[i];
+
+        float bind[12];
+        float skin[12];
+
+        for (auto row = 0; row < 3; ++row) {
+            for (auto col = 0; col < 4; ++col) {
+                bind[row * 4 + col] = inverse[col][row];
+            }
+        }
+
+        multiply_affine(model.data(), bind, skin);
+
+        // Skinning matrices are indexed like meshes' blend indices.
+        auto joint = std::size_t(skele.joint_indices[i]);
+
+        if (joint >= out.size()) {
+            continue;
+        }
+
+        auto& mat = out[joint];
+
+        for (auto row = 0; row < 3; ++row) {
+            for (auto col = 0; col < 4; ++col) {
+                mat[col][row] = skin[row * 4 + col];
+            }
+        }
+
+        mat[0][3] = 0;
+        mat[1][3] = 0;
+        mat[2][3] = 0;
+        mat[3][3] = 1;
+    }
+}
+
+} // namespace sushi
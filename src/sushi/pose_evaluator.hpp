@@ -0,0 +1,82 @@
+#ifndef SUSHI_POSE_EVALUATOR_HPP
+#define SUSHI_POSE_EVALUATOR_HPP
+
+#include "common.hpp"
+#include "skeleton.hpp"
+#include "transform.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+/// Sushi
+namespace sushi {
+
+/// Options for blending between poses.
+struct pose_blend_options {
+    /// Blends rotations with normalized linear interpolation wherever its error is within `max_error`,
+    /// falling back to slerp for bones whose rotations are further apart.
+    bool fast = true;
+
+    /// Largest rotation error allowed from normalized linear interpolation, in radians.
+    float max_error = 1e-3f;
+};
+
+/// Evaluates skeleton poses into skinning matrices, many bones at a time.
+///
+/// Local transforms are split into one array per component, and blending and composing are loops over whole arrays,
+/// written with SSE or AVX intrinsics which process 4 or 8 bones per instruction (or one bone at a time without either).
+/// Transforms are composed straight into 3x4 affine matrices, which are only widened to `glm::mat4` on output.
+/// Only the walk down the hierarchy, and the skinning multiply fused into it, are done one bone at a time,
+/// since each bone depends on its parent.
+///
+/// An evaluator holds scratch memory only, so one can be reused for any number of skeletons.
+class pose_evaluator {
+public:
+    /// Number of bones processed together. Arrays are padded to a multiple of this.
+    static constexpr std::size_t lanes = 8;
+
+    explicit pose_evaluator(const pose_blend_options& options = {});
+
+    /// Evaluates a single set of local transforms.
+    /// \param skele The skeleton.
+    /// \param local Local transform of each bone.
+    /// \param out Receives the skinning matrix of each bone, indexed by joint. Joints past its size are skipped.
+    void evaluate(const skeleton& skele, span<const transform> local, span<glm::mat4> out);
+
+    /// Evaluates a blend between two sets of local transforms.
+    /// \param skele The skeleton.
+    /// \param from Local transform of each bone at `alpha == 0`.
+    /// \param to Local transform of each bone at `alpha == 1`.
+    /// \param alpha Blend factor.
+    /// \param out Receives the skinning matrix of each bone, indexed by joint. Joints past its size are skipped.
+    void evaluate(const skeleton& skele, span<const transform> from, span<const transform> to, float alpha, span<glm::mat4> out);
+
+    /// Gets the model-space transform of a bone (not joint) from the last evaluation.
+    auto get_model_transform(std::size_t bone) const -> glm::mat4;
+
+    /// Gets the cosine of the largest angle between two rotations (as quaternions) which may be blended with nlerp.
+    auto get_nlerp_threshold() const -> float { return nlerp_threshold; }
+
+private:
+    void resize(std::size_t bones);
+    void load(span<const transform> local, float* planes);
+    void blend(float alpha);
+    void compose(const float* planes);
+    void finish(const skeleton& skele, span<glm::mat4> out);
+
+    float nlerp_threshold;
+    std::size_t num_bones = 0;
+    std::size_t stride = 0; /** Length of each plane, a multiple of `lanes`. */
+    std::vector<float> from_planes; /** 10 planes: position xyz, rotation xyzw, scale xyz. */
+    std::vector<float> to_planes;
+    std::vector<float> blend_planes; /** 10 planes like `from_planes`, then the dot product of each pair of rotations. */
+    std::vector<float> local_planes; /** 12 planes: the rows of each local 3x4 matrix. */
+    std::vector<std::array<float, 12>> model_transforms; /** Rows of each bone's model-space 3x4 matrix. */
+};
+
+} // namespace sushi
+
+#endif // SUSHI_POSE_EVALUATOR_HPP
@@ -0,0 +1,242 @@
+#include "range_allocator.hpp"
+
+#include <algorithm>
+
+namespace sushi {
+
+namespace {
+
+constexpr int sl_bits = 4; // Must match range_allocator::sl_bits.
+
+/// Index of the highest set bit. `x` must not be 0.
+auto find_last_set(std::uint64_t x) -> int {
+    auto bit = 0;
+    for (auto shift = 32; shift > 0; shift /= 2) {
+        if (x >> shift) {
+            x >>= shift;
+            bit += shift;
+        }
+    }
+    return bit;
+}
+
+/// Index of the lowest set bit. `x` must not be 0.
+auto find_first_set(std::uint64_t x) -> int {
+    return find_last_set(x & (~x + 1));
+}
+
+struct list_index {
+    int fl;
+    int sl;
+};
+
+/// Gets the free list holding blocks of the given size.
+auto get_list(std::size_t size) -> list_index {
+    if (size < (std::size_t{1} << sl_bits)) {
+        return {0, int(size)};
+    }
+
+    auto fl = find_last_set(size);
+    auto sl = int((size >> (fl - sl_bits)) ^ (std::size_t{1} << sl_bits));
+    return {fl - sl_bits + 1, sl};
+}
+
+/// Gets the first free list whose blocks are all at least the given size.
+auto get_list_at_least(std::size_t size) -> list_index {
+    if (size >= (std::size_t{1} << sl_bits)) {
+        size += (std::size_t{1} << (find_last_set(size) - sl_bits)) - 1;
+    }
+
+    return get_list(size);
+}
+
+} // namespace
+
+range_allocator::range_allocator(std::size_t capacity) : capacity(capacity) {
+    for (auto& heads : free_heads) {
+        heads.fill(none);
+    }
+
+    if (capacity > 0) {
+        auto b = new_block();
+        blocks[b].size = capacity;
+        insert_free(b);
+    }
+}
+
+auto range_allocator::allocate(std::size_t size) -> std::optional<allocation> {
+    if (size == 0 || size > capacity) {
+        return std::nullopt;
+    }
+
+    auto b = find_free(size);
+
+    if (b == none) {
+        return std::nullopt;
+    }
+
+    remove_free(b);
+
+    // The remainder is split off and returned to the free lists.
+    if (blocks[b].size > size) {
+        auto rest = new_block();
+        auto& blk = blocks[b];
+        auto& rest_blk = blocks[rest];
+
+        rest_blk.offset = blk.offset + size;
+        rest_blk.size = blk.size - size;
+        rest_blk.prev_phys = b;
+        rest_blk.next_phys = blk.next_phys;
+
+        if (blk.next_phys != none) {
+            blocks[blk.next_phys].prev_phys = rest;
+        }
+
+        blk.next_phys = rest;
+        blk.size = size;
+
+        insert_free(rest);
+    }
+
+    used += size;
+
+    return allocation{blocks[b].offset, size, b};
+}
+
+void range_allocator::free(const allocation& range) {
+    auto b = range.id;
+
+    used -= blocks[b].size;
+
+    // Free neighbours are absorbed into this block, and their slots recycled.
+    auto prev = blocks[b].prev_phys;
+
+    if (prev != none && blocks[prev].is_free) {
+        remove_free(prev);
+        blocks[prev].size += blocks[b].size;
+        blocks[prev].next_phys = blocks[b].next_phys;
+        if (blocks[b].next_phys != none) {
+            blocks[blocks[b].next_phys].prev_phys = prev;
+        }
+        unused_blocks.push_back(b);
+        b = prev;
+    }
+
+    auto next = blocks[b].next_phys;
+
+    if (next != none && blocks[next].is_free) {
+        remove_free(next);
+        blocks[b].size += blocks[next].size;
+        blocks[b].next_phys = blocks[next].next_phys;
+        if (blocks[next].next_phys != none) {
+            blocks[blocks[next].next_phys].prev_phys = b;
+        }
+        unused_blocks.push_back(next);
+    }
+
+    insert_free(b);
+}
+
+auto range_allocator::get_largest_free() const -> std::size_t {
+    if (fl_bitmap == 0) {
+        return 0;
+    }
+
+    auto fl = find_last_set(fl_bitmap);
+    auto sl = find_last_set(sl_bitmaps[fl]);
+    auto largest = std::size_t{0};
+
+    for (auto b = free_heads[fl][sl]; b != none; b = blocks[b].next_free) {
+        largest = std::max(largest, blocks[b].size);
+    }
+
+    return largest;
+}
+
+auto range_allocator::new_block() -> std::uint32_t {
+    if (!unused_blocks.empty()) {
+        auto b = unused_blocks.back();
+        unused_blocks.pop_back();
+        blocks[b] = {};
+        return b;
+    }
+
+    blocks.emplace_back();
+    return std::uint32_t(blocks.size() - 1);
+}
+
+void range_allocator::insert_free(std::uint32_t b) {
+    auto [fl, sl] = get_list(blocks[b].size);
+    auto& head = free_heads[fl][sl];
+
+    blocks[b].is_free = true;
+    blocks[b].prev_free = none;
+    blocks[b].next_free = head;
+
+    if (head != none) {
+        blocks[head].prev_free = b;
+    }
+
+    head = b;
+    fl_bitmap |= std::uint64_t{1} << fl;
+    sl_bitmaps[fl] |= std::uint32_t{1} << sl;
+}
+
+void range_allocator::remove_free(std::uint32_t b) {
+    auto [fl, sl] = get_list(blocks[b].size);
+    auto& blk = blocks[b];
+
+    if (blk.prev_free != none) {
+        blocks[blk.prev_free].next_free = blk.next_free;
+    } else {
+        free_heads[fl][sl] = blk.next_free;
+    }
+
+    if (blk.next_free != none) {
+        blocks[blk.next_free].prev_free = blk.prev_free;
+    }
+
+    if (free_heads[fl][sl] == none) {
+        sl_bitmaps[fl] &= ~(std::uint32_t{1} << sl);
+        if (sl_bitmaps[fl] == 0) {
+            fl_bitmap &= ~(std::uint64_t{1} << fl);
+        }
+    }
+
+    blk.is_free = false;
+    blk.prev_free = none;
+    blk.next_free = none;
+}
+
+auto range_allocator::find_free(std::size_t size) const -> std::uint32_t {
+    auto [fl, sl] = get_list_at_least(size);
+
+    // Any block in a list at or above this one is large enough.
+    auto sl_map = sl_bitmaps[fl] & (~std::uint32_t{0} << sl);
+
+    if (sl_map == 0) {
+        auto fl_map = fl + 1 < fl_count ? fl_bitmap & (~std::uint64_t{0} << (fl + 1)) : 0;
+
+        if (fl_map != 0) {
+            fl = find_first_set(fl_map);
+            sl_map = sl_bitmaps[fl];
+        }
+    }
+
+    if (sl_map != 0) {
+        return free_heads[fl][find_first_set(sl_map)];
+    }
+
+    // Only the list the size itself falls into might still have a large enough block, which is searched as a last resort.
+    auto exact = get_list(size);
+
+    for (auto b = free_heads[exact.fl][exact.sl]; b != none; b = blocks[b].next_free) {
+        if (blocks[b].size >= size) {
+            return b;
+        }
+    }
+
+    return none;
+}
+
+} // namespace sushi
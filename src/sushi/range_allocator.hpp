@@ -0,0 +1,76 @@
+#ifndef SUSHI_RANGE_ALLOCATOR_HPP
+#define SUSHI_RANGE_ALLOCATOR_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/// Sushi
+namespace sushi {
+
+/// Hands out ranges of an abstract address space, such as a GPU buffer, using a two-level segregated fit (TLSF) scheme.
+/// Allocation and freeing take constant time, and adjacent free ranges are always merged.
+/// Bookkeeping is kept separately from the space being managed, so it never touches the memory it describes.
+class range_allocator {
+public:
+    /// An allocated range.
+    struct allocation {
+        std::size_t offset = 0;
+        std::size_t size = 0;
+        std::uint32_t id = 0; /** Identifies the range for `free`. */
+    };
+
+    /// Constructs an allocator for the units `[0, capacity)`.
+    explicit range_allocator(std::size_t capacity = 0);
+
+    /// Allocates a range.
+    /// \param size Number of units. Must not be 0.
+    /// \return The range, or nothing if no free range is large enough.
+    auto allocate(std::size_t size) -> std::optional<allocation>;
+
+    /// Frees a range previously returned by `allocate`.
+    void free(const allocation& range);
+
+    auto get_capacity() const -> std::size_t { return capacity; }
+
+    /// Gets the number of units in allocated ranges.
+    auto get_used() const -> std::size_t { return used; }
+
+    /// Gets the size of the largest range which could currently be allocated.
+    auto get_largest_free() const -> std::size_t;
+
+private:
+    static constexpr std::uint32_t none = ~std::uint32_t{0};
+    static constexpr int sl_bits = 4;
+    static constexpr int sl_count = 1 << sl_bits;
+    static constexpr int fl_count = 64 - sl_bits + 1;
+
+    struct block {
+        std::size_t offset = 0;
+        std::size_t size = 0;
+        std::uint32_t prev_phys = none; /** The block just before this one in the address space. */
+        std::uint32_t next_phys = none;
+        std::uint32_t prev_free = none; /** Neighbours in this block's free list, while it is free. */
+        std::uint32_t next_free = none;
+        bool is_free = false;
+    };
+
+    auto new_block() -> std::uint32_t;
+    void insert_free(std::uint32_t b);
+    void remove_free(std::uint32_t b);
+    auto find_free(std::size_t size) const -> std::uint32_t;
+
+    std::size_t capacity;
+    std::size_t used = 0;
+    std::vector<block> blocks;
+    std::vector<std::uint32_t> unused_blocks; /** Slots in `blocks` which can be reused. */
+    std::uint64_t fl_bitmap = 0; /** Bit `fl` is set if any list in that first level is non-empty. */
+    std::array<std::uint32_t, fl_count> sl_bitmaps = {};
+    std::array<std::array<std::uint32_t, sl_count>, fl_count> free_heads;
+};
+
+} // namespace sushi
+
+#endif // SUSHI_RANGE_ALLOCATOR_HPP
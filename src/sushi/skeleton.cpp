@@ -1,37 +1,93 @@
 #include "skeleton.hpp"
 
 #include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
 
 namespace sushi {
 
+namespace {
+
+/// Finds the depth of every joint in the hierarchy.
+/// \throws std::runtime_error If a parent is out of range, or a joint is its own ancestor.
+auto get_joint_depths(const iqm::iqm_data& data) -> std::vector<std::size_t> {
+    const auto num_joints = data.joints.size();
+    auto depths = std::vector<std::size_t>(num_joints);
+
+    for (auto i = std::size_t{0}; i < num_joints; ++i) {
+        auto depth = std::size_t{0};
+
+        for (auto parent = data.joints[i].parent; parent != -1; parent = data.joints[parent].parent) {
+            if (parent < -1 || parent >= int(num_joints)) {
+                throw std::runtime_error("load_skeleton: Joint \"" + data.joints[i].name + "\" has an invalid parent!");
+            }
+
+            if (++depth > num_joints) {
+                throw std::runtime_error("load_skeleton: Joint \"" + data.joints[i].name + "\" is its own ancestor!");
+            }
+        }
+
+        depths[i] = depth;
+    }
+
+    return depths;
+}
+
+} // namespace
+
 auto load_skeleton(const iqm::iqm_data& data) -> skeleton {
     constexpr bool orient90X = true;
     const auto rotfixer90X = glm::angleAxis(glm::radians(-90.f), glm::vec3{1, 0, 0});
 
     skeleton skele;
 
-    // Bones
+    // Bones are sorted by depth, keeping the file's order within each level.
+
+    const auto num_bones = data.joints.size();
+    const auto depths = get_joint_depths(data);
+
+    skele.joint_indices.resize(num_bones);
+    std::iota(begin(skele.joint_indices), end(skele.joint_indices), 0);
+    std::stable_sort(begin(skele.joint_indices), end(skele.joint_indices), [&](int a, int b) {
+        return depths[a] < depths[b];
+    });
+
+    auto bone_indices = std::vector<int>(num_bones);
 
-    skele.bones.reserve(data.joints.size());
+    for (auto i = std::size_t{0}; i < num_bones; ++i) {
+        bone_indices[skele.joint_indices[i]] = int(i);
 
-    for (const auto& iqm_joint : data.joints) {
+        if (i == 0 || depths[skele.joint_indices[i]] != depths[skele.joint_indices[i - 1]]) {
+            skele.levels.push_back(i);
+        }
+    }
+
+    skele.levels.push_back(num_bones);
+
+    skele.parents.reserve(num_bones);
+    skele.base_poses.reserve(num_bones);
+    skele.base_pose_inverses.reserve(num_bones);
+    skele.bone_names.reserve(num_bones);
+
+    for (auto joint_index : skele.joint_indices) {
+        const auto& iqm_joint = data.joints[joint_index];
 
         auto mat = glm::mat4(1.f);
         mat = glm::translate(mat, iqm_joint.pos);
         mat = mat * glm::mat4_cast(glm::normalize(iqm_joint.rot));
         mat = glm::scale(mat, iqm_joint.scl);
 
-        if (iqm_joint.parent >= 0) {
-            mat = skele.bones[iqm_joint.parent].base_pose * mat;
-        }
+        auto parent = iqm_joint.parent >= 0 ? bone_indices[iqm_joint.parent] : -1;
 
-        skeleton::bone b;
-        b.base_pose = mat;
-        b.base_pose_inverse = glm::inverse(mat);
-        b.parent = iqm_joint.parent;
-        b.name = iqm_joint.name;
+        if (parent >= 0) {
+            mat = skele.base_poses[parent] * mat;
+        }
 
-        skele.bones.push_back(std::move(b));
+        skele.parents.push_back(parent);
+        skele.base_poses.push_back(mat);
+        skele.base_pose_inverses.push_back(glm::inverse(mat));
+        skele.bone_names.push_back(iqm_joint.name);
     }
 
     // Animations
@@ -52,8 +108,19 @@ auto load_skeleton(const iqm::iqm_data& data) -> skeleton {
     auto current_frame_channel = 0u;
 
     if (!data.frames.empty() && data.num_framechannels > 0) {
-        for (auto frame_index = 0u; frame_index < data.frames.size() / data.num_framechannels; ++frame_index) {
-            for (auto joint_index = 0u; joint_index < data.poses.size(); ++joint_index) {
+        // Frames are stored per bone, so animations can't be played unless every joint has a pose.
+        if (data.poses.size() != num_bones) {
+            throw std::runtime_error(
+                "load_skeleton: Animations have " + std::to_string(data.poses.size()) + " poses, but there are " +
+                std::to_string(num_bones) + " joints!");
+        }
+
+        const auto num_frames = data.frames.size() / data.num_framechannels;
+
+        skele.frame_transforms.resize(num_frames * num_bones);
+
+        for (auto frame_index = std::size_t{0}; frame_index < num_frames; ++frame_index) {
+            for (auto joint_index = std::size_t{0}; joint_index < data.poses.size(); ++joint_index) {
                 const auto& pose = data.poses[joint_index];
 
                 auto pose_pos = glm::vec3{0, 0, 0};
@@ -86,12 +153,14 @@ auto load_skeleton(const iqm::iqm_data& data) -> skeleton {
                     assign_channel_value(i, value);
                 }
 
-                if (orient90X && skele.bones[joint_index].parent == -1) {
+                auto bone_index = bone_indices[joint_index];
+
+                if (orient90X && skele.parents[bone_index] == -1) {
                     pose_pos = rotfixer90X * pose_pos;
                     pose_rot = rotfixer90X * pose_rot;
                 }
 
-                skele.frame_transforms.push_back({ pose_pos, pose_rot, pose_scl });
+                skele.frame_transforms[frame_index * num_bones + bone_index] = { pose_pos, pose_rot, pose_scl };
             }
         }
     }
@@ -119,7 +188,7 @@ auto get_frame(const skeleton& skele, const skeleton::animation& anim, float tim
         frame = std::min(frame, anim.num_frames - 1);
     }
 
-    auto bones_per_frame = skele.bones.size();
+    auto bones_per_frame = skele.get_num_bones();
 
     auto start = begin(skele.frame_transforms) + bones_per_frame * (anim.first_frame + frame);
 
@@ -127,8 +196,8 @@ auto get_frame(const skeleton& skele, const skeleton::animation& anim, float tim
 }
 
 auto get_bone_index(const skeleton& skele, const std::string& name) -> std::optional<int> {
-    for (auto i = 0; i < skele.bones.size(); ++i) {
-        if (skele.bones[i].name == name) {
+    for (auto i = 0; i < skele.bone_names.size(); ++i) {
+        if (skele.bone_names[i] == name) {
             return i;
         }
     }
@@ -136,4 +205,12 @@ auto get_bone_index(const skeleton& skele, const std::string& name) -> std::opti
     return std::nullopt;
 }
 
+auto get_level_range(const skeleton& skele, std::size_t depth) -> std::pair<std::size_t, std::size_t> {
+    if (depth + 1 >= skele.levels.size()) {
+        return {skele.get_num_bones(), skele.get_num_bones()};
+    }
+
+    return {skele.levels[depth], skele.levels[depth + 1]};
+}
+
 } // namespace sushi
@@ -5,13 +5,21 @@
 #include "iqm.hpp"
 #include "transform.hpp"
 
+#include <cstddef>
 #include <string>
 #include <optional>
+#include <utility>
 #include <vector>
 
 /// Sushi
 namespace sushi {
 
+/// A skeleton and its animations.
+///
+/// Bones are sorted by depth in the hierarchy, so every bone comes after its parent,
+/// and the bones at each depth are contiguous (see `levels`).
+/// Per-bone data is split into separate arrays, so that per-frame loops only touch what they use.
+/// Bone indices therefore don't match the file's joint indices, which meshes refer to; see `joint_indices`.
 struct skeleton {
     struct animation {
         std::string name;
@@ -21,18 +29,24 @@ struct skeleton {
         bool loop;
     };
 
-    struct bone {
-        glm::mat4 base_pose;
-        glm::mat4 base_pose_inverse;
-        int parent;
-        std::string name;
-    };
+    auto get_num_bones() const -> std::size_t { return parents.size(); }
+
+    std::vector<int> parents; /** Parent of each bone, or -1 for roots. Always less than the bone's own index. */
+    std::vector<glm::mat4> base_pose_inverses; /** Inverse bind matrix of each bone. */
+    std::vector<int> joint_indices; /** Joint index of each bone, as used by meshes' blend indices. */
+    std::vector<std::size_t> levels; /** First bone of each depth level, then `get_num_bones()` to end the last level. */
 
-    std::vector<bone> bones;
-    std::vector<transform> frame_transforms;
+    std::vector<glm::mat4> base_poses; /** Model-space bind matrix of each bone. */
+    std::vector<std::string> bone_names;
+
+    std::vector<transform> frame_transforms; /** Local transforms of every bone, one frame after another. */
     std::vector<animation> animations;
 };
 
+/// Extracts the skeleton and animations of an IQM model.
+/// \param data The model.
+/// \return The skeleton.
+/// \throws std::runtime_error If the joints' parents don't form a hierarchy, or animations don't have a pose per joint.
 auto load_skeleton(const iqm::iqm_data& data) -> skeleton;
 
 auto get_animation_index(const skeleton& skele, const std::string& name) -> std::optional<int>;
@@ -41,6 +55,12 @@ auto get_frame(const skeleton& skele, const skeleton::animation& anim, float tim
 
 auto get_bone_index(const skeleton& skele, const std::string& name) -> std::optional<int>;
 
+/// Gets the bones at a depth in the hierarchy, which may all be evaluated in parallel.
+/// \param skele The skeleton.
+/// \param depth The depth, where roots are at 0.
+/// \return The bones' indices are `[first, second)`.
+auto get_level_range(const skeleton& skele, std::size_t depth) -> std::pair<std::size_t, std::size_t>;
+
 } // namespace sushi
 
 #endif // SUSHI_SKELETON_HPP
\ No newline at end of file
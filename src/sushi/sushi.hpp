@@ -9,7 +9,17 @@
 #include "mesh_builder.hpp"
 #include "skeleton.hpp"
 #include "pose.hpp"
+#include "pose_evaluator.hpp"
+#include "animation_batch.hpp"
+#include "bone_palette.hpp"
+#include "morph_targets.hpp"
 #include "mesh_builder.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_normals.hpp"
+#include "vertex_format.hpp"
+#include "dynamic_mesh_group.hpp"
+#include "mesh_arena.hpp"
+#include "mesh_registry.hpp"
 #include "obj_loader.hpp"
 #include "texture.hpp"
 #include "shader.hpp"
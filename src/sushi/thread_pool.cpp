@@ -0,0 +1,151 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace sushi {
+
+namespace {
+
+thread_local bool in_thread_pool_task = false;
+
+// The pool and thread index of the task running on this thread, so that nested loops can keep the same index.
+thread_local const thread_pool* current_task_pool = nullptr;
+thread_local unsigned current_task_thread = 0;
+
+} // namespace
+
+thread_pool::thread_pool(unsigned num_threads) {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    num_threads = 1;
+#endif
+
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    workers.reserve(num_threads - 1);
+
+    for (auto i = 1u; i < num_threads; ++i) {
+        workers.emplace_back([this, i]{ worker_main(i); });
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        auto lock = std::unique_lock(mutex);
+        stopping = true;
+    }
+
+    wake.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void thread_pool::run(std::size_t num_tasks, void* ctx, invoke_func invoke) {
+    if (num_tasks == 0) {
+        return;
+    }
+
+    if (workers.empty() || num_tasks == 1 || in_thread_pool_task) {
+        // Within one of this pool's tasks, the thread keeps its index, since other threads may be using theirs.
+        auto thread = current_task_pool == this ? current_task_thread : 0u;
+
+        for (auto i = std::size_t{0}; i < num_tasks; ++i) {
+            invoke(ctx, i, thread);
+        }
+        return;
+    }
+
+    auto run_lock = std::unique_lock(run_mutex);
+
+    job j;
+    j.ctx = ctx;
+    j.invoke = invoke;
+    j.num_tasks = num_tasks;
+
+    {
+        auto lock = std::unique_lock(mutex);
+        current_job = &j;
+        ++generation;
+    }
+
+    wake.notify_all();
+
+    work(j, 0);
+
+    {
+        auto lock = std::unique_lock(mutex);
+        current_job = nullptr;
+        done.wait(lock, [&]{ return j.active_workers == 0; });
+    }
+
+    if (j.error) {
+        std::rethrow_exception(j.error);
+    }
+}
+
+void thread_pool::work(job& j, unsigned thread_index) {
+    in_thread_pool_task = true;
+    current_task_pool = this;
+    current_task_thread = thread_index;
+
+    while (true) {
+        auto task = j.next_task.fetch_add(1, std::memory_order_relaxed);
+
+        if (task >= j.num_tasks) {
+            break;
+        }
+
+        try {
+            j.invoke(j.ctx, task, thread_index);
+        } catch (...) {
+            auto lock = std::unique_lock(j.error_mutex);
+            if (!j.error) {
+                j.error = std::current_exception();
+            }
+        }
+    }
+
+    in_thread_pool_task = false;
+    current_task_pool = nullptr;
+    current_task_thread = 0;
+}
+
+void thread_pool::worker_main(unsigned thread_index) {
+    auto seen_generation = std::size_t{0};
+
+    while (true) {
+        job* j = nullptr;
+
+        {
+            auto lock = std::unique_lock(mutex);
+            wake.wait(lock, [&]{ return stopping || (current_job && generation != seen_generation); });
+
+            if (stopping) {
+                return;
+            }
+
+            seen_generation = generation;
+            j = current_job;
+            ++j->active_workers;
+        }
+
+        work(*j, thread_index);
+
+        {
+            auto lock = std::unique_lock(mutex);
+            --j->active_workers;
+        }
+
+        done.notify_all();
+    }
+}
+
+auto default_thread_pool() -> thread_pool& {
+    static thread_pool pool;
+    return pool;
+}
+
+} // namespace sushi
@@ -0,0 +1,75 @@
+#ifndef SUSHI_THREAD_POOL_HPP
+#define SUSHI_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// Sushi
+namespace sushi {
+
+/// A fixed set of worker threads for running data-parallel loops.
+/// Only one loop runs at a time; the calling thread participates in the loop.
+class thread_pool {
+public:
+    /// Constructs a pool.
+    /// \param num_threads Total number of threads to run loops on, including the calling thread. 0 uses all hardware threads.
+    explicit thread_pool(unsigned num_threads = 0);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    /// Gets the number of threads loops are run on, including the calling thread.
+    auto size() const -> unsigned { return unsigned(workers.size()) + 1; }
+
+    /// Calls `func(task_index, thread_index)` for every `task_index` in `[0, num_tasks)`, and waits for all of them.
+    /// `thread_index` is in `[0, size())` and is unique among concurrently running tasks, so it can index per-thread scratch memory.
+    /// If called from within a task, the loop runs serially on the current thread, keeping that task's `thread_index`.
+    /// If any task throws, the first exception is rethrown once all tasks have finished.
+    template <typename F>
+    void parallel_for(std::size_t num_tasks, F&& func) {
+        auto invoke = [](void* ctx, std::size_t task, unsigned thread) {
+            (*static_cast<std::remove_reference_t<F>*>(ctx))(task, thread);
+        };
+        run(num_tasks, &func, invoke);
+    }
+
+private:
+    using invoke_func = void (*)(void* ctx, std::size_t task, unsigned thread);
+
+    struct job {
+        void* ctx = nullptr;
+        invoke_func invoke = nullptr;
+        std::size_t num_tasks = 0;
+        std::atomic<std::size_t> next_task = 0;
+        std::atomic<unsigned> active_workers = 0;
+        std::exception_ptr error;
+        std::mutex error_mutex;
+    };
+
+    void run(std::size_t num_tasks, void* ctx, invoke_func invoke);
+    void work(job& j, unsigned thread_index);
+    void worker_main(unsigned thread_index);
+
+    std::vector<std::thread> workers;
+    std::mutex run_mutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    job* current_job = nullptr;
+    std::size_t generation = 0;
+    bool stopping = false;
+};
+
+/// Gets a process-wide pool using all hardware threads. It is created on first use.
+auto default_thread_pool() -> thread_pool&;
+
+} // namespace sushi
+
+#endif // SUSHI_THREAD_POOL_HPP
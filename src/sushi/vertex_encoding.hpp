@@ -0,0 +1,113 @@
+#ifndef SUSHI_VERTEX_ENCODING_HPP
+#define SUSHI_VERTEX_ENCODING_HPP
+
+#include "gl.hpp"
+#include "attrib_location.hpp"
+#include "common.hpp"
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace sushi {
+
+namespace _detail {
+
+/// Describes one vertex attribute array, prior to upload.
+struct attrib_source {
+    attrib_location loc;
+    GLint size;
+    GLenum type;
+    GLboolean normalize;
+    std::array<float, 4> init;
+    const void* data; /** Null if the attribute is not present. */
+};
+
+inline auto get_type_size(GLenum type) -> std::size_t {
+    switch (type) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+            return 2;
+        default:
+            return 4;
+    }
+}
+
+/// Gets the size of a single element of an attribute, in bytes.
+inline auto get_attrib_size(const attrib_source& src) -> std::size_t {
+    return src.size * get_type_size(src.type);
+}
+
+/// Maps a unit vector onto the octahedron, then unfolds it into the [-1,1] square.
+inline auto encode_octahedral(float x, float y, float z) -> std::array<float, 2> {
+    auto l1 = std::abs(x) + std::abs(y) + std::abs(z);
+
+    if (l1 == 0) {
+        return {0, 0};
+    }
+
+    x /= l1;
+    y /= l1;
+    z /= l1;
+
+    if (z < 0) {
+        auto ox = (1 - std::abs(y)) * (x >= 0 ? 1.f : -1.f);
+        auto oy = (1 - std::abs(x)) * (y >= 0 ? 1.f : -1.f);
+        return {ox, oy};
+    }
+
+    return {x, y};
+}
+
+template <typename T>
+auto quantize_unorm(float f) -> T {
+    constexpr auto max = float(std::numeric_limits<T>::max());
+    return T(std::lround(std::clamp(f, 0.f, 1.f) * max));
+}
+
+template <typename T>
+auto quantize_snorm(float f) -> T {
+    constexpr auto max = float(std::numeric_limits<T>::max());
+    return T(std::lround(std::clamp(f, -1.f, 1.f) * max));
+}
+
+/// Byte layout of a single interleaved vertex.
+struct interleaved_layout {
+    GLsizei stride = 0;
+    std::array<std::size_t, 7> offsets = {}; /** Indexed by attrib_location. */
+};
+
+/// Packs every present attribute into a single vertex, keeping each attribute 4-byte aligned.
+inline auto make_interleaved_layout(span<const attrib_source> sources) -> interleaved_layout {
+    interleaved_layout layout;
+
+    for (const auto& src : sources) {
+        if (src.data) {
+            layout.offsets[static_cast<GLuint>(src.loc)] = layout.stride;
+            layout.stride += GLsizei((get_attrib_size(src) + 3) / 4 * 4);
+        }
+    }
+
+    return layout;
+}
+
+/// The formats of a group's vertex attributes, as stored in its buffers.
+struct vertex_encoding {
+    std::array<attrib_source, 7> attribs; /** Same order as the sources they were created from. */
+    std::size_t num_attribs = 0;
+    interleaved_layout interleaved;
+
+    auto get_attribs() const -> span<const attrib_source> { return {attribs.data(), num_attribs}; }
+};
+
+} // _detail
+
+} // sushi
+
+#endif // SUSHI_VERTEX_ENCODING_HPP
@@ -0,0 +1,50 @@
+#include "vertex_format.hpp"
+
+#include "mesh_utils.hpp"
+
+namespace sushi {
+
+namespace _detail {
+
+auto bake_packed_meshes(
+    const vertex_encoding& encoding,
+    const void* vertex_data,
+    std::size_t num_vertices,
+    span<const packed_mesh_data> meshes,
+    span<const glm::vec3> positions,
+    const mesh_options& options) -> mesh_blob {
+
+    mesh_blob blob;
+    blob.options = options;
+    blob.format = encoding;
+
+    auto bytes = static_cast<const unsigned char*>(vertex_data);
+    blob.vertex_data.assign(bytes, bytes + num_vertices * encoding.interleaved.stride);
+
+    bake_elements(blob, meshes, num_vertices, positions);
+
+    return blob;
+}
+
+auto upload_packed_meshes(const mesh_blob& blob, void (*bind)(GLuint vertex_buffer)) -> mesh_group {
+    mesh_group group;
+    group.options = blob.options;
+    group.meshes = blob.meshes;
+    group.bounds = blob.bounds;
+    group.vertex_buffer = load_buffer(GL_ARRAY_BUFFER, blob.vertex_data.data(), blob.vertex_data.size());
+
+    group.vao = make_unique_vertex_array();
+    glBindVertexArray(group.vao.get());
+    SUSHI_DEFER { glBindVertexArray(0); };
+
+    group.index_type = blob.index_type;
+    group.index_buffer = load_buffer(GL_ELEMENT_ARRAY_BUFFER, blob.index_data.data(), blob.index_data.size());
+
+    bind(group.vertex_buffer.get());
+
+    return group;
+}
+
+} // namespace _detail
+
+} // namespace sushi
@@ -0,0 +1,435 @@
+#ifndef SUSHI_VERTEX_FORMAT_HPP
+#define SUSHI_VERTEX_FORMAT_HPP
+
+#include "gl.hpp"
+#include "attrib_location.hpp"
+#include "common.hpp"
+#include "mesh_group.hpp"
+#include "vertex_encoding.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// Sushi
+namespace sushi {
+
+namespace _detail {
+
+/// Common properties of vertex attribute descriptors.
+template <attrib_location Loc, typename Value, typename Component, GLint Size, GLenum Type, GLboolean Normalize>
+struct attrib_traits {
+    using value_type = Value; /** The type attribute values are given as. */
+    using component_type = Component; /** The type each component is stored as. */
+
+    static constexpr attrib_location location = Loc;
+    static constexpr GLint size = Size;
+    static constexpr GLenum type = Type;
+    static constexpr GLboolean normalize = Normalize;
+    static constexpr std::size_t bytes = sizeof(Component) * Size;
+    static constexpr bool octahedral = false;
+};
+
+/// Marks attributes as present in a vertex_encoding, which otherwise expects a pointer to their data.
+inline constexpr char packed_attrib_present = 0;
+
+inline auto decode_octahedral(const std::int16_t* in) -> glm::vec3 {
+    auto x = std::max(in[0] / 32767.f, -1.f);
+    auto y = std::max(in[1] / 32767.f, -1.f);
+    auto z = 1 - std::abs(x) - std::abs(y);
+
+    if (z < 0) {
+        auto ox = (1 - std::abs(y)) * (x >= 0 ? 1.f : -1.f);
+        auto oy = (1 - std::abs(x)) * (y >= 0 ? 1.f : -1.f);
+        x = ox;
+        y = oy;
+    }
+
+    return glm::normalize(glm::vec3(x, y, z));
+}
+
+inline void encode_octahedral(const glm::vec3& v, std::int16_t* out) {
+    auto e = encode_octahedral(v.x, v.y, v.z);
+    out[0] = quantize_snorm<std::int16_t>(e[0]);
+    out[1] = quantize_snorm<std::int16_t>(e[1]);
+}
+
+} // namespace _detail
+
+/// Position as 3 floats.
+struct pos3f : _detail::attrib_traits<attrib_location::POSITION, glm::vec3, GLfloat, 3, GL_FLOAT, GL_FALSE> {
+    static void encode(const glm::vec3& v, GLfloat* out) { out[0] = v.x; out[1] = v.y; out[2] = v.z; }
+    static auto decode(const GLfloat* in) -> glm::vec3 { return {in[0], in[1], in[2]}; }
+};
+
+/// Texture coordinates as 2 floats.
+struct uv2f : _detail::attrib_traits<attrib_location::TEXCOORD, glm::vec2, GLfloat, 2, GL_FLOAT, GL_FALSE> {
+    static void encode(const glm::vec2& v, GLfloat* out) { out[0] = v.x; out[1] = v.y; }
+    static auto decode(const GLfloat* in) -> glm::vec2 { return {in[0], in[1]}; }
+};
+
+/// Texture coordinates as 2 half floats.
+struct uv2h : _detail::attrib_traits<attrib_location::TEXCOORD, glm::vec2, std::uint16_t, 2, GL_HALF_FLOAT, GL_FALSE> {
+    static void encode(const glm::vec2& v, std::uint16_t* out) {
+        out[0] = glm::packHalf1x16(v.x);
+        out[1] = glm::packHalf1x16(v.y);
+    }
+    static auto decode(const std::uint16_t* in) -> glm::vec2 {
+        return {glm::unpackHalf1x16(in[0]), glm::unpackHalf1x16(in[1])};
+    }
+};
+
+/// Texture coordinates as 2 16-bit normalized integers. Only suitable for texture coordinates within [0,1].
+struct uv2u16 : _detail::attrib_traits<attrib_location::TEXCOORD, glm::vec2, std::uint16_t, 2, GL_UNSIGNED_SHORT, GL_TRUE> {
+    static void encode(const glm::vec2& v, std::uint16_t* out) {
+        out[0] = _detail::quantize_unorm<std::uint16_t>(v.x);
+        out[1] = _detail::quantize_unorm<std::uint16_t>(v.y);
+    }
+    static auto decode(const std::uint16_t* in) -> glm::vec2 { return {in[0] / 65535.f, in[1] / 65535.f}; }
+};
+
+/// Normal as 3 floats.
+struct normal3f : _detail::attrib_traits<attrib_location::NORMAL, glm::vec3, GLfloat, 3, GL_FLOAT, GL_FALSE> {
+    static void encode(const glm::vec3& v, GLfloat* out) { out[0] = v.x; out[1] = v.y; out[2] = v.z; }
+    static auto decode(const GLfloat* in) -> glm::vec3 { return {in[0], in[1], in[2]}; }
+};
+
+/// Unit normal, octahedral-encoded as 2 16-bit normalized integers. See `decode_octahedral` in `assets/vert.glsl`.
+struct normal_oct16 : _detail::attrib_traits<attrib_location::NORMAL, glm::vec3, std::int16_t, 2, GL_SHORT, GL_TRUE> {
+    static constexpr bool octahedral = true;
+    static void encode(const glm::vec3& v, std::int16_t* out) { _detail::encode_octahedral(v, out); }
+    static auto decode(const std::int16_t* in) -> glm::vec3 { return _detail::decode_octahedral(in); }
+};
+
+/// Tangent as 3 floats.
+struct tangent3f : _detail::attrib_traits<attrib_location::TANGENT, glm::vec3, GLfloat, 3, GL_FLOAT, GL_FALSE> {
+    static void encode(const glm::vec3& v, GLfloat* out) { out[0] = v.x; out[1] = v.y; out[2] = v.z; }
+    static auto decode(const GLfloat* in) -> glm::vec3 { return {in[0], in[1], in[2]}; }
+};
+
+/// Unit tangent, octahedral-encoded as 2 16-bit normalized integers.
+struct tangent_oct16 : _detail::attrib_traits<attrib_location::TANGENT, glm::vec3, std::int16_t, 2, GL_SHORT, GL_TRUE> {
+    static constexpr bool octahedral = true;
+    static void encode(const glm::vec3& v, std::int16_t* out) { _detail::encode_octahedral(v, out); }
+    static auto decode(const std::int16_t* in) -> glm::vec3 { return _detail::decode_octahedral(in); }
+};
+
+/// Bone indices as 4 bytes.
+struct joints4ub : _detail::attrib_traits<attrib_location::BLENDINDICES, glm::ivec4, GLubyte, 4, GL_UNSIGNED_BYTE, GL_FALSE> {
+    static void encode(const glm::ivec4& v, GLubyte* out) { for (auto i = 0; i < 4; ++i) out[i] = GLubyte(v[i]); }
+    static auto decode(const GLubyte* in) -> glm::ivec4 { return {in[0], in[1], in[2], in[3]}; }
+};
+
+/// Bone weights as 4 bytes, where 255 is a weight of 1.
+struct weights4ub : _detail::attrib_traits<attrib_location::BLENDWEIGHTS, glm::ivec4, GLubyte, 4, GL_UNSIGNED_BYTE, GL_TRUE> {
+    static void encode(const glm::ivec4& v, GLubyte* out) { for (auto i = 0; i < 4; ++i) out[i] = GLubyte(v[i]); }
+    static auto decode(const GLubyte* in) -> glm::ivec4 { return {in[0], in[1], in[2], in[3]}; }
+};
+
+/// Color as 4 floats.
+struct color4f : _detail::attrib_traits<attrib_location::COLOR, glm::vec4, GLfloat, 4, GL_FLOAT, GL_FALSE> {
+    static void encode(const glm::vec4& v, GLfloat* out) { out[0] = v.x; out[1] = v.y; out[2] = v.z; out[3] = v.w; }
+    static auto decode(const GLfloat* in) -> glm::vec4 { return {in[0], in[1], in[2], in[3]}; }
+};
+
+/// Color as 4 8-bit normalized integers.
+struct color4ub : _detail::attrib_traits<attrib_location::COLOR, glm::vec4, GLubyte, 4, GL_UNSIGNED_BYTE, GL_TRUE> {
+    static void encode(const glm::vec4& v, GLubyte* out) {
+        for (auto i = 0; i < 4; ++i) out[i] = _detail::quantize_unorm<GLubyte>(v[i]);
+    }
+    static auto decode(const GLubyte* in) -> glm::vec4 {
+        return {in[0] / 255.f, in[1] / 255.f, in[2] / 255.f, in[3] / 255.f};
+    }
+};
+
+namespace _detail {
+
+template <typename A, typename... Attribs>
+constexpr auto get_attrib_offset() -> std::size_t {
+    constexpr bool matches[] = {std::is_same_v<A, Attribs>...};
+    constexpr std::size_t sizes[] = {Attribs::bytes...};
+    auto offset = std::size_t{0};
+    for (auto i = std::size_t{0}; i < sizeof...(Attribs) && !matches[i]; ++i) {
+        offset += sizes[i];
+    }
+    return offset;
+}
+
+template <typename... Attribs>
+constexpr auto has_unique_locations() -> bool {
+    constexpr attrib_location locs[] = {Attribs::location...};
+    for (auto i = std::size_t{0}; i < sizeof...(Attribs); ++i) {
+        for (auto j = i + 1; j < sizeof...(Attribs); ++j) {
+            if (locs[i] == locs[j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/// Describes a packed vertex, in the same form as encodings chosen at runtime, so that it can be bound by `upload`.
+template <typename... Attribs>
+constexpr auto make_packed_encoding() -> vertex_encoding {
+    vertex_encoding encoding{};
+    encoding.num_attribs = 7;
+
+    // Attributes which are not present are still listed, so that binding sets their default value.
+    for (auto i = 0u; i < 7; ++i) {
+        auto loc = static_cast<attrib_location>(i);
+        auto init = loc == attrib_location::COLOR ? std::array<float, 4>{1, 1, 1, 1} : std::array<float, 4>{0, 0, 0, 0};
+        encoding.attribs[i] = {loc, 4, GL_FLOAT, GL_FALSE, init, nullptr};
+    }
+
+    constexpr attrib_source present[] = {
+        {Attribs::location, Attribs::size, Attribs::type, Attribs::normalize, {0, 0, 0, 0}, &packed_attrib_present}...};
+    constexpr std::size_t sizes[] = {Attribs::bytes...};
+
+    for (auto i = std::size_t{0}; i < sizeof...(Attribs); ++i) {
+        auto loc = static_cast<GLuint>(present[i].loc);
+        auto init = encoding.attribs[loc].init;
+        encoding.attribs[loc] = present[i];
+        encoding.attribs[loc].init = init;
+        encoding.interleaved.offsets[loc] = std::size_t(encoding.interleaved.stride);
+        encoding.interleaved.stride += GLsizei(sizes[i]);
+    }
+
+    return encoding;
+}
+
+/// A mesh in a packed_mesh_builder.
+struct packed_mesh_data {
+    std::string name;
+    std::vector<GLuint> elements;
+};
+
+/// Bakes already packed vertices, and the given meshes, into a blob.
+auto bake_packed_meshes(
+    const vertex_encoding& encoding,
+    const void* vertex_data,
+    std::size_t num_vertices,
+    span<const packed_mesh_data> meshes,
+    span<const glm::vec3> positions,
+    const mesh_options& options) -> mesh_blob;
+
+/// Uploads a packed blob's buffers, then calls `bind` with its vertex array object bound.
+/// \param blob A blob baked by a packed_mesh_builder.
+/// \param bind Binds the vertex attributes from the given vertex buffer.
+auto upload_packed_meshes(const mesh_blob& blob, void (*bind)(GLuint vertex_buffer)) -> mesh_group;
+
+} // namespace _detail
+
+/// A vertex format fixed at compile time, such as `vertex_format<pos3f, uv2h, normal_oct16>`.
+/// Attributes are packed together in the order given, with no padding, into a single interleaved buffer.
+/// \tparam Attribs Attribute descriptors, at most one per attrib_location.
+template <typename... Attribs>
+struct vertex_format {
+    static_assert(sizeof...(Attribs) > 0, "A vertex format needs at least one attribute");
+    static_assert(_detail::has_unique_locations<Attribs...>(), "Each attribute location can only be used once");
+    static_assert(((Attribs::bytes % 4 == 0) && ...), "Attributes must be multiples of 4 bytes, to stay aligned");
+
+    /// Size of a vertex, in bytes.
+    static constexpr GLsizei stride = GLsizei((Attribs::bytes + ...));
+
+    /// Offset of an attribute within a vertex, in bytes.
+    template <typename A>
+    static constexpr std::size_t offset_of = _detail::get_attrib_offset<A, Attribs...>();
+
+    /// Whether the format has an attribute at the given location.
+    template <attrib_location Loc>
+    static constexpr bool has = ((Attribs::location == Loc) || ...);
+
+    /// Whether normals and tangents are octahedral-encoded.
+    static constexpr bool octahedral_normals = (Attribs::octahedral || ...);
+
+    static_assert(
+        ((Attribs::octahedral == octahedral_normals
+            || (Attribs::location != attrib_location::NORMAL && Attribs::location != attrib_location::TANGENT)) && ...),
+        "Normals and tangents must either both be octahedral or both not be");
+
+    /// Encodings of every attribute location, as consumed by `upload`.
+    static constexpr _detail::vertex_encoding encoding = _detail::make_packed_encoding<Attribs...>();
+
+    /// A single vertex, with every attribute encoded and packed together.
+    class vertex {
+    public:
+        /// Constructs a vertex with every attribute zeroed.
+        vertex() = default;
+
+        /// Constructs a vertex from a value for each attribute, in the format's order.
+        explicit vertex(const typename Attribs::value_type&... values) {
+            (set<Attribs>(values), ...);
+        }
+
+        /// Encodes an attribute's value.
+        template <typename A>
+        auto set(const typename A::value_type& value) -> vertex& {
+            typename A::component_type components[A::size];
+            A::encode(value, components);
+            std::memcpy(data + offset_of<A>, components, A::bytes);
+            return *this;
+        }
+
+        /// Decodes an attribute's value.
+        template <typename A>
+        auto get() const -> typename A::value_type {
+            typename A::component_type components[A::size];
+            std::memcpy(components, data + offset_of<A>, A::bytes);
+            return A::decode(components);
+        }
+
+    private:
+        alignas(4) unsigned char data[stride] = {};
+    };
+
+    static_assert(sizeof(vertex) == std::size_t(stride), "Vertices must be tightly packed");
+
+    /// Binds the attributes to the current vertex array object, with every location, type, and offset fixed at compile time.
+    /// Locations the format does not have are left disabled, with their default values.
+    /// \param vertex_buffer The interleaved vertex buffer.
+    static void bind(GLuint vertex_buffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        (bind_attrib<Attribs>(), ...);
+        init_missing(std::make_integer_sequence<GLuint, 7>());
+    }
+
+    /// Gets the options describing how this format stores vertices.
+    /// \param options Options to take the index and level of detail settings from.
+    static auto get_options(mesh_options options = {}) -> mesh_options {
+        options.layout = vertex_layout::INTERLEAVED;
+        options.octahedral_normals = octahedral_normals;
+        return options;
+    }
+
+private:
+    template <typename A>
+    static void bind_attrib() {
+        constexpr auto loc = static_cast<GLuint>(A::location);
+        glEnableVertexAttribArray(loc);
+        glVertexAttribPointer(loc, A::size, A::type, A::normalize, stride, reinterpret_cast<const void*>(offset_of<A>));
+    }
+
+    template <GLuint... Locs>
+    static void init_missing(std::integer_sequence<GLuint, Locs...>) {
+        (init_missing<Locs>(), ...);
+    }
+
+    template <GLuint Loc>
+    static void init_missing() {
+        if constexpr (!has<attrib_location(Loc)>) {
+            constexpr auto value = attrib_location(Loc) == attrib_location::COLOR ? 1.f : 0.f;
+            glVertexAttrib4f(Loc, value, value, value, value);
+        }
+    }
+};
+
+/// Uploads meshes baked by a packed_mesh_builder. Must be called on the GL context's thread.
+/// Unlike `upload`, the attributes are bound by `Format::bind`, with no per-attribute work at runtime.
+/// \tparam Format The vertex_format the blob was baked with.
+/// \param blob The baked meshes.
+/// \return The meshes.
+template <typename Format>
+auto upload_packed(const mesh_blob& blob) -> mesh_group {
+    return _detail::upload_packed_meshes(blob, &Format::bind);
+}
+
+/// Builds meshes whose vertices are given directly in a compile-time vertex_format.
+/// Vertices are stored exactly as they will be uploaded, so baking does no per-attribute work.
+/// \tparam Format A vertex_format.
+template <typename Format>
+class packed_mesh_builder {
+public:
+    using vertex_type = typename Format::vertex;
+
+    /// Starts a new mesh. Triangles added before the first call go into an unnamed mesh.
+    void mesh(std::string name) {
+        meshes.push_back({std::move(name), {}});
+    }
+
+    /// Reserves memory for vertices and indices, to avoid reallocation while building.
+    /// \param vertices Number of vertices which will be added in total.
+    /// \param indices Number of indices which will be added to the current (or next) mesh.
+    void reserve(std::size_t vertices, std::size_t indices) {
+        verts.reserve(vertices);
+        current_mesh().elements.reserve(current_mesh().elements.size() + indices);
+    }
+
+    /// Adds a vertex.
+    /// \return The index of the vertex.
+    auto vertex(const vertex_type& v) -> GLuint {
+        verts.push_back(v);
+        return GLuint(verts.size() - 1);
+    }
+
+    /// Adds many vertices.
+    /// \return The index of the first vertex.
+    auto vertices(span<const vertex_type> vs) -> GLuint {
+        auto first = GLuint(verts.size());
+        verts.insert(end(verts), vs.begin(), vs.end());
+        return first;
+    }
+
+    void tri(GLuint a, GLuint b, GLuint c) {
+        auto& elements = current_mesh().elements;
+        elements.insert(end(elements), {a, b, c});
+    }
+
+    /// Adds triangles to the current mesh.
+    /// \param indices Vertex indices, three per triangle.
+    /// \param base_vertex Added to every index.
+    void tris(span<const GLuint> indices, GLuint base_vertex = 0) {
+        auto& elements = current_mesh().elements;
+        for (auto i = std::size_t{0}; i < indices.size() / 3 * 3; ++i) {
+            elements.push_back(indices[i] + base_vertex);
+        }
+    }
+
+    /// Bakes the meshes for upload, without any GL calls.
+    /// \param options Index and level of detail options. The vertex options are determined by the format.
+    /// \return The baked data, to be passed to `upload_packed<Format>` on the GL thread.
+    auto bake(const mesh_options& options = {}) const -> mesh_blob {
+        auto positions = std::vector<glm::vec3>();
+
+        if constexpr (Format::template has<attrib_location::POSITION>) {
+            positions.reserve(verts.size());
+            for (const auto& v : verts) {
+                positions.push_back(v.template get<pos3f>());
+            }
+        }
+
+        return _detail::bake_packed_meshes(
+            Format::encoding,
+            verts.data(),
+            verts.size(),
+            meshes,
+            positions,
+            Format::get_options(options));
+    }
+
+    /// Bakes and uploads the meshes. Must be called on the GL context's thread.
+    /// \param options Index and level of detail options. The vertex options are determined by the format.
+    /// \return The meshes.
+    auto get(const mesh_options& options = {}) const -> mesh_group {
+        return upload_packed<Format>(bake(options));
+    }
+
+private:
+    auto current_mesh() -> _detail::packed_mesh_data& {
+        if (meshes.empty()) {
+            meshes.push_back({});
+        }
+        return meshes.back();
+    }
+
+    std::vector<vertex_type> verts;
+    std::vector<_detail::packed_mesh_data> meshes;
+};
+
+} // namespace sushi
+
+#endif // SUSHI_VERTEX_FORMAT_HPP
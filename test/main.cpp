@@ -27,7 +27,6 @@ public:
         uniforms.DiffuseTexture = get_uniform_location("DiffuseTexture");
         uniforms.GrayScale = get_uniform_location("GrayScale");
         uniforms.Animated = get_uniform_location("Animated");
-        uniforms.Bones = get_uniform_location("Bones");
     }
 
     void set_MVP(const mat4& mat) {
@@ -46,17 +45,12 @@ public:
         sushi::set_current_program_uniform(uniforms.Animated, +b);
     }
 
-    void set_Bones(const glm::mat4* mats, int num_mats) {
-        glUniformMatrix4fv(uniforms.Bones, num_mats, GL_FALSE, &mats[0][0].x);
-    }
-
 private:
     struct {
         GLint MVP;
         GLint DiffuseTexture;
         GLint GrayScale;
         GLint Animated;
-        GLint Bones;
     } uniforms;
 };
 
@@ -119,6 +113,7 @@ int main() try {
 
     auto texture = sushi::load_texture_2d("assets/test.png", false, false, false, false);
     auto mesh = sushi::load_obj_file("assets/test.obj").value_or(sushi::mesh_group{});
+    auto plain_mesh = sushi::load_obj_file("assets/plain.obj").value_or(sushi::mesh_group{});
     auto program = example_shader();
     auto xrot = 0.f;
     auto yrot = 0.f;
@@ -129,6 +124,7 @@ int main() try {
     auto player_anim = sushi::get_animation_index(player_skele, "Walk");
     auto player_anim_time = 0.f;
     auto player_tex = sushi::load_texture_2d("assets/player.png", true, false, true, true);
+    auto player_palettes = sushi::bone_palette_buffer();
 
     auto data = window_data{};
 
@@ -194,6 +190,24 @@ int main() try {
             sushi::draw_mesh(mesh);
         }
 
+        // draw mesh without texcoords or normals
+        {
+            auto model_mat = glm::mat4(1.f);
+
+            model_mat = glm::translate(model_mat, glm::vec3{0, 1, 0});
+            model_mat = glm::rotate(model_mat, yrot, glm::vec3{0, 1, 0});
+            model_mat = glm::scale(model_mat, glm::vec3{0.25, 0.25, 0.25});
+
+            auto mvp = proj_mat * view_mat * model_mat;
+
+            program.bind();
+            program.set_MVP(mvp);
+            program.set_DiffuseTexture(0);
+            program.set_GrayScale(data.a_down);
+            sushi::set_texture(0, texture);
+            sushi::draw_mesh(plain_mesh);
+        }
+
         // draw animated mesh
         {
             auto model_mat = glm::mat4(1.f);
@@ -208,7 +222,7 @@ int main() try {
             program.set_GrayScale(data.a_down);
             sushi::set_texture(0, player_tex);
             auto pose = sushi::get_pose(player_skele, player_anim, player_anim_time, data.s_down);
-            sushi::draw_mesh(player_meshes, pose);
+            sushi::draw_mesh(player_meshes, pose, player_palettes);
             player_anim_time += delta;
         }
 